@@ -14,72 +14,85 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-
-#include <gmp.h>
+#include <string.h>
 #include "curve25519.h"
 #include "base32.h"
 
-static char base32chars[32] = {
+static const char base32chars[32] = {
   'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h',
   'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p',
   'q', 'r', 's', 't', 'u', 'v', 'w', 'x',
   'y', 'z', '2', '3', '4', '5', '6', '7'
 };
 
+/* Value of each character; anything but '2' to '7' counts as
+   (c - 'a') mod 32, so upper case letters work as well */
+static const unsigned char base32values[256] = {
+  31, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30,
+  31, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+  15, 16, 26, 27, 28, 29, 30, 31, 23, 24, 25, 26, 27, 28, 29, 30,
+  31, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30,
+  31, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30,
+  31, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30,
+  31, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30,
+  31, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30,
+  31, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30,
+};
+
+/* Digit i holds bits 5i to 5i + 4; the 52nd digit (bit 255) is only
+   written if it is not zero.  Returns the number of characters. */
+static unsigned int
+encode(char *s, const unsigned char *b) {
+  unsigned int n = (b[31] & 0x80) ? 52 : 51, i;
+  for (i = 0; i < n; i++) {
+    unsigned int o = 5 * i, j = o / 8;
+    unsigned int v = b[j] | ((j < 31) ? (b[j + 1] << 8) : 0);
+    s[n - 1 - i] = base32chars[(v >> (o % 8)) & 31];
+  }
+  return n;
+}
+
 extern void
 base32_encode(char*s, curve25519key_t *x) {
-  int c; int i = 0; int v = 0; int a = 0;
-  for (c = 0; c < C25519BITS; c++) {
-    v |= curve25519key_getbit(x, c) << i;
-    /* fprintf(stderr, "v: %x\n", v); */
-    i++;
-    if (i > 4) {
-      s[a] = base32chars[v];
-      v = 0;
-      i = 0;
-      a++;
-    }
-  }
-  if (v) {
-    s[a] = base32chars[v];
-    a++;
-  }
-  s[a] = 0;
-  a--;
-  i=0;
-  while (i < a) {
-    v = s[a];
-    s[a] = s[i];
-    s[i] = v;
-    i++; a--;
+  unsigned char b[32];
+  curve25519key_to_bytes(b, x);
+  s[encode(s, b)] = 0;
+}
+
+extern size_t
+base32_encode_n(char *s, curve25519key_t *x, unsigned int n) {
+  unsigned char b[32];
+  char *t = s;
+  unsigned int i;
+  for (i = 0; i < n; i++) {
+    curve25519key_to_bytes(b, x + i);
+    t += encode(t, b);
+    *t++ = '\n';
   }
+  return t - s;
 }
 
+/* Digits are taken from the end of s; those past bit 255 are ignored */
 extern void
 base32_decode(const char*s, curve25519key_t *x) {
-  int c; int i = 0; int v = 0; int a = 0;
-  while (s[a]) {
-    a++;
-  }
-  a--;
-  while (a >= 0) {
-    c = s[a];
-    switch (c) {
-    case '2': case '3': case '4': case '5': case '6': case '7':
-      v = (c - '2')+26;
-      break;
-    default:
-      v = c - 'a';
+  unsigned char b[32];
+  unsigned int i = 0;
+  size_t a = strlen(s);
+  memset(b, 0, sizeof(b));
+  while ((a > 0) && (i < C25519BITS)) {
+    unsigned int v = base32values[(unsigned char)s[--a]] << (i % 8);
+    b[i / 8] |= v;
+    if (i / 8 < 31) {
+      b[i / 8 + 1] |= v >> 8;
     }
-    curve25519key_setbit(x, i, v&1); v>>=1; i++; if (i >= C25519BITS) { break; };
-    curve25519key_setbit(x, i, v&1); v>>=1; i++; if (i >= C25519BITS) { break; };
-    curve25519key_setbit(x, i, v&1); v>>=1; i++; if (i >= C25519BITS) { break; };
-    curve25519key_setbit(x, i, v&1); v>>=1; i++; if (i >= C25519BITS) { break; };
-    curve25519key_setbit(x, i, v&1); v>>=1; i++; if (i >= C25519BITS) { break; };
-    a--;
-  }
-  while (i < C25519BITS) {
-    curve25519key_setbit(x, i, 0);
-    i++;
+    i += 5;
   }
+  curve25519key_from_bytes(x, b);
 }
@@ -1,7 +1,13 @@
 #ifndef __CURVE25519LIB_BASE32_H__
 #define __CURVE25519LIB_BASE32_H__
 
+#include <stddef.h>
+
 extern void base32_encode(char*s, curve25519key_t *x);
 extern void base32_decode(const char*s, curve25519key_t *x);
+/* Writes the n keys one per line, each followed by a newline rather
+ * than a null character; returns the number of characters written, at
+ * most 53 * n. */
+extern size_t base32_encode_n(char *s, curve25519key_t *x, unsigned int n);
 
 #endif /* __CURVE25519LIB_BASE32_H__ */
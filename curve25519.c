@@ -14,13 +14,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <gmp.h>
+#include <string.h>
 #include "curve25519.h"
+#include "fe25519.h"
+#include "mont25519.h"
+#include "stats25519.h"
+#include "curve25519avx2.h"
+#ifdef C25519_CXX
+#include "curve25519cxx.h"
+#endif
 
-#if GMP_LIMB_BITS == 32
-static curve25519key_t p25519 = { 0xffffffed, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0x7fffffff };
+#if C25519LIMBBITS == 32
 static curve25519key_t zerocmp = { 0, 0, 0, 0, 0, 0, 0, 0 };
-static curve25519key_t onecmp = { 1, 0, 0, 0, 0, 0, 0, 0 };
 static curve25519key_t unsafe[12] =
   {{ 0 },
    { 1 },
@@ -35,10 +40,8 @@ static curve25519key_t unsafe[12] =
    { 0xFFFFFFDA, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF },
    { 0xFFFFFFDB, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF },
   };
-#elif GMP_LIMB_BITS == 64
-static curve25519key_t p25519 = { 0xffffffffffffffed, 0xffffffffffffffff, 0xffffffffffffffff, 0x7fffffffffffffff };
+#elif C25519LIMBBITS == 64
 static curve25519key_t zerocmp = { 0, 0, 0, 0 };
-static curve25519key_t onecmp = { 1, 0, 0, 0 };
 static curve25519key_t unsafe[12] =
   {{ 0, 0, 0, 0 },
    { 1, 0, 0, 0 },
@@ -57,30 +60,44 @@ static curve25519key_t unsafe[12] =
 #error "GMP_LIMBS_BITS not supported for this architecture"
 #endif
 
+#ifdef C25519_FE51
+static int
+keycmp(curve25519key_t *a, curve25519key_t *b) {
+  int c;
+  for (c = C25519N - 1; c >= 0; c--) {
+    if (a[0][c] != b[0][c]) {
+      return (a[0][c] > b[0][c]) ? 1 : -1;
+    }
+  }
+  return 0;
+}
+#define CMP(a, b) keycmp((curve25519key_t*)(a), (curve25519key_t*)(b))
+#else
 #define CMP(a, b) mpn_cmp((mp_limb_t*)(a), (mp_limb_t*)(b), C25519N)
+#endif
 
 extern int
 curve25519key_getbit(curve25519key_t *x, unsigned int n) {
-  unsigned int d = GMP_LIMB_BITS;
+  unsigned int d = C25519LIMBBITS;
   return (x[0][n / d] >> (n % d)) & 1;
 }
 
 extern void
 curve25519key_setbit(curve25519key_t *x, unsigned int n, int v) {
-  unsigned int d = GMP_LIMB_BITS;
+  unsigned int d = C25519LIMBBITS;
   unsigned int i = n / d;
-  mp_limb_t l = x[0][i];
+  curve25519limb_t l = x[0][i];
   if (v) {
-    l |= ((mp_limb_t)1)<<(n % d);
+    l |= ((curve25519limb_t)1)<<(n % d);
   } else {
-    l &= ~(((mp_limb_t)(1))<<(n % d));
+    l &= ~(((curve25519limb_t)(1))<<(n % d));
   }
   x[0][i] = l;
 }
 
 extern unsigned int
 curve25519key_getbyte(curve25519key_t *x, unsigned int n) {
-  unsigned int d = GMP_LIMB_BITS;
+  unsigned int d = C25519LIMBBITS;
   n *= 8;
   return (x[0][n / d] >> (n % d)) & 0xff;
 }
@@ -89,18 +106,18 @@ extern void
 curve25519key_setbyte(curve25519key_t *x, unsigned int n, unsigned int v) {
   n *= 8;
   {
-    unsigned int d = GMP_LIMB_BITS;
+    unsigned int d = C25519LIMBBITS;
     unsigned int i = n / d;
-    mp_limb_t l = x[0][i];
+    curve25519limb_t l = x[0][i];
     l = ~l;
-    l |= 0xff << (n % d);
+    l |= ((curve25519limb_t)0xff) << (n % d);
     l = ~l;
-    l |= v << (n % d);
+    l |= ((curve25519limb_t)v) << (n % d);
     x[0][i] = l;
   }
 }
 
-#if GMP_LIMB_BITS == 32
+#if C25519LIMBBITS == 32
 
 extern unsigned int
 curve25519key_getuint32(curve25519key_t *x, unsigned int n) {
@@ -112,7 +129,7 @@ curve25519key_setuint32(curve25519key_t *x, unsigned int n, unsigned int v) {
   x[0][n] = v;
 }
 
-#elif GMP_LIMB_BITS == 64
+#elif C25519LIMBBITS == 64
 
 extern unsigned int
 curve25519key_getuint32(curve25519key_t *x, unsigned int n) {
@@ -122,63 +139,137 @@ curve25519key_getuint32(curve25519key_t *x, unsigned int n) {
 extern void
 curve25519key_setuint32(curve25519key_t *x, unsigned int n, unsigned int v) {
   x[0][n>>1] = (n&1)
-  ? (x[0][n>>1] & 0xffffffff) | (((mp_limb_t)v)<<32)
+  ? (x[0][n>>1] & 0xffffffff) | (((curve25519limb_t)v)<<32)
   : (x[0][n>>1] & 0xffffffff00000000) | v;
 }
 
 #endif
 
-extern int
-curve25519key_validate(curve25519key_t *x) {
-  int r;
-  if ((r = CMP(x, unsafe + 5)) > 0) {
-    if ((r = CMP(x, unsafe + 8)) > 0) {
-      if ((r = CMP(x, unsafe + 10)) > 0) {
-	if (CMP(x, unsafe + 11) == 0) {
-	  return 0;
-	}
-      } else if (r < 0) {
-	if (CMP(x, unsafe + 9) == 0) {
-	  return 0;
-	}
-      } else {
-	return 0;
-      }
-    } else if (r < 0) {
-      if ((r = CMP(x, unsafe + 6)) > 0) {
-	if (CMP(x, unsafe + 7) == 0) {
-	  return 0;
-	}
-      } else if (r == 0) {
-	return 0;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+
+/* The limbs are stored least significant byte first, as the key bytes */
+extern void
+curve25519key_from_bytes_n(curve25519key_t *x, const unsigned char *b, unsigned int n) {
+  memcpy(x, b, (size_t)n * 32);
+}
+
+extern void
+curve25519key_to_bytes_n(unsigned char *b, curve25519key_t *x, unsigned int n) {
+  memcpy(b, x, (size_t)n * 32);
+}
+
+#else
+
+extern void
+curve25519key_from_bytes_n(curve25519key_t *x, const unsigned char *b, unsigned int n) {
+  unsigned int i, j, k;
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < C25519N; j++) {
+      curve25519limb_t l = 0;
+      for (k = C25519LIMBBITS / 8; k-- > 0;) {
+	l = (l << 8) | b[k];
       }
-    } else {
-      return 0;
+      x[i][j] = l;
+      b += C25519LIMBBITS / 8;
     }
-  } else if (r < 0) {
-    if ((r = CMP(x, unsafe + 2)) > 0) {
-      if ((r = CMP(x, unsafe + 3)) > 0) {
-	if (CMP(x, unsafe + 4) == 0) {
-	  return 0;
-	}
-      } else if (r == 0) {
-	return 0;
-      }
-    } else if (r < 0) {
-      if ((r = CMP(x, unsafe + 1)) < 0) {
-	if (CMP(x, unsafe) == 0) {
-	  return 0;
-	}
-      } else if (r == 0) {
-	return 0;
+  }
+}
+
+extern void
+curve25519key_to_bytes_n(unsigned char *b, curve25519key_t *x, unsigned int n) {
+  unsigned int i, j, k;
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < C25519N; j++) {
+      curve25519limb_t l = x[i][j];
+      for (k = 0; k < C25519LIMBBITS / 8; k++) {
+	*b++ = l & 0xff;
+	l >>= 8;
       }
-    } else {
-      return 0;
     }
-  } else {
-    return 0;
   }
-  return 1;
+}
+
+#endif
+
+extern void
+curve25519key_from_bytes(curve25519key_t *x, const unsigned char *b) {
+  curve25519key_from_bytes_n(x, b, 1);
+}
+
+extern void
+curve25519key_to_bytes(unsigned char *b, curve25519key_t *x) {
+  curve25519key_to_bytes_n(b, x, 1);
+}
+
+#define C25519TOPBIT (((curve25519limb_t)1) << (C25519LIMBBITS - 1))
+
+/* 1 if x is one of the unsafe keys, else 0.  All the entries are
+   compared, without branching on x, so that the compiler can keep the
+   loops in vector registers. */
+static inline unsigned int
+unsafekey(curve25519key_t *x) {
+  curve25519limb_t hit = 0;
+  unsigned int i, j;
+  for (i = 0; i < 12; i++) {
+    curve25519limb_t d = 0;
+    for (j = 0; j < C25519N; j++) {
+      d |= x[0][j] ^ unsafe[i][j];
+    }
+    hit |= ((d | (0 - d)) >> (C25519LIMBBITS - 1)) ^ 1;
+  }
+  return hit;
+}
+
+/* x mod p, in place and without branches */
+static inline void
+reducekey(curve25519key_t *x) {
+  curve25519limb_t t[C25519N], c, m;
+  unsigned int j;
+  /* Bit 255 counts as 2^255 = 19; then x < 2^255 + 19 */
+  c = 19 * (x[0][C25519N - 1] >> (C25519LIMBBITS - 1));
+  x[0][C25519N - 1] &= ~C25519TOPBIT;
+  for (j = 0; j < C25519N; j++) {
+    x[0][j] += c;
+    c = x[0][j] < c;
+  }
+  /* x >= p iff x + 19 >= 2^255, and then x - p = x + 19 - 2^255 */
+  c = 19;
+  for (j = 0; j < C25519N; j++) {
+    t[j] = x[0][j] + c;
+    c = t[j] < c;
+  }
+  m = 0 - (t[C25519N - 1] >> (C25519LIMBBITS - 1));
+  t[C25519N - 1] &= ~C25519TOPBIT;
+  for (j = 0; j < C25519N; j++) {
+    x[0][j] ^= (x[0][j] ^ t[j]) & m;
+  }
+}
+
+extern int
+curve25519key_validate(curve25519key_t *x) {
+  C25519TIMER(t);
+  int r = !unsafekey(x);
+  C25519TIMED(VALIDATE, t);
+  return r;
+}
+
+extern unsigned int
+curve25519key_validate_batch(curve25519key_t *x, unsigned int n, unsigned long long *reject, int flags) {
+  unsigned int i, r = 0;
+  C25519TIMER(t);
+  for (i = 0; i < n; i += 64) {
+    reject[i / 64] = 0;
+  }
+  for (i = 0; i < n; i++) {
+    unsigned int u = unsafekey(x + i);
+    reject[i / 64] |= ((unsigned long long)u) << (i % 64);
+    r += u;
+    if (flags & C25519VALIDATE_REDUCE) {
+      reducekey(x + i);
+    }
+  }
+  C25519TIMED(VALIDATE, t);
+  return r;
 }
 
 #if 1
@@ -192,207 +283,296 @@ tracev(char*m, curve25519key_t *x) {
 }
 #endif
 
-static void
-copykey(curve25519key_t *n, curve25519key_t *x) {
-  int c;
-  for (c = 0; c < C25519N; c++) {
-    n[0][c] = x[0][c];
-  }
-}
-
 static
 int zeromodp(curve25519key_t *x) {
-  return (mpn_cmp((mp_limb_t*)x, (mp_limb_t*)&zerocmp, C25519N) == 0);
+  return (CMP(x, &zerocmp) == 0);
 }
 
-static
-void addmodp(curve25519key_t *a, curve25519key_t *b) {
-  mpn_add_n((mp_limb_t*)a, (mp_limb_t*)a, (mp_limb_t*)b, C25519N);
-  if (mpn_cmp((mp_limb_t*)a, (mp_limb_t*)&p25519, C25519N) >= 0) {
-    mpn_sub_n((mp_limb_t*)a, (mp_limb_t*)a, (mp_limb_t*)&p25519, C25519N);
+/* Computes the projective result (x:z) of the scalar multiplication of
+   (x_1:z_1), or of the affine x_1 if z_1 is NULL.  All the 256 bits of f
+   are processed, starting from the point at infinity (1:0), and the two
+   points are exchanged by a conditional swap rather than a branch on
+   each bit. */
+static inline void
+ladderproj(fe25519 *x, fe25519 *z, curve25519key_t *f, fe25519 *x_1, fe25519 *z_1) {
+  fe25519 x_3, z_3;
+  unsigned int s = 0;
+  int n;
+
+  setmodp(x, 1);
+  setmodp(z, 0);
+  copymodp(&x_3, x_1);
+  if (z_1) {
+    copymodp(&z_3, z_1);
+  } else {
+    setmodp(&z_3, 1);
   }
-}
 
-static
-void submodp(curve25519key_t *a, curve25519key_t *b) {
-  if (mpn_cmp((mp_limb_t*)b, (mp_limb_t*)a, C25519N) > 0) {
-    mpn_add_n((mp_limb_t*)a, (mp_limb_t*)&p25519, (mp_limb_t*)a, C25519N);
+  for (n = C25519BITS - 1; n >= 0; n--) {
+    unsigned int b = curve25519key_getbit(f, n);
+    cswapmodp(x, &x_3, s ^ b);
+    cswapmodp(z, &z_3, s ^ b);
+    s = b;
+    ladderstepproj(x, z, &x_3, &z_3, x_1, z_1);
   }
-  mpn_sub_n((mp_limb_t*)a, (mp_limb_t*)a, (mp_limb_t*)b, C25519N);
+  cswapmodp(x, &x_3, s);
+  cswapmodp(z, &z_3, s);
 }
 
 static void
-mulmodp(curve25519key_t *a, curve25519key_t *b) {
-  mp_limb_t d[C25519N*2]; 
-  mpn_mul_n(d, (mp_limb_t*)a, (mp_limb_t*)b, C25519N);
-  if (0) {
-    // unoptimized, this makes the curve25519 function ~150% slower
-    mp_limb_t r[C25519N+1];
-    mpn_tdiv_qr(r, (mp_limb_t*)a, 0, d, C25519N*2, (mp_limb_t*)&p25519, C25519N);
-  } else {
-    mp_limb_t r = mpn_addmul_1(d, d+C25519N, C25519N, 19*2);
-    r = mpn_add_1((mp_limb_t*)a, d, C25519N, r * (19*2));
-    r <<= 1;
-#if GMP_LIMB_BITS == 32
-    if (((mp_limb_t*)a)[C25519N - 1] & 0x80000000) {
-      r |= 1;
-      ((mp_limb_t*)a)[C25519N - 1] &= 0x7fffffff;
-    }
-#elif GMP_LIMB_BITS == 64
-    if (((mp_limb_t*)a)[C25519N - 1] & 0x8000000000000000) {
-      r |= 1;
-      ((mp_limb_t*)a)[C25519N - 1] &= 0x7fffffffffffffff;
-    }
-#endif
-    mpn_add_1((mp_limb_t*)a, (mp_limb_t*)a, C25519N, r * 19);
-    if (mpn_cmp((mp_limb_t*)a, (mp_limb_t*)&p25519, C25519N) >= 0) {
-      mpn_sub_n((mp_limb_t*)a, (mp_limb_t*)a, (mp_limb_t*)&p25519, C25519N);
-    }
-  }
+ladder(fe25519 *x, fe25519 *z, curve25519key_t *f, curve25519key_t *c) {
+  fe25519 x_1;
+  loadmodp(&x_1, c);
+  ladderproj(x, z, f, &x_1, NULL);
 }
 
+#ifdef C25519_AVX2
 static void
-sqrmodp(curve25519key_t *a) {
-  mulmodp(a, a);
+ladder4(fe25519 *x, fe25519 *z, curve25519key_t *f, unsigned int fs, curve25519key_t *c, unsigned int cs) {
+  curve25519key_t kx[4], kz[4], kf[4], kc[4];
+  int i;
+  for (i = 0; i < 4; i++) {
+    memcpy(kf + i, f + i * fs, sizeof(curve25519key_t));
+    memcpy(kc + i, c + i * cs, sizeof(curve25519key_t));
+  }
+  curve25519avx2_ladder(kx, kz, kf, kc);
+  for (i = 0; i < 4; i++) {
+    loadmodp(x + i, kx + i);
+    loadmodp(z + i, kz + i);
+  }
 }
 
+/* Four points by the scalar recoded in s */
 static void
-invmodp(curve25519key_t *a) {
-  /* a = a ** (p-2)
-     0111 + (1111) x 7 + (1111) x (8*6) + (1111) x 6 + 1110 + 1011
-     0 . 1 x (3 + 4*7 + 4 * 8*6 + 4*6 + 3) . 0 . 1011
-     0 . 1 x (250) . 0 . 1011
-  */
-  curve25519key_t c; copykey(&c, a);
-  int i = 250;
-  while (--i) {
-    sqrmodp(a);
-    //if (i > 240) { tracev("invmodp a", a); }
-    mulmodp(a, &c);
-    //if (i > 240) { tracev("invmodp a 2", a); }
+ladder4one(fe25519 *x, fe25519 *z, const unsigned char *s, curve25519key_t *c) {
+  curve25519key_t kx[4], kz[4];
+  int i;
+  curve25519avx2_ladder_one(kx, kz, s, c);
+  for (i = 0; i < 4; i++) {
+    loadmodp(x + i, kx + i);
+    loadmodp(z + i, kz + i);
   }
-  sqrmodp(a);
-  sqrmodp(a); mulmodp(a, &c);
-  sqrmodp(a);
-  sqrmodp(a); mulmodp(a, &c);
-  sqrmodp(a); mulmodp(a, &c);
 }
+#endif
 
-static mp_limb_t asmall = 121665; /* (486662 - 2) / 4; */
+#ifdef C25519_CXX
 
-static
-void mulasmall(curve25519key_t *a) {
-  if (0) {
-    // unoptimized: this makes the function ~5 % slower
-    mp_limb_t d[C25519N+1]; mp_limb_t r[2];
-    //tracev("mulasmall a", a);
-    d[C25519N] = mpn_mul_1(d, (mp_limb_t*)a, C25519N, asmall);
-    //tracev("mulasmall d", d);
-    //tracev("mulasmall a", a);
-    mpn_tdiv_qr(r, (mp_limb_t*)a, 0, d, C25519N+1, (mp_limb_t*)&p25519, C25519N);
-    //tracev("mulasmall a", a);
+/* The whole computation is in curve25519cxx.cc, so only the call is
+   timed and its field operations are not counted */
+extern void
+curve25519(curve25519key_t *r, curve25519key_t *f, curve25519key_t *c) {
+  C25519TIMER(t);
+  curve25519cxx(r, f, c);
+  C25519TIMED(CURVE25519, t);
+}
+
+#else
+
+extern void
+curve25519(curve25519key_t *r, curve25519key_t *f, curve25519key_t *c) {
+  fe25519 x, z;
+  C25519TIMER(t);
+  C25519TIMER(tl);
+
+  ladder(&x, &z, f, c);
+  C25519TIMED(LADDER, tl);
+  //tracev("x", &x);
+  //tracev("z", &z);
+  C25519TIMER(ti);
+  invmodp(&z);
+  C25519TIMED(INVERT, ti);
+  //tracev("1/z", &z);
+  mulmodp(&x, &z);
+  storemodp(r, &x);
+  C25519TIMED(CURVE25519, t);
+}
+
+#endif /* C25519_CXX */
+
+/* Loads (x:z), mapping z = 0 to the key 0 = (0:1) as invmodp(0) = 0
+   makes the affine functions do */
+static void
+loadproj(fe25519 *x, fe25519 *z, curve25519proj_t *c) {
+  curve25519key_t k;
+  loadmodp(z, &c->z);
+  storemodp(&k, z);
+  if (zeromodp(&k)) {
+    setmodp(x, 0);
+    setmodp(z, 1);
   } else {
-    mp_limb_t r = mpn_mul_1((mp_limb_t*)a, (mp_limb_t*)a, C25519N, asmall);
-    // Limb size must be at least 32-bits for this to work
-    // r = mpn_mul_1((mp_limb_t*)a, (mp_limb_t*)a, C25519N, r*19*2);
-    r = mpn_add_1((mp_limb_t*)a, (mp_limb_t*)a, C25519N, r * (19*2));
-    r <<= 1;
-#if GMP_LIMB_BITS == 32
-    if (((mp_limb_t*)a)[C25519N - 1] & 0x80000000) {
-      r |= 1;
-      ((mp_limb_t*)a)[C25519N - 1] &= 0x7fffffff;
-    }
-#elif GMP_LIMB_BITS == 64
-    if (((mp_limb_t*)a)[C25519N - 1] & 0x8000000000000000) {
-      r |= 1;
-      ((mp_limb_t*)a)[C25519N - 1] &= 0x7fffffffffffffff;
-    }
-#endif
-    mpn_add_1((mp_limb_t*)a, (mp_limb_t*)a, C25519N, r * 19);
-    if (mpn_cmp((mp_limb_t*)a, (mp_limb_t*)&p25519, C25519N) >= 0) {
-      mpn_sub_n((mp_limb_t*)a, (mp_limb_t*)a, (mp_limb_t*)&p25519, C25519N);
-    }
+    loadmodp(x, &c->x);
   }
 }
 
-static
-void dbl(curve25519key_t *x_2, curve25519key_t *z_2, curve25519key_t *x, curve25519key_t *z) {
-  curve25519key_t m, n, o;
-  //tracev("dbl x", x);
-  //tracev("dbl z", z);
-  copykey(&m, x); addmodp(&m, z); sqrmodp(&m);
-  //tracev("dbl m", &m);
-  copykey(&n, x); submodp(&n, z); sqrmodp(&n);
-  //tracev("dbl n", &n);
-  copykey(&o, &m); submodp(&o, &n);
-  //tracev("dbl o", &o);
-  copykey(x_2, &n); mulmodp(x_2, &m);
-  //tracev("dbl x_2", x_2);
-  copykey(z_2, &o); mulasmall(z_2); addmodp(z_2, &m); mulmodp(z_2, &o);
-  //tracev("dbl z_2", z_2);
+extern void
+curve25519_proj(curve25519proj_t *r, curve25519key_t *f, curve25519proj_t *c) {
+  fe25519 x_1, z_1, x, z;
+  C25519TIMER(tl);
+  loadproj(&x_1, &z_1, c);
+  ladderproj(&x, &z, f, &x_1, &z_1);
+  storemodp(&r->x, &x);
+  storemodp(&r->z, &z);
+  C25519TIMED(LADDER, tl);
 }
 
-static
-void sum(curve25519key_t *x_3, curve25519key_t *z_3, curve25519key_t *x, curve25519key_t *z, curve25519key_t *x_p, curve25519key_t *z_p, curve25519key_t *x_1) {
-  curve25519key_t k, l, p, q;
-  //tracev("sum x", x);
-  //tracev("sum z", z);
-  copykey(&p, x); submodp(&p, z); copykey(&k, x_p); addmodp(&k, z_p); mulmodp(&p, &k);
-  copykey(&q, x); addmodp(&q, z); copykey(&l, x_p); submodp(&l, z_p); mulmodp(&q, &l);
-  //tracev("sum p", &p);
-  //tracev("sum q", &q);
-  copykey(x_3, &p); addmodp(x_3, &q); sqrmodp(x_3);
-  copykey(z_3, &p); submodp(z_3, &q); sqrmodp(z_3); mulmodp(z_3, x_1);
+extern void
+curve25519proj_from_key(curve25519proj_t *r, curve25519key_t *c) {
+  fe25519 x;
+  loadmodp(&x, c);
+  storemodp(&r->x, &x);
+  setmodp(&x, 1);
+  storemodp(&r->z, &x);
 }
 
 extern void
-curve25519(curve25519key_t *r, curve25519key_t *f, curve25519key_t *c) {
-  curve25519key_t x_1, x_a, z_a, x, z;
+curve25519proj_to_key(curve25519key_t *r, curve25519proj_t *c) {
+  fe25519 x, z;
+  C25519TIMER(ti);
+  loadmodp(&x, &c->x);
+  loadmodp(&z, &c->z);
+  invmodp(&z);
+  mulmodp(&x, &z);
+  storemodp(r, &x);
+  C25519TIMED(INVERT, ti);
+}
 
-  //tracev("f", f);
-  if (zeromodp(f)) {
-    copykey(r, &zerocmp);
-    return;
+/* Modulo p the unsafe keys are only 0, 1, two points of order 8 and
+   p - 1, the first five entries of the table: x / z is one of them when
+   x = k z */
+extern int
+curve25519proj_validate(curve25519proj_t *c) {
+  fe25519 x, z, t;
+  curve25519key_t kx, kt;
+  int i, r = 1;
+  C25519TIMER(tv);
+  loadmodp(&x, &c->x);
+  loadmodp(&z, &c->z);
+  storemodp(&kx, &x);
+  storemodp(&kt, &z);
+  if (zeromodp(&kt)) {
+    r = 0;
   }
-  copykey(&x_1, c);
-  //tracev("c", c);
-  //tracev("x_1", x_1);
-  dbl(&x_a, &z_a, &x_1, &onecmp);
-  //tracev("x_a", &x_a);
-  //tracev("z_a", &z_a);
-  copykey(&x, &x_1);
-  copykey(&z, &onecmp);
-
-  int n = C25519BITS-1;
-
-  while (curve25519key_getbit(f, n) == 0) {
-    n--;
+  for (i = 0; (i < 5) && r; i++) {
+    loadmodp(&t, unsafe + i);
+    mulmodp(&t, &z);
+    storemodp(&kt, &t);
+    if (CMP(&kt, &kx) == 0) {
+      r = 0;
+    }
   }
-  n--;
-
-  while (n >= 0) {
-    curve25519key_t nx, nz, nx_a, nz_a;
-    int b = curve25519key_getbit(f, n);
-    //fprintf(stderr, "b: %d\n", b);
-    if (b == 0) {
-      dbl(&nx, &nz, &x, &z);
-      sum(&nx_a, &nz_a, &x_a, &z_a, &x, &z, &x_1);
-    } else {
-      sum(&nx, &nz, &x_a, &z_a, &x, &z, &x_1);
-      dbl(&nx_a, &nz_a, &x_a, &z_a);
+  C25519TIMED(VALIDATE, tv);
+  return r;
+}
+
+/* Number of results sharing a single inversion in curve25519_batch */
+#define C25519BATCH 64
+
+/* Turns the projective points (x[i]:z[i]) into affine keys r[i], using
+   Montgomery's trick to do a single inversion for the whole set.  Points
+   with z = 0 map to 0, as invmodp(0) = 0 would give for a single point. */
+static void
+normalize_batch(curve25519key_t *r, unsigned int rs, fe25519 *x, fe25519 *z, unsigned int n) {
+  fe25519 acc[C25519BATCH];
+  fe25519 inv, t;
+  curve25519key_t k;
+  unsigned int i;
+
+  for (i = 0; i < n; i++) {
+    storemodp(&k, z + i);
+    if (zeromodp(&k)) {
+      setmodp(x + i, 0);
+      setmodp(z + i, 1);
+    }
+    copymodp(acc + i, z + i);
+    if (i > 0) {
+      mulmodp(acc + i, acc + i - 1);
     }
-    copykey(&x, &nx); copykey(&z, &nz); copykey(&x_a, &nx_a); copykey(&z_a, &nz_a);
-    //tracev("xn", &x);
-    //tracev("zn", &z);
-    //tracev("x_a", &x_a);
-    //tracev("z_a", &z_a);
-    n--;
   }
+  copymodp(&inv, acc + n - 1);
+  invmodp(&inv);
+  for (i = n - 1; i > 0; i--) {
+    /* inv = 1 / (z[0] * ... * z[i]) */
+    copymodp(&t, &inv); mulmodp(&t, acc + i - 1);
+    mulmodp(&inv, z + i);
+    mulmodp(x + i, &t);
+    storemodp(r + i * rs, x + i);
+  }
+  mulmodp(x, &inv);
+  storemodp(r, x);
+}
 
-  //tracev("x", &x);
-  //tracev("z", &z);
-  invmodp(&z);
-  //tracev("1/z", &z);
-  mulmodp(&x, &z);
-  copykey(r, &x);
+extern void
+curve25519_batch_stride(curve25519key_t *r, unsigned int rs, curve25519key_t *f, unsigned int fs, curve25519key_t *c, unsigned int cs, unsigned int n) {
+  fe25519 x[C25519BATCH], z[C25519BATCH];
+  unsigned int i, m;
+  C25519TIMER(t);
+
+  while (n > 0) {
+    m = (n < C25519BATCH) ? n : C25519BATCH;
+    i = 0;
+#ifdef C25519_AVX2
+    if (curve25519avx2_available()) {
+      for (; i + 4 <= m; i += 4) {
+	C25519TIMER(tl);
+	ladder4(x + i, z + i, f + i * fs, fs, c + i * cs, cs);
+	C25519TIMED(LADDER, tl);
+      }
+    }
+#endif
+    for (; i < m; i++) {
+      C25519TIMER(tl);
+      ladder(x + i, z + i, f + i * fs, c + i * cs);
+      C25519TIMED(LADDER, tl);
+    }
+    C25519TIMER(ti);
+    normalize_batch(r, rs, x, z, m);
+    C25519TIMED(INVERT, ti);
+    r += m * rs; f += m * fs; c += m * cs; n -= m;
+  }
+  C25519TIMED(BATCH, t);
+}
+
+extern void
+curve25519_batch(curve25519key_t *r, curve25519key_t *f, curve25519key_t *c, unsigned int n) {
+  curve25519_batch_stride(r, 1, f, 1, c, 1, n);
+}
+
+/* As curve25519_batch(), but the vector lanes all follow the same
+   scalar, whose swaps are computed once for the whole call */
+extern void
+curve25519_one_to_many(curve25519key_t *r, curve25519key_t *f, curve25519key_t *c, unsigned int n) {
+  fe25519 x[C25519BATCH], z[C25519BATCH];
+  unsigned int i, m;
+#ifdef C25519_AVX2
+  unsigned char s[C25519SWAPS];
+  int avx2 = curve25519avx2_available();
+  if (avx2) {
+    curve25519avx2_recode(s, f);
+  }
+#endif
+  C25519TIMER(t);
+
+  while (n > 0) {
+    m = (n < C25519BATCH) ? n : C25519BATCH;
+    i = 0;
+#ifdef C25519_AVX2
+    if (avx2) {
+      for (; i + 4 <= m; i += 4) {
+	C25519TIMER(tl);
+	ladder4one(x + i, z + i, s, c + i);
+	C25519TIMED(LADDER, tl);
+      }
+    }
+#endif
+    for (; i < m; i++) {
+      C25519TIMER(tl);
+      ladder(x + i, z + i, f, c + i);
+      C25519TIMED(LADDER, tl);
+    }
+    C25519TIMER(ti);
+    normalize_batch(r, 1, x, z, m);
+    C25519TIMED(INVERT, ti);
+    r += m; c += m; n -= m;
+  }
+  C25519TIMED(BATCH, t);
 }
@@ -17,20 +17,77 @@
 #ifndef __CURVE25519_H__
 #define __CURVE25519_H__
 
+/* Keys are stored as little-endian arrays of limbs.  The FE51 field
+ * backend does not depend on GMP and always uses 64-bit limbs. */
+#ifdef C25519_FE51
+#include <stdint.h>
+#define C25519LIMBBITS 64
+typedef uint64_t curve25519limb_t;
+#else
 #include <gmp.h>
+#define C25519LIMBBITS GMP_LIMB_BITS
+typedef mp_limb_t curve25519limb_t;
+#endif
 
 #define C25519BITS 256
 #define C25519USEDBITS (C25519BITS - 1)
-#define C25519N (C25519BITS/GMP_LIMB_BITS)
-typedef mp_limb_t curve25519key_t[C25519N];
+#define C25519N (C25519BITS/C25519LIMBBITS)
+typedef curve25519limb_t curve25519key_t[C25519N];
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 extern void curve25519(curve25519key_t *r, curve25519key_t *f, curve25519key_t *c);
+/* r[i] = curve25519(f[i], c[i]) for i < n, sharing field inversions
+ * between the results; r may be the same array as f or c */
+extern void curve25519_batch(curve25519key_t *r, curve25519key_t *f, curve25519key_t *c, unsigned int n);
+/* The same, with the i-th keys at r + i * rs, f + i * fs and c + i * cs */
+extern void curve25519_batch_stride(curve25519key_t *r, unsigned int rs, curve25519key_t *f, unsigned int fs, curve25519key_t *c, unsigned int cs, unsigned int n);
+/* r[i] = curve25519(f, c[i]) for i < n: one private key with many
+ * public ones, as curve25519_batch() but with the scalar shared by the
+ * vector lanes; r may be the same array as c */
+extern void curve25519_one_to_many(curve25519key_t *r, curve25519key_t *f, curve25519key_t *c, unsigned int n);
+/* r = curve25519(f, 9), using precomputed multiples of the base point */
+extern void curve25519_base(curve25519key_t *r, curve25519key_t *f);
+
+/* A point in projective coordinates (x:z), standing for the key x / z;
+ * chains of scalar multiplications can stay in this form and skip the
+ * inversion after each step.  z = 0 stands for the key 0, which is what
+ * curve25519() would return. */
+typedef struct {
+  curve25519key_t x, z;
+} curve25519proj_t;
+/* r = curve25519(f, c) in projective form; r may be c */
+extern void curve25519_proj(curve25519proj_t *r, curve25519key_t *f, curve25519proj_t *c);
+/* (c:1), and back x / z */
+extern void curve25519proj_from_key(curve25519proj_t *r, curve25519key_t *c);
+extern void curve25519proj_to_key(curve25519key_t *r, curve25519proj_t *c);
+/* curve25519key_validate() of x / z, without the inversion */
+extern int curve25519proj_validate(curve25519proj_t *c);
+
 extern int curve25519key_validate(curve25519key_t *x);
+/* Checks the n keys x[i] as curve25519key_validate() does, setting bit
+ * i % 64 of reject[i / 64] for each unsafe one and clearing the others;
+ * returns the number of unsafe keys.  With C25519VALIDATE_REDUCE the keys
+ * are then reduced modulo p in place. */
+#define C25519VALIDATE_REDUCE 1
+extern unsigned int curve25519key_validate_batch(curve25519key_t *x, unsigned int n, unsigned long long *reject, int flags);
 extern int curve25519key_getbit(curve25519key_t *x, unsigned int n);
 extern void curve25519key_setbit(curve25519key_t *x, unsigned int n, int v);
 extern unsigned int curve25519key_getbyte(curve25519key_t *x, unsigned int n);
 extern void curve25519key_setbyte(curve25519key_t *x, unsigned int n, unsigned int v);
 extern unsigned int curve25519key_getuint32(curve25519key_t *x, unsigned int n);
 extern void curve25519key_setuint32(curve25519key_t *x, unsigned int n, unsigned int v);
+/* Conversion from and to 32 little-endian bytes */
+extern void curve25519key_from_bytes(curve25519key_t *x, const unsigned char *b);
+extern void curve25519key_to_bytes(unsigned char *b, curve25519key_t *x);
+/* The same for n keys, each 32 bytes after the previous one */
+extern void curve25519key_from_bytes_n(curve25519key_t *x, const unsigned char *b, unsigned int n);
+extern void curve25519key_to_bytes_n(unsigned char *b, curve25519key_t *x, unsigned int n);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* __CURVE25519_H__ */
@@ -0,0 +1,368 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Four Montgomery ladders at once, one per 64-bit lane of the AVX2
+ * registers.  A field element is made of ten limbs in radix 2^25.5
+ * (alternating 26 and 25 bits), and limb i of the four elements shares
+ * the register v[i].  The products only need the low 32 bits of each
+ * lane, so that they map to vpmuludq.
+ *
+ * Each lane has its own scalar: instead of branching on the scalar bits
+ * the ladder always runs over all 256 bits, swapping the two points of a
+ * lane by masking when its bit changes.
+ */
+
+#include "curve25519.h"
+#include "curve25519avx2.h"
+
+#ifdef C25519_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#define AVX2 __attribute__((target("avx2")))
+
+typedef struct { __m256i v[10]; } fe4;
+
+static const unsigned int limbbits[10] = { 26, 25, 26, 25, 26, 25, 26, 25, 26, 25 };
+
+/* Any thread may be the first to ask: they all store the same value */
+extern int
+curve25519avx2_available(void) {
+  static int a = -1;
+  int v = __atomic_load_n(&a, __ATOMIC_RELAXED);
+  if (v < 0) {
+    __builtin_cpu_init();
+    v = __builtin_cpu_supports("avx2") ? 1 : 0;
+    __atomic_store_n(&a, v, __ATOMIC_RELAXED);
+  }
+  return v;
+}
+
+static uint64_t
+keybits(uint32_t *w, unsigned int pos, unsigned int len) {
+  unsigned int i = pos / 32, o = pos % 32;
+  uint64_t v = w[i] >> o;
+  if (o + len > 32) {
+    v |= ((uint64_t)w[i + 1]) << (32 - o);
+  }
+  return v & ((((uint64_t)1) << len) - 1);
+}
+
+/* As in the scalar code, the whole 256-bit key is taken modulo p */
+AVX2 static void
+loadmodp4(fe4 *a, curve25519key_t *k) {
+  uint64_t l[4][10];
+  uint32_t w[8];
+  int i, j;
+  for (j = 0; j < 4; j++) {
+    unsigned int pos = 0;
+    for (i = 0; i < 8; i++) {
+      w[i] = curve25519key_getuint32(k + j, i);
+    }
+    for (i = 0; i < 10; i++) {
+      l[j][i] = keybits(w, pos, limbbits[i]);
+      pos += limbbits[i];
+    }
+    l[j][0] += 19 * (w[7] >> 31);
+  }
+  for (i = 0; i < 10; i++) {
+    a->v[i] = _mm256_set_epi64x(l[3][i], l[2][i], l[1][i], l[0][i]);
+  }
+}
+
+static void
+freeze10(uint64_t *h) {
+  uint64_t q;
+  int i, n;
+  for (n = 0; n < 2; n++) {
+    for (i = 0; i < 9; i++) {
+      h[i + 1] += h[i] >> limbbits[i];
+      h[i] &= (((uint64_t)1) << limbbits[i]) - 1;
+    }
+    h[0] += 19 * (h[9] >> 25);
+    h[9] &= (((uint64_t)1) << 25) - 1;
+  }
+  /* Now h < 2^255; q = 1 iff h >= p */
+  q = (h[0] + 19) >> 26;
+  for (i = 1; i < 10; i++) {
+    q = (h[i] + q) >> limbbits[i];
+  }
+  h[0] += 19 * q;
+  for (i = 0; i < 9; i++) {
+    h[i + 1] += h[i] >> limbbits[i];
+    h[i] &= (((uint64_t)1) << limbbits[i]) - 1;
+  }
+  h[9] &= (((uint64_t)1) << 25) - 1;
+}
+
+AVX2 static void
+storemodp4(curve25519key_t *k, fe4 *a) {
+  uint64_t l[10][4];
+  int i, j;
+  for (i = 0; i < 10; i++) {
+    _mm256_storeu_si256((__m256i*)l[i], a->v[i]);
+  }
+  for (j = 0; j < 4; j++) {
+    uint64_t h[10], acc = 0;
+    unsigned int bits = 0, n = 0;
+    for (i = 0; i < 10; i++) {
+      h[i] = l[i][j];
+    }
+    freeze10(h);
+    for (i = 0; i < 10; i++) {
+      acc |= h[i] << bits;
+      bits += limbbits[i];
+      while (bits >= 32) {
+	curve25519key_setuint32(k + j, n++, (unsigned int)(acc & 0xffffffff));
+	acc >>= 32;
+	bits -= 32;
+      }
+    }
+    curve25519key_setuint32(k + j, n, (unsigned int)acc);
+  }
+}
+
+AVX2 static inline void
+setmodp4(fe4 *a, unsigned int v) {
+  int i;
+  a->v[0] = _mm256_set1_epi64x(v);
+  for (i = 1; i < 10; i++) {
+    a->v[i] = _mm256_setzero_si256();
+  }
+}
+
+AVX2 static inline void
+addmodp4(fe4 *a, fe4 *b) {
+  int i;
+  for (i = 0; i < 10; i++) {
+    a->v[i] = _mm256_add_epi64(a->v[i], b->v[i]);
+  }
+}
+
+/* a + 2p - b: both operands must come out of a multiplication */
+AVX2 static inline void
+submodp4(fe4 *a, fe4 *b) {
+  __m256i p0 = _mm256_set1_epi64x(0x7ffffda);
+  __m256i p26 = _mm256_set1_epi64x(0x7fffffe);
+  __m256i p25 = _mm256_set1_epi64x(0x3fffffe);
+  int i;
+  a->v[0] = _mm256_sub_epi64(_mm256_add_epi64(a->v[0], p0), b->v[0]);
+  for (i = 1; i < 10; i++) {
+    a->v[i] = _mm256_sub_epi64(_mm256_add_epi64(a->v[i], (i & 1) ? p25 : p26), b->v[i]);
+  }
+}
+
+AVX2 static inline void
+cswapmodp4(fe4 *a, fe4 *b, __m256i m) {
+  int i;
+  for (i = 0; i < 10; i++) {
+    __m256i t = _mm256_and_si256(_mm256_xor_si256(a->v[i], b->v[i]), m);
+    a->v[i] = _mm256_xor_si256(a->v[i], t);
+    b->v[i] = _mm256_xor_si256(b->v[i], t);
+  }
+}
+
+/* Brings every limb back to its nominal width (plus a small excess) */
+AVX2 static inline void
+carrymodp4(fe4 *a, __m256i *h) {
+  const __m256i m26 = _mm256_set1_epi64x(0x3ffffff);
+  const __m256i m25 = _mm256_set1_epi64x(0x1ffffff);
+  __m256i c;
+#define CARRY(i, j, bits, mask) \
+  c = _mm256_srli_epi64(h[i], bits); h[j] = _mm256_add_epi64(h[j], c); h[i] = _mm256_and_si256(h[i], mask)
+  CARRY(0, 1, 26, m26); CARRY(4, 5, 26, m26);
+  CARRY(1, 2, 25, m25); CARRY(5, 6, 25, m25);
+  CARRY(2, 3, 26, m26); CARRY(6, 7, 26, m26);
+  CARRY(3, 4, 25, m25); CARRY(7, 8, 25, m25);
+  CARRY(4, 5, 26, m26); CARRY(8, 9, 26, m26);
+  /* h0 += 19 * (h9 >> 25) */
+  c = _mm256_srli_epi64(h[9], 25);
+  h[9] = _mm256_and_si256(h[9], m25);
+  h[0] = _mm256_add_epi64(h[0], _mm256_add_epi64(_mm256_add_epi64(_mm256_slli_epi64(c, 4), _mm256_slli_epi64(c, 1)), c));
+  CARRY(0, 1, 26, m26);
+#undef CARRY
+  {
+    int i;
+    for (i = 0; i < 10; i++) {
+      a->v[i] = h[i];
+    }
+  }
+}
+
+AVX2 static inline void
+mulmodp4(fe4 *a, fe4 *b) {
+  const __m256i n19 = _mm256_set1_epi64x(19);
+  __m256i f0 = a->v[0], f1 = a->v[1], f2 = a->v[2], f3 = a->v[3], f4 = a->v[4];
+  __m256i f5 = a->v[5], f6 = a->v[6], f7 = a->v[7], f8 = a->v[8], f9 = a->v[9];
+  __m256i g0 = b->v[0], g1 = b->v[1], g2 = b->v[2], g3 = b->v[3], g4 = b->v[4];
+  __m256i g5 = b->v[5], g6 = b->v[6], g7 = b->v[7], g8 = b->v[8], g9 = b->v[9];
+  __m256i f1_2 = _mm256_add_epi64(f1, f1), f3_2 = _mm256_add_epi64(f3, f3);
+  __m256i f5_2 = _mm256_add_epi64(f5, f5), f7_2 = _mm256_add_epi64(f7, f7);
+  __m256i f9_2 = _mm256_add_epi64(f9, f9);
+  __m256i g1_19 = _mm256_mul_epu32(g1, n19), g2_19 = _mm256_mul_epu32(g2, n19);
+  __m256i g3_19 = _mm256_mul_epu32(g3, n19), g4_19 = _mm256_mul_epu32(g4, n19);
+  __m256i g5_19 = _mm256_mul_epu32(g5, n19), g6_19 = _mm256_mul_epu32(g6, n19);
+  __m256i g7_19 = _mm256_mul_epu32(g7, n19), g8_19 = _mm256_mul_epu32(g8, n19);
+  __m256i g9_19 = _mm256_mul_epu32(g9, n19);
+  __m256i h[10];
+#define M(x, y) _mm256_mul_epu32(x, y)
+  h[0] = M(f0, g0) + M(f1_2, g9_19) + M(f2, g8_19) + M(f3_2, g7_19) + M(f4, g6_19) + M(f5_2, g5_19) + M(f6, g4_19) + M(f7_2, g3_19) + M(f8, g2_19) + M(f9_2, g1_19);
+  h[1] = M(f0, g1) + M(f1, g0) + M(f2, g9_19) + M(f3, g8_19) + M(f4, g7_19) + M(f5, g6_19) + M(f6, g5_19) + M(f7, g4_19) + M(f8, g3_19) + M(f9, g2_19);
+  h[2] = M(f0, g2) + M(f1_2, g1) + M(f2, g0) + M(f3_2, g9_19) + M(f4, g8_19) + M(f5_2, g7_19) + M(f6, g6_19) + M(f7_2, g5_19) + M(f8, g4_19) + M(f9_2, g3_19);
+  h[3] = M(f0, g3) + M(f1, g2) + M(f2, g1) + M(f3, g0) + M(f4, g9_19) + M(f5, g8_19) + M(f6, g7_19) + M(f7, g6_19) + M(f8, g5_19) + M(f9, g4_19);
+  h[4] = M(f0, g4) + M(f1_2, g3) + M(f2, g2) + M(f3_2, g1) + M(f4, g0) + M(f5_2, g9_19) + M(f6, g8_19) + M(f7_2, g7_19) + M(f8, g6_19) + M(f9_2, g5_19);
+  h[5] = M(f0, g5) + M(f1, g4) + M(f2, g3) + M(f3, g2) + M(f4, g1) + M(f5, g0) + M(f6, g9_19) + M(f7, g8_19) + M(f8, g7_19) + M(f9, g6_19);
+  h[6] = M(f0, g6) + M(f1_2, g5) + M(f2, g4) + M(f3_2, g3) + M(f4, g2) + M(f5_2, g1) + M(f6, g0) + M(f7_2, g9_19) + M(f8, g8_19) + M(f9_2, g7_19);
+  h[7] = M(f0, g7) + M(f1, g6) + M(f2, g5) + M(f3, g4) + M(f4, g3) + M(f5, g2) + M(f6, g1) + M(f7, g0) + M(f8, g9_19) + M(f9, g8_19);
+  h[8] = M(f0, g8) + M(f1_2, g7) + M(f2, g6) + M(f3_2, g5) + M(f4, g4) + M(f5_2, g3) + M(f6, g2) + M(f7_2, g1) + M(f8, g0) + M(f9_2, g9_19);
+  h[9] = M(f0, g9) + M(f1, g8) + M(f2, g7) + M(f3, g6) + M(f4, g5) + M(f5, g4) + M(f6, g3) + M(f7, g2) + M(f8, g1) + M(f9, g0);
+#undef M
+  carrymodp4(a, h);
+}
+
+/* Each cross product once, doubled through the f*_2 terms.  The limbs
+   times 19 or 38 still fit in 32 bits for the inputs of mulmodp4 */
+AVX2 static inline void
+sqrmodp4(fe4 *a) {
+  const __m256i n19 = _mm256_set1_epi64x(19), n38 = _mm256_set1_epi64x(38);
+  __m256i f0 = a->v[0], f1 = a->v[1], f2 = a->v[2], f3 = a->v[3], f4 = a->v[4];
+  __m256i f5 = a->v[5], f6 = a->v[6], f7 = a->v[7], f8 = a->v[8], f9 = a->v[9];
+  __m256i f0_2 = _mm256_add_epi64(f0, f0), f1_2 = _mm256_add_epi64(f1, f1);
+  __m256i f2_2 = _mm256_add_epi64(f2, f2), f3_2 = _mm256_add_epi64(f3, f3);
+  __m256i f4_2 = _mm256_add_epi64(f4, f4), f5_2 = _mm256_add_epi64(f5, f5);
+  __m256i f6_2 = _mm256_add_epi64(f6, f6), f7_2 = _mm256_add_epi64(f7, f7);
+  __m256i f5_38 = _mm256_mul_epu32(f5, n38), f6_19 = _mm256_mul_epu32(f6, n19);
+  __m256i f7_38 = _mm256_mul_epu32(f7, n38), f8_19 = _mm256_mul_epu32(f8, n19);
+  __m256i f9_38 = _mm256_mul_epu32(f9, n38);
+  __m256i h[10];
+#define M(x, y) _mm256_mul_epu32(x, y)
+  h[0] = M(f0, f0) + M(f1_2, f9_38) + M(f2_2, f8_19) + M(f3_2, f7_38) + M(f4_2, f6_19) + M(f5, f5_38);
+  h[1] = M(f0_2, f1) + M(f2, f9_38) + M(f3_2, f8_19) + M(f4, f7_38) + M(f5_2, f6_19);
+  h[2] = M(f0_2, f2) + M(f1_2, f1) + M(f3_2, f9_38) + M(f4_2, f8_19) + M(f5_2, f7_38) + M(f6, f6_19);
+  h[3] = M(f0_2, f3) + M(f1_2, f2) + M(f4, f9_38) + M(f5_2, f8_19) + M(f6, f7_38);
+  h[4] = M(f0_2, f4) + M(f1_2, f3_2) + M(f2, f2) + M(f5_2, f9_38) + M(f6_2, f8_19) + M(f7, f7_38);
+  h[5] = M(f0_2, f5) + M(f1_2, f4) + M(f2_2, f3) + M(f6, f9_38) + M(f7_2, f8_19);
+  h[6] = M(f0_2, f6) + M(f1_2, f5_2) + M(f2_2, f4) + M(f3_2, f3) + M(f7_2, f9_38) + M(f8, f8_19);
+  h[7] = M(f0_2, f7) + M(f1_2, f6) + M(f2_2, f5) + M(f3_2, f4) + M(f8, f9_38);
+  h[8] = M(f0_2, f8) + M(f1_2, f7_2) + M(f2_2, f6) + M(f3_2, f5_2) + M(f4, f4) + M(f9, f9_38);
+  h[9] = M(f0_2, f9) + M(f1_2, f8) + M(f2_2, f7) + M(f3_2, f6) + M(f4_2, f5);
+#undef M
+  carrymodp4(a, h);
+}
+
+/* a = a * 121665 + b, added before the carries */
+AVX2 static inline void
+mulasmalladdmodp4(fe4 *a, fe4 *b) {
+  const __m256i s = _mm256_set1_epi64x(121665); /* (486662 - 2) / 4; */
+  __m256i h[10];
+  int i;
+  for (i = 0; i < 10; i++) {
+    h[i] = _mm256_add_epi64(_mm256_mul_epu32(a->v[i], s), b->v[i]);
+  }
+  carrymodp4(a, h);
+}
+
+AVX2 static inline void
+ladderstep4(fe4 *x_2, fe4 *z_2, fe4 *x_3, fe4 *z_3, fe4 *x_1) {
+  fe4 a, b, d, e, aa, bb;
+  a = *x_2; addmodp4(&a, z_2);          /* x_2 + z_2 */
+  b = *x_2; submodp4(&b, z_2);          /* x_2 - z_2 */
+  d = *x_3; submodp4(&d, z_3);          /* x_3 - z_3 */
+  e = *x_3; addmodp4(&e, z_3);          /* x_3 + z_3 */
+  mulmodp4(&d, &a);
+  mulmodp4(&e, &b);
+  aa = a; sqrmodp4(&aa);
+  bb = b; sqrmodp4(&bb);
+
+  *x_3 = d; addmodp4(x_3, &e); sqrmodp4(x_3);
+  *z_3 = d; submodp4(z_3, &e); sqrmodp4(z_3); mulmodp4(z_3, x_1);
+
+  *x_2 = aa; mulmodp4(x_2, &bb);
+  e = aa; submodp4(&e, &bb);            /* aa - bb */
+  *z_2 = e; mulasmalladdmodp4(z_2, &aa); mulmodp4(z_2, &e);
+}
+
+AVX2 extern void
+curve25519avx2_ladder(curve25519key_t *x, curve25519key_t *z, curve25519key_t *f, curve25519key_t *c) {
+  fe4 x_1, x_2, z_2, x_3, z_3;
+  __m256i swap = _mm256_setzero_si256();
+  int n;
+
+  loadmodp4(&x_1, c);
+  setmodp4(&x_2, 1);
+  setmodp4(&z_2, 0);
+  x_3 = x_1;
+  setmodp4(&z_3, 1);
+
+  for (n = C25519BITS - 1; n >= 0; n--) {
+    __m256i k = _mm256_set_epi64x(-(long long)curve25519key_getbit(f + 3, n),
+				  -(long long)curve25519key_getbit(f + 2, n),
+				  -(long long)curve25519key_getbit(f + 1, n),
+				  -(long long)curve25519key_getbit(f, n));
+    swap = _mm256_xor_si256(swap, k);
+    cswapmodp4(&x_2, &x_3, swap);
+    cswapmodp4(&z_2, &z_3, swap);
+    swap = k;
+    ladderstep4(&x_2, &z_2, &x_3, &z_3, &x_1);
+  }
+  cswapmodp4(&x_2, &x_3, swap);
+  cswapmodp4(&z_2, &z_3, swap);
+
+  storemodp4(x, &x_2);
+  storemodp4(z, &z_2);
+}
+
+extern void
+curve25519avx2_recode(unsigned char *s, curve25519key_t *f) {
+  unsigned int b = 0;
+  int n;
+  for (n = C25519BITS - 1; n >= 0; n--) {
+    unsigned int k = curve25519key_getbit(f, n);
+    s[n] = b ^ k;
+    b = k;
+  }
+  s[C25519BITS] = b;
+}
+
+/* All the lanes share the scalar, and so every swap */
+AVX2 extern void
+curve25519avx2_ladder_one(curve25519key_t *x, curve25519key_t *z, const unsigned char *s, curve25519key_t *c) {
+  fe4 x_1, x_2, z_2, x_3, z_3;
+  __m256i swap;
+  int n;
+
+  loadmodp4(&x_1, c);
+  setmodp4(&x_2, 1);
+  setmodp4(&z_2, 0);
+  x_3 = x_1;
+  setmodp4(&z_3, 1);
+
+  for (n = C25519BITS - 1; n >= 0; n--) {
+    swap = _mm256_set1_epi64x(-(long long)s[n]);
+    cswapmodp4(&x_2, &x_3, swap);
+    cswapmodp4(&z_2, &z_3, swap);
+    ladderstep4(&x_2, &z_2, &x_3, &z_3, &x_1);
+  }
+  swap = _mm256_set1_epi64x(-(long long)s[C25519BITS]);
+  cswapmodp4(&x_2, &x_3, swap);
+  cswapmodp4(&z_2, &z_3, swap);
+
+  storemodp4(x, &x_2);
+  storemodp4(z, &z_2);
+}
+
+#endif /* C25519_AVX2 */
@@ -0,0 +1,18 @@
+#ifndef __CURVE25519LIB_AVX2_H__
+#define __CURVE25519LIB_AVX2_H__
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(C25519_NO_AVX2)
+#define C25519_AVX2
+
+extern int curve25519avx2_available(void);
+/* Projective results (x[i]:z[i]) of four scalar multiplications */
+extern void curve25519avx2_ladder(curve25519key_t *x, curve25519key_t *z, curve25519key_t *f, curve25519key_t *c);
+/* The swaps of the ladder for the scalar f, computed once for
+ * curve25519avx2_ladder_one(): s[n] before step n, then s[C25519BITS] */
+#define C25519SWAPS (C25519BITS + 1)
+extern void curve25519avx2_recode(unsigned char *s, curve25519key_t *f);
+/* The same as curve25519avx2_ladder() with a single scalar, recoded in s */
+extern void curve25519avx2_ladder_one(curve25519key_t *x, curve25519key_t *z, const unsigned char *s, curve25519key_t *c);
+#endif
+
+#endif /* __CURVE25519LIB_AVX2_H__ */
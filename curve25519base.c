@@ -0,0 +1,120 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Scalar multiplication of the base point u = 9, computed on the
+ * equivalent Edwards curve from the precomputed multiples in
+ * curve25519basetab.h (generated by curve25519basegen).
+ *
+ * The scalar is written in signed radix 16, f = sum e[i] 16^i with
+ * -8 <= e[i] <= 8, and the result is sum of the odd terms, multiplied by
+ * 16, plus the even terms, each term being looked up in base[i/2].
+ */
+
+#include "curve25519.h"
+#include "ge25519.h"
+#include "stats25519.h"
+#include "curve25519basetab.h"
+
+/* The order of the base point, 2^252 + 27742317777372353535851937790883648493 */
+static unsigned int order[8] = { 0x5cf5d3ed, 0x5812631a, 0xa2f79cd6, 0x14def9de, 0, 0, 0, 0x10000000 };
+
+/* w = w mod order, for any w < 2^256 < 16 * order */
+static void
+reduceorder(unsigned int *w) {
+  int k, i;
+  for (k = 3; k >= 0; k--) {
+    unsigned int t[8], s, m;
+    unsigned long long b = 0;
+    /* t = w - order * 2^k */
+    for (i = 0; i < 8; i++) {
+      s = order[i] << k;
+      if ((k > 0) && (i > 0)) {
+	s |= order[i - 1] >> (32 - k);
+      }
+      b = (unsigned long long)w[i] - s - b;
+      t[i] = (unsigned int)b;
+      b >>= 63;
+    }
+    /* keep the difference if there was no borrow */
+    m = (unsigned int)b - 1;
+    for (i = 0; i < 8; i++) {
+      w[i] ^= (w[i] ^ t[i]) & m;
+    }
+  }
+}
+
+static void
+selectbase(ge25519_precomp *t, int pos, int b) {
+  unsigned int neg = ((unsigned int)b) >> 31;
+  unsigned int babs = b - ((-neg & b) << 1);
+  int j;
+  ge25519_precomp_0(t);
+  for (j = 0; j < 8; j++) {
+    ge25519_precomp_cmov(t, &base[pos][j], ((babs ^ (j + 1)) - 1) >> 31);
+  }
+  ge25519_precomp_cneg(t, neg);
+}
+
+extern void
+curve25519_base(curve25519key_t *r, curve25519key_t *f) {
+  unsigned int w[8];
+  signed char e[64];
+  int carry, i;
+  ge25519_p3 h;
+  ge25519_p2 s;
+  ge25519_p1p1 t;
+  ge25519_precomp p;
+  C25519TIMER(tb);
+
+  for (i = 0; i < 8; i++) {
+    w[i] = curve25519key_getuint32(f, i);
+  }
+  reduceorder(w);
+  for (i = 0; i < 64; i++) {
+    e[i] = (w[i / 8] >> (4 * (i % 8))) & 15;
+  }
+  carry = 0;
+  for (i = 0; i < 63; i++) {
+    e[i] += carry;
+    carry = (e[i] + 8) >> 4;
+    e[i] -= carry << 4;
+  }
+  e[63] += carry;
+
+  ge25519_p3_0(&h);
+  for (i = 1; i < 64; i += 2) {
+    selectbase(&p, i / 2, e[i]);
+    ge25519_madd(&t, &h, &p);
+    ge25519_p1p1_to_p3(&h, &t);
+  }
+
+  ge25519_p3_to_p2(&s, &h);
+  ge25519_p2_dbl(&t, &s); ge25519_p1p1_to_p2(&s, &t);
+  ge25519_p2_dbl(&t, &s); ge25519_p1p1_to_p2(&s, &t);
+  ge25519_p2_dbl(&t, &s); ge25519_p1p1_to_p2(&s, &t);
+  ge25519_p2_dbl(&t, &s); ge25519_p1p1_to_p3(&h, &t);
+
+  for (i = 0; i < 64; i += 2) {
+    selectbase(&p, i / 2, e[i]);
+    ge25519_madd(&t, &h, &p);
+    ge25519_p1p1_to_p3(&h, &t);
+  }
+
+  C25519TIMER(ti);
+  ge25519_to_montgomery(r, &h);
+  C25519TIMED(INVERT, ti);
+  C25519TIMED(BASE, tb);
+}
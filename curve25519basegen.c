@@ -0,0 +1,127 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Writes to standard output the table used by curve25519_base():
+ * base[i][j] = (j + 1) * 256^i * B, where B is the Edwards point
+ * corresponding to the Curve25519 base point u = 9.  The values are
+ * printed in the limb representation of the configured field backend.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "curve25519.h"
+#include "ge25519.h"
+
+static unsigned int bx[8] = { 0x8f25d51a, 0xc9562d60, 0x9525a7b2, 0x692cc760, 0xfdd6dc5c, 0xc0a4e231, 0xcd6e53fe, 0x216936d3 };
+static unsigned int by[8] = { 0x66666658, 0x66666666, 0x66666666, 0x66666666, 0x66666666, 0x66666666, 0x66666666, 0x66666666 };
+
+static void
+loadwords(fe25519 *a, unsigned int *w) {
+  curve25519key_t k;
+  int i;
+  for (i = 0; i < 8; i++) {
+    curve25519key_setuint32(&k, i, w[i]);
+  }
+  loadmodp(a, &k);
+}
+
+/* Brings a to the canonical representation */
+static void
+canonical(fe25519 *a) {
+  curve25519key_t k;
+  storemodp(&k, a);
+  loadmodp(a, &k);
+}
+
+static void
+printfe(const char *sep, fe25519 *a) {
+  unsigned int i;
+  printf("%s{ ", sep);
+  for (i = 0; i < sizeof(fe25519) / sizeof(a[0][0]); i++) {
+    printf("%s0x%llx", i ? ", " : "", (unsigned long long)a[0][i]);
+  }
+  printf(" }");
+}
+
+int
+main() {
+  fe25519 d2, t;
+  ge25519_p3 b, p, q;
+  ge25519_p1p1 r;
+  ge25519_p2 s;
+  ge25519_cached c;
+  curve25519key_t u, nine = { 9 };
+  int i, j, k;
+
+  /* d2 = 2 * (-121665 / 121666) */
+  setmodp(&d2, 121666); invmodp(&d2);
+  setmodp(&t, 121665); mulmodp(&d2, &t);
+  setmodp(&t, 0); submodp(&t, &d2);
+  copymodp(&d2, &t); addmodp(&d2, &t); canonical(&d2);
+
+  loadwords(&b.X, bx);
+  loadwords(&b.Y, by);
+  setmodp(&b.Z, 1);
+  copymodp(&b.T, &b.X); mulmodp(&b.T, &b.Y);
+
+  ge25519_to_montgomery(&u, &b);
+  for (i = 0; i < C25519N; i++) {
+    if (u[i] != nine[i]) {
+      fprintf(stderr, "curve25519basegen: base point does not map to u = 9\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  printf("/* Generated by curve25519basegen, do not edit */\n\n");
+  printf("static ge25519_precomp base[32][8] = {\n");
+  p = b;
+  for (i = 0; i < 32; i++) {
+    printf("  {\n");
+    ge25519_p3_to_cached(&c, &p, &d2);
+    q = p;
+    for (j = 0; j < 8; j++) {
+      fe25519 x, y, zi;
+      ge25519_precomp e;
+      if (j > 0) {
+	ge25519_add(&r, &q, &c);
+	ge25519_p1p1_to_p3(&q, &r);
+      }
+      copymodp(&zi, &q.Z); invmodp(&zi);
+      copymodp(&x, &q.X); mulmodp(&x, &zi);
+      copymodp(&y, &q.Y); mulmodp(&y, &zi);
+      copymodp(&e.yplusx, &y); addmodp(&e.yplusx, &x); canonical(&e.yplusx);
+      copymodp(&e.yminusx, &y); submodp(&e.yminusx, &x); canonical(&e.yminusx);
+      copymodp(&e.xy2d, &x); mulmodp(&e.xy2d, &y); mulmodp(&e.xy2d, &d2); canonical(&e.xy2d);
+      printfe("    {", &e.yplusx);
+      printfe(", ", &e.yminusx);
+      printfe(", ", &e.xy2d);
+      printf(" },\n");
+    }
+    printf("  },\n");
+    /* p = 256 * p */
+    ge25519_p3_to_p2(&s, &p);
+    for (k = 0; k < 8; k++) {
+      ge25519_p2_dbl(&r, &s);
+      if (k < 7) {
+	ge25519_p1p1_to_p2(&s, &r);
+      } else {
+	ge25519_p1p1_to_p3(&p, &r);
+      }
+    }
+  }
+  printf("};\n");
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,397 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Microbenchmarks of the field operations, the ladder steps and the
+ * public functions, and of the scaling of the worker pool.
+ *
+ * Each measurement is a series of samples, each running the operation
+ * enough times in a row to take at least SAMPLENS; the time per
+ * operation of the samples gives the latency percentiles, and their
+ * total the throughput.  Cycles are read from the time stamp counter
+ * where there is one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "curve25519.h"
+#include "curve25519pool.h"
+#include "curve25519avx2.h"
+#include "fe25519.h"
+#include "mont25519.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_CYCLES 1
+#define cycles() __builtin_ia32_rdtsc()
+#else
+#define HAVE_CYCLES 0
+#define cycles() 0
+#endif
+
+/* Minimum length of a sample, and time spent on each measurement */
+#define SAMPLENS 20000
+#define MEASURENS 300000000
+#define MAXSAMPLES 4096
+
+/* The chunk of curve25519pool.c: each thread gets several, so that all
+   of them have work and stealing evens out the ranges */
+#define POOLCHUNK 64
+/* Runs per thread count, of which the fastest is kept */
+#define POOLRUNS 3
+
+struct result {
+  const char *name;
+  unsigned long long ops;
+  double seconds;
+  double cycles;		/* per operation */
+  double p50, p90, p99;		/* ns per operation */
+};
+
+typedef void bench_t(void *s, unsigned int k);
+
+struct state {
+  fe25519 a[2], b[2], c[2], d[2], e;
+  curve25519key_t k, l;
+};
+
+static uint64_t
+now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void
+randomkey(curve25519key_t *k) {
+  static uint64_t s = 0x9e3779b97f4a7c15ULL;
+  unsigned int i;
+  for (i = 0; i < 32; i++) {
+    s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+    curve25519key_setbyte(k, i, s & 0xff);
+  }
+}
+
+static void
+init(struct state *s) {
+  curve25519key_t t;
+  int i;
+  for (i = 0; i < 2; i++) {
+    randomkey(&t); t[C25519N - 1] >>= 2; loadmodp(s->a + i, &t);
+    randomkey(&t); t[C25519N - 1] >>= 2; loadmodp(s->b + i, &t);
+    randomkey(&t); t[C25519N - 1] >>= 2; loadmodp(s->c + i, &t);
+    randomkey(&t); t[C25519N - 1] >>= 2; loadmodp(s->d + i, &t);
+  }
+  randomkey(&t); t[C25519N - 1] >>= 2; loadmodp(&s->e, &t);
+  randomkey(&s->k);
+  randomkey(&s->l);
+}
+
+/* The operations form dependency chains, so that they are not
+   optimized away and consecutive ones cannot overlap */
+static void
+bmul(void *v, unsigned int k) {
+  struct state *s = v;
+  while (k--) {
+    mulmodp(s->a, s->b);
+  }
+}
+
+static void
+bsqr(void *v, unsigned int k) {
+  struct state *s = v;
+  while (k--) {
+    sqrmodp(s->a);
+  }
+}
+
+static void
+bmulasmall(void *v, unsigned int k) {
+  struct state *s = v;
+  while (k--) {
+    mulasmall(s->a);
+  }
+}
+
+static void
+binv(void *v, unsigned int k) {
+  struct state *s = v;
+  while (k--) {
+    invmodp(s->a);
+  }
+}
+
+/* Both inversions, whichever invmodp uses */
+static void
+binvchain(void *v, unsigned int k) {
+  struct state *s = v;
+  while (k--) {
+    invchainmodp(s->a);
+  }
+}
+
+#ifdef C25519_HAVE_SAFEGCD
+static void
+binvgcd(void *v, unsigned int k) {
+  struct state *s = v;
+  while (k--) {
+    invgcdmodp(s->a);
+  }
+}
+#endif
+
+static void
+bdbl(void *v, unsigned int k) {
+  struct state *s = v;
+  unsigned int i;
+  for (i = 0; i < k; i++) {
+    unsigned int j = i & 1;
+    dbl(s->a + (j ^ 1), s->b + (j ^ 1), s->a + j, s->b + j);
+  }
+}
+
+static void
+bsum(void *v, unsigned int k) {
+  struct state *s = v;
+  unsigned int i;
+  for (i = 0; i < k; i++) {
+    unsigned int j = i & 1;
+    sum(s->a + (j ^ 1), s->b + (j ^ 1), s->a + j, s->b + j, s->c + j, s->d + j, &s->e);
+  }
+}
+
+static void
+bladderstep(void *v, unsigned int k) {
+  struct state *s = v;
+  while (k--) {
+    ladderstep(s->a, s->b, s->c, s->d, &s->e);
+  }
+}
+
+static void
+bcurve25519(void *v, unsigned int k) {
+  struct state *s = v;
+  while (k--) {
+    curve25519(&s->l, &s->k, &s->l);
+  }
+}
+
+static void
+bbase(void *v, unsigned int k) {
+  struct state *s = v;
+  while (k--) {
+    curve25519_base(&s->k, &s->k);
+  }
+}
+
+static int
+cmpdouble(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void
+measure(struct result *r, const char *name, bench_t *b, double scale) {
+  static double t[MAXSAMPLES];
+  struct state s;
+  unsigned int k = 1, n = 0;
+  uint64_t c = 0, ns = 0;
+  init(&s);
+  /* Warm up, and find the operations per sample */
+  for (;;) {
+    uint64_t t0 = now();
+    b(&s, k);
+    if ((now() - t0 >= SAMPLENS) || (k >= (1u << 24))) {
+      break;
+    }
+    k *= 2;
+  }
+  while ((n < MAXSAMPLES) && (ns < MEASURENS * scale)) {
+    uint64_t t0 = now(), c0 = cycles(), d;
+    b(&s, k);
+    c += cycles() - c0;
+    d = now() - t0;
+    ns += d;
+    t[n++] = (double)d / k;
+  }
+  qsort(t, n, sizeof(double), cmpdouble);
+  r->name = name;
+  r->ops = (unsigned long long)n * k;
+  r->seconds = ns / 1e9;
+  r->cycles = (double)c / r->ops;
+  r->p50 = t[n / 2];
+  r->p90 = t[n * 9 / 10];
+  r->p99 = t[n * 99 / 100];
+}
+
+/* Throughput of the pool with 1 to max threads */
+static void
+scaling(double *dh, double *kg, unsigned int max, double scale) {
+  unsigned int chunks = (16 * scale > 4) ? (unsigned int)(16 * scale) : 4;
+  unsigned int t, n = POOLCHUNK * chunks * max, i, j;
+  curve25519key_t *f = malloc(3 * (size_t)n * sizeof(curve25519key_t)), *c = f + n, *r = c + n;
+  if (!f) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < n; i++) {
+    randomkey(f + i);
+    randomkey(c + i);
+  }
+  for (t = 1; t <= max; t++) {
+    curve25519pool_t *p = curve25519pool_new(t);
+    unsigned int m = POOLCHUNK * chunks * t;
+    if (!p) {
+      fprintf(stderr, "Cannot start %u threads\n", t);
+      exit(EXIT_FAILURE);
+    }
+    dh[t - 1] = kg[t - 1] = 0;
+    for (j = 0; j < POOLRUNS; j++) {
+      uint64_t t0 = now();
+      double v;
+      curve25519pool_run(p, r, f, c, m);
+      v = m / ((now() - t0) / 1e9);
+      if (v > dh[t - 1]) {
+	dh[t - 1] = v;
+      }
+      t0 = now();
+      curve25519pool_run(p, r, f, NULL, m);
+      v = m / ((now() - t0) / 1e9);
+      if (v > kg[t - 1]) {
+	kg[t - 1] = v;
+      }
+    }
+    curve25519pool_free(p);
+  }
+  free(f);
+}
+
+static void
+usage(FILE *f, const char *p) {
+  fprintf(f,
+	  "Usage: %s [--json] [--threads N] [--quick]\n\n"
+	  "Measures the field operations, the ladder steps, curve25519() and\n"
+	  "curve25519_base(), and the throughput of a pool of 1 to N threads\n"
+	  "(default: one per online processor).  --quick shortens all the\n"
+	  "measurements tenfold; --json prints the results as JSON.\n",
+	  p);
+}
+
+int main(int argc, const char *argv[]) {
+  struct result r[11];
+  double *dh, *kg, scale = 1;
+  unsigned int threads = 0, n = 0, i;
+  int json = 0;
+  for (i = 1; i < (unsigned int)argc; i++) {
+    if (strcmp(argv[i], "--json") == 0) {
+      json = 1;
+    } else if (strcmp(argv[i], "--quick") == 0) {
+      scale = 0.1;
+    } else if ((strcmp(argv[i], "--threads") == 0) && (i + 1 < (unsigned int)argc) && (atoi(argv[i + 1]) > 0)) {
+      threads = atoi(argv[++i]);
+    } else {
+      usage((strcmp(argv[i], "--help") == 0) ? stdout : stderr, argv[0]);
+      exit((strcmp(argv[i], "--help") == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+  if (threads == 0) {
+    long c = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = (c > 0) ? c : 1;
+  }
+
+  measure(r + n++, "mulmodp", bmul, scale);
+  measure(r + n++, "sqrmodp", bsqr, scale);
+  measure(r + n++, "mulasmall", bmulasmall, scale);
+  measure(r + n++, "invmodp", binv, scale);
+  measure(r + n++, "invchainmodp", binvchain, scale);
+#ifdef C25519_HAVE_SAFEGCD
+  measure(r + n++, "invgcdmodp", binvgcd, scale);
+#endif
+  measure(r + n++, "dbl", bdbl, scale);
+  measure(r + n++, "sum", bsum, scale);
+  measure(r + n++, "ladderstep", bladderstep, scale);
+  measure(r + n++, "curve25519", bcurve25519, scale);
+  measure(r + n++, "curve25519_base", bbase, scale);
+
+  dh = malloc(2 * threads * sizeof(double));
+  if (!dh) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  kg = dh + threads;
+  scaling(dh, kg, threads, scale);
+
+  if (json) {
+    printf("{\n  \"backend\": \"%s\",\n  \"avx2\": %s,\n  \"mulx\": %s,\n  \"cxx\": %s,\n  \"cycles\": %s,\n  \"ops\": [\n",
+#ifdef C25519_FE51
+	   "fe51",
+#else
+	   "gmp",
+#endif
+#ifdef C25519_AVX2
+	   curve25519avx2_available() ? "true" : "false",
+#else
+	   "false",
+#endif
+#ifdef C25519_MULX
+	   curve25519mulx_available() ? "true" : "false",
+#else
+	   "false",
+#endif
+#ifdef C25519_CXX
+	   "true",
+#else
+	   "false",
+#endif
+	   HAVE_CYCLES ? "true" : "false");
+    for (i = 0; i < n; i++) {
+      printf("    { \"name\": \"%s\", \"ops\": %llu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, ",
+	     r[i].name, r[i].ops, r[i].seconds, r[i].ops / r[i].seconds);
+      if (HAVE_CYCLES) {
+	printf("\"cycles_per_op\": %.1f, ", r[i].cycles);
+      } else {
+	printf("\"cycles_per_op\": null, ");
+      }
+      printf("\"ns_p50\": %.1f, \"ns_p90\": %.1f, \"ns_p99\": %.1f }%s\n",
+	     r[i].p50, r[i].p90, r[i].p99, (i + 1 < n) ? "," : "");
+    }
+    printf("  ],\n  \"scaling\": [\n");
+    for (i = 0; i < threads; i++) {
+      printf("    { \"threads\": %u, \"curve25519_per_sec\": %.1f, \"curve25519_base_per_sec\": %.1f }%s\n",
+	     i + 1, dh[i], kg[i], (i + 1 < threads) ? "," : "");
+    }
+    printf("  ]\n}\n");
+  } else {
+    printf("%-16s %12s %12s %10s %10s %10s\n", "operation", "cycles/op", "ops/s", "p50 ns", "p90 ns", "p99 ns");
+    for (i = 0; i < n; i++) {
+      if (HAVE_CYCLES) {
+	printf("%-16s %12.1f", r[i].name, r[i].cycles);
+      } else {
+	printf("%-16s %12s", r[i].name, "-");
+      }
+      printf(" %12.1f %10.1f %10.1f %10.1f\n",
+	     r[i].ops / r[i].seconds, r[i].p50, r[i].p90, r[i].p99);
+    }
+    printf("\n%-8s %16s %8s %16s %8s\n", "threads", "curve25519/s", "speedup", "base/s", "speedup");
+    for (i = 0; i < threads; i++) {
+      printf("%-8u %16.1f %8.2f %16.1f %8.2f\n", i + 1, dh[i], dh[i] / dh[0], kg[i], kg[i] / kg[0]);
+    }
+  }
+  free(dh);
+  return 0;
+}
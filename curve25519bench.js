@@ -0,0 +1,140 @@
+// Copyright (c) 2007, 2013 Michele Bini
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Checks the javascript implementation in curve25519.html against the
+// vectors in curve25519test.txt and TESTDUMP, and against ./curve25519
+// on random keys when it has been built, then measures its speed:
+//
+//   node curve25519bench.js [--keys N] [--seconds S]
+
+var fs = require("fs");
+var vm = require("vm");
+var path = require("path");
+var crypto = require("crypto");
+var child_process = require("child_process");
+
+var dir = __dirname;
+var keys = 100, seconds = 2;
+var failed = 0;
+
+for (var i = 2; i < process.argv.length; i++) {
+  var a = process.argv[i];
+  if (a == "--keys" && i + 1 < process.argv.length) {
+    keys = parseInt(process.argv[++i], 10);
+  } else if (a == "--seconds" && i + 1 < process.argv.length) {
+    seconds = parseFloat(process.argv[++i]);
+  } else {
+    console.error("Usage: node curve25519bench.js [--keys N] [--seconds S]");
+    process.exit(2);
+  }
+}
+
+// Runs the script of the page, without the page.  It goes in the main
+// context, as in a browser: globals of a separate vm context are much
+// slower to reach.
+var html = fs.readFileSync(path.join(dir, "curve25519.html"), "utf8");
+var m = html.match(/<script[^>]*>([\s\S]*?)<\/script>/);
+vm.runInThisContext(m[1], { filename: "curve25519.html" });
+var c255 = global;
+
+function fail(what, expected, got) {
+  console.log("FAIL " + what + ": expected " + expected + ", got " + got);
+  failed++;
+}
+
+// curve25519test.txt holds the two inputs and the result in
+// inverted-bytes hexadecimal
+function ibh2hex(s) {
+  return s.match(/../g).reverse().join("");
+}
+
+function vectors() {
+  var lines = fs.readFileSync(path.join(dir, "curve25519test.txt"), "utf8").split("\n");
+  var n = 0;
+  lines.forEach(function (l) {
+    var v = l.trim().split(/\s+/);
+    if (v.length != 3) {
+      return;
+    }
+    var r = c255.c255lhexencode(c255.curve25519(c255.c255lhexdecode(ibh2hex(v[0])), c255.c255lhexdecode(ibh2hex(v[1]))));
+    if (r != ibh2hex(v[2])) {
+      fail("curve25519test.txt line " + (n + 1), ibh2hex(v[2]), r);
+    }
+    n++;
+  });
+  console.log("curve25519test.txt: " + n + " vectors");
+}
+
+function testdump() {
+  var lines = fs.readFileSync(path.join(dir, "TESTDUMP"), "utf8").split("\n");
+  var n = 0;
+  for (var i = 0; i + 1 < lines.length; i++) {
+    var v = lines[i].trim().split(/\s+/);
+    if (v[0] != "$" || v[1] != "./curve25519") {
+      continue;
+    }
+    var r = c255.curve25519b32(v[2], v.length > 3 ? v[3] : "j");
+    var e = lines[i + 1].trim();
+    if (r != e) {
+      fail(lines[i].trim(), e, r);
+    }
+    n++;
+  }
+  console.log("TESTDUMP: " + n + " vectors");
+}
+
+function crosscheck() {
+  var cmd = path.join(dir, "curve25519");
+  var input = [], expected, i;
+  if (!fs.existsSync(cmd)) {
+    console.log("./curve25519 not built, skipping the comparison with the C library");
+    return;
+  }
+  for (i = 0; i < keys; i++) {
+    input.push(crypto.randomBytes(32).toString("hex") + " " + crypto.randomBytes(32).toString("hex"));
+  }
+  expected = child_process.execFileSync(cmd, ["--unsafe", "--hex", "--batch"],
+					{ input: input.join("\n") + "\n", encoding: "utf8" }).trim().split("\n");
+  for (i = 0; i < keys; i++) {
+    var v = input[i].split(" ");
+    var r = c255.c255lhexencode(c255.curve25519(c255.c255lhexdecode(v[0]), c255.c255lhexdecode(v[1])));
+    if (r != expected[i]) {
+      fail("./curve25519 --hex " + input[i], expected[i], r);
+    }
+  }
+  console.log("./curve25519: " + keys + " random keys");
+}
+
+function bench() {
+  var f = c255.c255lhexdecode(crypto.randomBytes(32).toString("hex"));
+  var c = c255.c255lhexdecode(crypto.randomBytes(32).toString("hex"));
+  var n = 0, t, start = process.hrtime.bigint();
+  do {
+    c = c255.curve25519(f, c);
+    n++;
+    t = Number(process.hrtime.bigint() - start) / 1e9;
+  } while (t < seconds);
+  console.log("curve25519: " + n + " in " + t.toFixed(2) + " s, " +
+	      (n / t).toFixed(1) + " per second, " + (1000 * t / n).toFixed(3) + " ms each");
+}
+
+vectors();
+testdump();
+crosscheck();
+if (failed) {
+  console.log(failed + " failures");
+  process.exit(1);
+}
+bench();
@@ -0,0 +1,272 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Each shard is a chained hash table over a fixed array of entries, under
+ * its own mutex; lookups only hold it for a few comparisons, and the
+ * secret is computed without it on a miss.  Free entries are kept in a
+ * list threaded through the chain links.  When none is left, the CLOCK
+ * hand sweeps the array, clearing the reference bit of recently used
+ * entries, and evicts the first one it finds unreferenced.  A secret
+ * computed across a curve25519cache_forget() is not stored, since its
+ * key may be the one just forgotten.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include "curve25519.h"
+#include "curve25519cache.h"
+
+#define DEFAULTSHARDS 16
+#define NONE 0xffffffffu
+
+struct entry {
+  unsigned long long id;
+  curve25519key_t p, r;
+  uint32_t next;		/* in the chain of the bucket, or free list */
+  uint32_t bucket;
+  unsigned char used, ref;
+};
+
+struct shard {
+  pthread_mutex_t lock;
+  struct entry *e;
+  uint32_t *bucket;
+  uint32_t size, mask, free, hand, n;
+  unsigned long long forgets;	/* calls to curve25519cache_forget() */
+  unsigned long long hits, misses, evictions;
+  char pad[64];			/* keeps the locks on different cache lines */
+};
+
+struct curve25519cache {
+  unsigned int nshards;
+  uint64_t seed;
+  struct shard s[];
+};
+
+/* Not optimized away, unlike a memset of memory about to be reused */
+static void
+wipe(void *p, size_t n) {
+  volatile unsigned char *v = p;
+  while (n--) {
+    *v++ = 0;
+  }
+}
+
+static uint64_t
+hash(curve25519cache_t *c, unsigned long long id, curve25519key_t *p) {
+  uint64_t h = c->seed ^ id;
+  unsigned int j;
+  for (j = 0; j < C25519N; j++) {
+    h = (h ^ p[0][j]) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+extern curve25519cache_t *
+curve25519cache_new(size_t bytes, unsigned int shards) {
+  curve25519cache_t *c;
+  size_t head, per, n;
+  unsigned int i;
+  uint32_t b, k;
+  if (shards == 0) {
+    shards = DEFAULTSHARDS;
+  }
+  head = sizeof(*c) + shards * sizeof(struct shard);
+  /* Each entry also takes at most two bucket heads */
+  per = sizeof(struct entry) + 2 * sizeof(uint32_t);
+  if (bytes < head + shards * per) {
+    return NULL;
+  }
+  n = (bytes - head) / shards / per;
+  if (n >= NONE / 2) {
+    n = NONE / 2 - 1;
+  }
+  for (b = 1; b <= n; b *= 2) {
+  }
+  c = calloc(1, head);
+  if (!c) {
+    return NULL;
+  }
+  c->nshards = shards;
+  if (getrandom(&c->seed, sizeof(c->seed), 0) != sizeof(c->seed)) {
+    c->seed = (uint64_t)time(NULL) ^ (uintptr_t)c;
+  }
+  for (i = 0; i < shards; i++) {
+    struct shard *s = c->s + i;
+    s->e = calloc(n, sizeof(struct entry));
+    s->bucket = malloc(b * sizeof(uint32_t));
+    if (!s->e || !s->bucket) {
+      free(s->e);
+      free(s->bucket);
+      c->nshards = i;
+      curve25519cache_free(c);
+      return NULL;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    s->size = n;
+    s->mask = b - 1;
+    for (k = 0; k < b; k++) {
+      s->bucket[k] = NONE;
+    }
+    for (k = 0; k < n; k++) {
+      s->e[k].next = (k + 1 < n) ? k + 1 : NONE;
+    }
+    s->free = 0;
+  }
+  return c;
+}
+
+extern void
+curve25519cache_free(curve25519cache_t *c) {
+  unsigned int i;
+  for (i = 0; i < c->nshards; i++) {
+    struct shard *s = c->s + i;
+    wipe(s->e, s->size * sizeof(struct entry));
+    free(s->e);
+    free(s->bucket);
+    pthread_mutex_destroy(&s->lock);
+  }
+  free(c);
+}
+
+static struct entry *
+lookup(struct shard *s, uint32_t b, unsigned long long id, curve25519key_t *p) {
+  uint32_t i;
+  for (i = s->bucket[b]; i != NONE; i = s->e[i].next) {
+    struct entry *e = s->e + i;
+    if ((e->id == id) && (memcmp(e->p, p, sizeof(curve25519key_t)) == 0)) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+/* Removes entry i from its chain, wipes it and puts it on the free list */
+static void
+release(struct shard *s, uint32_t i) {
+  struct entry *e = s->e + i;
+  uint32_t *l = s->bucket + e->bucket;
+  while (*l != i) {
+    l = &s->e[*l].next;
+  }
+  *l = e->next;
+  wipe(e, sizeof(*e));
+  e->next = s->free;
+  s->free = i;
+  s->n--;
+}
+
+static uint32_t
+evict(struct shard *s) {
+  for (;;) {
+    uint32_t i = s->hand;
+    struct entry *e = s->e + i;
+    s->hand = (i + 1 < s->size) ? i + 1 : 0;
+    if (e->ref) {
+      e->ref = 0;
+    } else {
+      release(s, i);
+      s->evictions++;
+      return i;
+    }
+  }
+}
+
+extern int
+curve25519cache_compute(curve25519cache_t *c, unsigned long long id, curve25519key_t *r, curve25519key_t *f, curve25519key_t *p) {
+  uint64_t h = hash(c, id, p);
+  struct shard *s = c->s + (h % c->nshards);
+  uint32_t b = (h >> 32) & s->mask, i;
+  struct entry *e;
+  curve25519key_t k;
+  unsigned long long forgets;
+
+  pthread_mutex_lock(&s->lock);
+  e = lookup(s, b, id, p);
+  if (e) {
+    memcpy(r, e->r, sizeof(curve25519key_t));
+    e->ref = 1;
+    s->hits++;
+    pthread_mutex_unlock(&s->lock);
+    return 1;
+  }
+  s->misses++;
+  forgets = s->forgets;
+  pthread_mutex_unlock(&s->lock);
+
+  memcpy(k, p, sizeof(k));
+  curve25519(r, f, &k);
+
+  pthread_mutex_lock(&s->lock);
+  /* Another thread may have added it in the meantime */
+  if ((s->forgets == forgets) && !lookup(s, b, id, &k)) {
+    if (s->free == NONE) {
+      evict(s);
+    }
+    i = s->free;
+    e = s->e + i;
+    s->free = e->next;
+    e->id = id;
+    memcpy(e->p, k, sizeof(k));
+    memcpy(e->r, r, sizeof(curve25519key_t));
+    e->used = 1;
+    e->ref = 0;
+    e->bucket = b;
+    e->next = s->bucket[b];
+    s->bucket[b] = i;
+    s->n++;
+  }
+  pthread_mutex_unlock(&s->lock);
+  return 0;
+}
+
+extern void
+curve25519cache_forget(curve25519cache_t *c, unsigned long long id) {
+  unsigned int i;
+  uint32_t j;
+  for (i = 0; i < c->nshards; i++) {
+    struct shard *s = c->s + i;
+    pthread_mutex_lock(&s->lock);
+    s->forgets++;
+    for (j = 0; j < s->size; j++) {
+      if (s->e[j].used && (s->e[j].id == id)) {
+	release(s, j);
+      }
+    }
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+extern void
+curve25519cache_stats(curve25519cache_t *c, curve25519cachestats_t *r) {
+  unsigned int i;
+  memset(r, 0, sizeof(*r));
+  for (i = 0; i < c->nshards; i++) {
+    struct shard *s = c->s + i;
+    pthread_mutex_lock(&s->lock);
+    r->hits += s->hits;
+    r->misses += s->misses;
+    r->evictions += s->evictions;
+    r->entries += s->n;
+    r->capacity += s->size;
+    pthread_mutex_unlock(&s->lock);
+  }
+}
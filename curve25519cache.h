@@ -0,0 +1,54 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CURVE25519LIB_CACHE_H__
+#define __CURVE25519LIB_CACHE_H__
+
+#include <stddef.h>
+#include "curve25519.h"
+
+/* A bounded, thread-safe cache of shared secrets.
+ *
+ * Entries are identified by a handle chosen by the caller for the
+ * private key (the key itself is never stored) and by the public key of
+ * the peer.  All the memory is allocated when the cache is created;
+ * when it is full, entries are evicted in CLOCK order, and evicted or
+ * forgotten secrets are overwritten with zeros. */
+
+typedef struct curve25519cache curve25519cache_t;
+
+typedef struct {
+  unsigned long long hits, misses, evictions;
+  unsigned int entries;		/* currently in use */
+  unsigned int capacity;
+} curve25519cachestats_t;
+
+/* Creates a cache using at most bytes of memory, split into shards with
+ * their own locks (0 for the default).  Returns NULL if bytes is too
+ * small or no memory is available. */
+extern curve25519cache_t *curve25519cache_new(size_t bytes, unsigned int shards);
+/* Wipes all the secrets and releases the cache */
+extern void curve25519cache_free(curve25519cache_t *c);
+
+/* r = curve25519(f, c), where id is the handle of f: the result is taken
+ * from the cache if present, else computed and stored.  Returns 1 on a
+ * hit, 0 on a miss. */
+extern int curve25519cache_compute(curve25519cache_t *c, unsigned long long id, curve25519key_t *r, curve25519key_t *f, curve25519key_t *p);
+/* Wipes all the entries of the private key id, e.g. when it is retired */
+extern void curve25519cache_forget(curve25519cache_t *c, unsigned long long id);
+extern void curve25519cache_stats(curve25519cache_t *c, curve25519cachestats_t *s);
+
+#endif /* __CURVE25519LIB_CACHE_H__ */
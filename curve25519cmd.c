@@ -18,7 +18,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include "curve25519.h"
+#include "curve25519pool.h"
+#include "curve25519file.h"
+#include "curve25519stats.h"
 #include "base32.h"
+#include "hex.h"
 
 static void
 usage(FILE*f, const char*p, int q) {
@@ -32,6 +36,15 @@ usage(FILE*f, const char*p, int q) {
 	  "  %s [OPT]... [FMT] <private key> [FMT]\n\n"
 	  "Obtain shared secret from <public key> with your private key:\n"
 	  "  %s [OPT]... [FMT] <private key> [FMT] <public key> [FMT]\n\n"
+	  "Process one private key, optionally followed by a public key, per\n"
+	  "line of standard input, writing one result per line:\n"
+	  "  %s [OPT]... [FMT] --batch [--threads N]\n"
+	  "N worker threads (default 1) compute while the input is parsed and\n"
+	  "the output written; results keep the order of the input lines.\n\n"
+	  "Process a binary key file (see curve25519file.h) into another:\n"
+	  "  %s --file <input> <output> [--threads N] [--align] [--huge]\n"
+	  "--align pads the output records to 64 bytes; --huge asks for huge\n"
+	  "pages.  Keys are not validated in this mode.\n\n"
 	  "FMT specifies the format used for the keys.\n"
 	  "It is one of the options:\n"
 	  "  --b32: base32-encoded (default)\n"
@@ -40,8 +53,237 @@ usage(FILE*f, const char*p, int q) {
 	  "OPT is one of the options:\n"
 	  "  --safe: abort program when potentially unsafe keys are seen\n"
 	  "  --warn: just warn about it (default)\n"
-	  "  --unsafe: do not perform any key validation\n\n",
-	  p, p, p);
+	  "  --unsafe: do not perform any key validation\n"
+	  "  --stats: print statistics to standard error on exit (if built\n"
+	  "           with STATS=1)\n\n",
+	  p, p, p, p);
+}
+
+/* Returns 0 on success, -1 if a is not a key in the given format */
+static int
+parsekey(const char *a, int format, curve25519key_t *k) {
+  switch (format) {
+  case 0:
+    base32_decode(a, k);
+    break;
+
+  case 1:
+    if (hex_decode(a, k) < 0) {
+      fprintf(stderr, "Bad character where an hexadecimal key was expected: %c\n",
+	      a[strspn(a, "0123456789abcdefABCDEF")]);
+      return -1;
+    }
+    break;
+
+  default:
+    if (ibh_decode(a, k) < 0) {
+      fprintf(stderr, "Bad key format.\n");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void
+printkey(FILE *o, int format, curve25519key_t *k) {
+  char s[(C25519BITS/4)+2];
+  size_t n;
+  switch (format) {
+  case 0:
+    n = base32_encode_n(s, k, 1);
+    break;
+
+  case 1:
+    n = hex_encode_n(s, k, 1);
+    break;
+
+  default:
+    n = ibh_encode_n(s, k, 1);
+    break;
+  }
+  fwrite(s, 1, n, o);
+}
+
+/* Lines of input handled together in batch mode */
+#define BLOCKLINES 4096
+
+/* Lines with one key go to the g arrays (public key generation), those
+   with two keys to the d arrays (shared secrets). */
+struct block {
+  unsigned long first;	/* number of the first line in the block */
+  unsigned int n, ng, nd;
+  char two[BLOCKLINES];
+  unsigned long line[BLOCKLINES];
+  curve25519key_t gf[BLOCKLINES], gr[BLOCKLINES];
+  curve25519key_t df[BLOCKLINES], dc[BLOCKLINES], dr[BLOCKLINES];
+  curve25519job_t *jg, *jd;
+};
+
+/* Bit i of the mask m */
+#define UNSAFE(m, i) (((m)[(i) / 64] >> ((i) % 64)) & 1)
+
+static void
+unsafekey(int sf, const char *what, unsigned long line) {
+  fprintf(stderr, "Line %lu: %s may be unsafe!\n", line, what);
+  if (sf > 1) {
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* Validates all the input keys of a block at once, then reports the
+   unsafe ones in the order of the lines */
+static void
+checkblock(struct block *b, int sf) {
+  unsigned long long mg[BLOCKLINES / 64], mf[BLOCKLINES / 64], mc[BLOCKLINES / 64];
+  unsigned int i, g = 0, d = 0;
+  if ((sf == 0) ||
+      (curve25519key_validate_batch(b->gf, b->ng, mg, 0) +
+       curve25519key_validate_batch(b->df, b->nd, mf, 0) +
+       curve25519key_validate_batch(b->dc, b->nd, mc, 0) == 0)) {
+    return;
+  }
+  for (i = 0; i < b->n; i++) {
+    if (b->two[i]) {
+      if (UNSAFE(mf, d)) {
+	unsafekey(sf, "input key n. 0", b->line[i]);
+      }
+      if (UNSAFE(mc, d)) {
+	unsafekey(sf, "input key n. 1", b->line[i]);
+      }
+      d++;
+    } else {
+      if (UNSAFE(mg, g)) {
+	unsafekey(sf, "input key n. 0", b->line[i]);
+      }
+      g++;
+    }
+  }
+}
+
+/* Reads up to BLOCKLINES non-empty lines; returns the number read */
+static unsigned int
+readblock(struct block *b, FILE *in, int format, int sf, unsigned long *line, char **buf, size_t *size) {
+  b->n = b->ng = b->nd = 0;
+  while (b->n < BLOCKLINES) {
+    char *t[3], *save;
+    int m = 0;
+    if (getline(buf, size, in) < 0) {
+      break;
+    }
+    (*line)++;
+    /* Stops at a third token, which is an error */
+    for (t[m] = strtok_r(*buf, " \t\r\n", &save); t[m]; t[m] = strtok_r(NULL, " \t\r\n", &save)) {
+      if (++m == 3) {
+	break;
+      }
+    }
+    if (m == 0) {
+      continue;
+    }
+    if (m > 2) {
+      fprintf(stderr, "Line %lu: too many keys\n", *line);
+      exit(EXIT_FAILURE);
+    }
+    if (m == 1) {
+      if (parsekey(t[0], format, b->gf + b->ng) < 0) {
+	fprintf(stderr, "Line %lu: bad key\n", *line);
+	exit(EXIT_FAILURE);
+      }
+      b->ng++;
+    } else {
+      if ((parsekey(t[0], format, b->df + b->nd) < 0) || (parsekey(t[1], format, b->dc + b->nd) < 0)) {
+	fprintf(stderr, "Line %lu: bad key\n", *line);
+	exit(EXIT_FAILURE);
+      }
+      b->nd++;
+    }
+    b->two[b->n] = (m == 2);
+    b->line[b->n] = *line;
+    b->n++;
+  }
+  checkblock(b, sf);
+  return b->n;
+}
+
+static void
+submitblock(curve25519pool_t *p, struct block *b) {
+  b->jg = curve25519pool_submit(p, b->gr, b->gf, NULL, b->ng, NULL, NULL);
+  b->jd = curve25519pool_submit(p, b->dr, b->df, b->dc, b->nd, NULL, NULL);
+  if (!b->jg || !b->jd) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void
+writeblock(struct block *b, FILE *out, int format, int sf) {
+  unsigned long long mg[BLOCKLINES / 64], md[BLOCKLINES / 64];
+  unsigned int i, g = 0, d = 0, r = 0;
+  curve25519job_wait(b->jg);
+  curve25519job_wait(b->jd);
+  if (sf > 0) {
+    r = curve25519key_validate_batch(b->gr, b->ng, mg, 0) + curve25519key_validate_batch(b->dr, b->nd, md, 0);
+  }
+  for (i = 0; i < b->n; i++) {
+    curve25519key_t *k;
+    if (b->two[i]) {
+      if (r && UNSAFE(md, d)) {
+	unsafekey(sf, "output key", b->line[i]);
+      }
+      k = b->dr + d++;
+    } else {
+      if (r && UNSAFE(mg, g)) {
+	unsafekey(sf, "output key", b->line[i]);
+      }
+      k = b->gr + g++;
+    }
+    printkey(out, format, k);
+  }
+}
+
+/* Parsing of a block, computation of the previous one in the worker
+   threads, and output of the one before overlap. */
+static void
+batch(int format, int sf, unsigned int threads) {
+  static char inbuf[1<<20], outbuf[1<<20];
+  struct block *b = malloc(2 * sizeof(struct block));
+  curve25519pool_t *p = curve25519pool_new(threads);
+  unsigned long line = 0;
+  char *buf = NULL;
+  size_t size = 0;
+  unsigned int c = 0;
+  if (!b || !p) {
+    fprintf(stderr, "Cannot start the batch computation\n");
+    exit(EXIT_FAILURE);
+  }
+  setvbuf(stdin, inbuf, _IOFBF, sizeof(inbuf));
+  setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+  while (readblock(b + c, stdin, format, sf, &line, &buf, &size) > 0) {
+    submitblock(p, b + c);
+    c ^= 1;
+    if (b[c].n > 0) {
+      writeblock(b + c, stdout, format, sf);
+      b[c].n = 0;
+    }
+  }
+  c ^= 1;
+  if (b[c].n > 0) {
+    writeblock(b + c, stdout, format, sf);
+  }
+  fflush(stdout);
+  curve25519pool_free(p);
+  free(buf);
+  free(b);
+}
+
+static void
+dumpstats(void) {
+  curve25519stats_t s;
+  if (curve25519_stats_snapshot(&s) < 0) {
+    fprintf(stderr, "Statistics are not available in this build\n");
+    return;
+  }
+  curve25519_stats_print(stderr, &s);
 }
 
 int main(int argc, const char *argv[]) {
@@ -50,11 +292,36 @@ int main(int argc, const char *argv[]) {
   int c = 1;
   int kk = 0; /* number of keys parsed */
   int sf = 1; /* 0: no validation; 1: warn; 2: reject invalid keys */
+  int bm = 0; /* batch mode */
+  unsigned int threads = 1;
+  const char *fin = NULL, *fout = NULL; /* key files */
+  int ff = 0; /* key file flags */
   while (c<argc) {
     int t = 0;
     const char*a = argv[c];
     c++;
-    if (strlen(a) > 8) {
+    if (strcmp(a, "--batch") == 0) {
+      bm = 1;
+    } else if (strcmp(a, "--threads") == 0) {
+      if ((c >= argc) || (atoi(argv[c]) <= 0)) {
+	usage(stderr, argv[0], 1);
+	exit(EXIT_FAILURE);
+      }
+      threads = atoi(argv[c]);
+      c++;
+    } else if (strcmp(a, "--file") == 0) {
+      if (c + 1 >= argc) {
+	usage(stderr, argv[0], 1);
+	exit(EXIT_FAILURE);
+      }
+      fin = argv[c];
+      fout = argv[c + 1];
+      c += 2;
+    } else if (strcmp(a, "--align") == 0) {
+      ff |= C25519FILE_ALIGN;
+    } else if (strcmp(a, "--huge") == 0) {
+      ff |= C25519FILE_HUGEPAGES;
+    } else if (strlen(a) > 8) {
       t = 1;
     } else if (a[0] == '-') {
       if (strcmp(a, "--hex") == 0) {
@@ -69,6 +336,8 @@ int main(int argc, const char *argv[]) {
 	sf = 1;
       } else if (strcmp(a, "--unsafe") == 0) {
 	sf = 0;
+      } else if (strcmp(a, "--stats") == 0) {
+	atexit(dumpstats);
       } else if (strcmp(a, "--help") == 0) {
 	usage(stdout, argv[0], 0);
 	exit(EXIT_SUCCESS);
@@ -78,67 +347,36 @@ int main(int argc, const char *argv[]) {
     }
     if (t == 1) {
       k = realloc(k, sizeof(curve25519key_t)*(kk + 1));
-      switch (format) {
-      case 0:
-	base32_decode(a, k + kk);
-	break;
-
-      case 1:
-	{
-	  int l = strlen(a);
-	  unsigned int p;
-	  unsigned int b = 0;
-	  while (l > 0) {
-	    l--; p = a[l];
-	    switch (p) {
-	    case '0': case '1': case '2': case '3': case '4':
-	    case '5': case '6': case '7': case '8': case '9':
-	      p = p - '0';
-	      break;
-	    case 'a': case 'b': case 'c': case 'd': case 'e': case 'f':
-	      p = p - ('a' - 10);
-	      break;
-	    case 'A': case 'B': case 'C': case 'D': case 'E': case 'F':
-	      p = p - ('A' - 10);
-	      break;
-	    default:
-	      fprintf(stderr, "Bad character where an hexadecimal key was expected: %c\n", p);
-	      exit(EXIT_FAILURE);
-	    }
-	    curve25519key_setbit(k+kk, b, p&1); p >>= 1; b++;
-	    curve25519key_setbit(k+kk, b, p&1); p >>= 1; b++;
-	    curve25519key_setbit(k+kk, b, p&1); p >>= 1; b++;
-	    curve25519key_setbit(k+kk, b, p&1); p >>= 1; b++;
-	  }
-	  while (b < C25519BITS) {
-	    curve25519key_setbit(k+kk, b, 0); b++;
-	  }
-	}
-	break;
-
-      default:
-	{
-	  unsigned int x[32];
-	  int n = sscanf(a, "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
-			 x, x+1, x+2, x+3, x+4, x+5, x+6, x+7,
-			 x+8, x+9, x+10, x+11, x+12, x+13, x+14, x+15,
-			 x+16, x+17, x+18, x+19, x+20, x+21, x+22, x+23,
-			 x+24, x+25, x+26, x+27, x+28, x+29, x+30, x+31
-			 );
-	  if (n != 32) {
-	    fprintf(stderr, "Bad key format.\n");
-	    usage(stderr, argv[0], 1);
-	    exit(EXIT_FAILURE);
-	  }
-	  for (n = 0; n < 32; n++) {
-	    curve25519key_setbyte(k+kk, n, x[n]);
-	  }
-	}
+      if (parsekey(a, format, k + kk) < 0) {
+	usage(stderr, argv[0], 1);
+	exit(EXIT_FAILURE);
       }
       kk++;
     }
   }
 
+  if (fin) {
+    curve25519pool_t *p = curve25519pool_new(threads);
+    if (bm || (kk > 0) || !p) {
+      usage(stderr, argv[0], 1);
+      exit(EXIT_FAILURE);
+    }
+    if (curve25519file_process(fin, fout, p, ff) < 0) {
+      perror(fin);
+      exit(EXIT_FAILURE);
+    }
+    curve25519pool_free(p);
+    exit(EXIT_SUCCESS);
+  }
+
+  if (bm) {
+    if (kk > 0) {
+      usage(stderr, argv[0], 1);
+      exit(EXIT_FAILURE);
+    }
+    batch(format, sf, threads);
+    exit(EXIT_SUCCESS);
+  }
 
   if (sf > 0) {
     int q;
@@ -153,24 +391,26 @@ int main(int argc, const char *argv[]) {
   }
   
   if (kk == 1) {
-    curve25519key_t b = { 9 };
-    curve25519(k, k, &b);
+    curve25519_base(k, k);
   } else if (kk > 1) {
+    /* The chain stays in projective form, with a single inversion */
     int q = kk - 1;
-    curve25519key_t *l = k + q;
+    curve25519proj_t l;
+    curve25519proj_from_key(&l, k + q);
     while (1) {
       q--;
-      curve25519(l, k + q, l);
+      curve25519_proj(&l, k + q, &l);
       if (q <= 0) {
 	break;
       }
-      if ((sf > 0) && !curve25519key_validate(l)) {
+      if ((sf > 0) && !curve25519proj_validate(&l)) {
 	fprintf(stderr, "Intermediate key may be unsafe!\n");
 	if (sf > 1) {
 	  exit(EXIT_FAILURE);
 	}
       }
     }
+    curve25519proj_to_key(k + kk - 1, &l);
   } else {
     usage(stderr, argv[0], 0);
     exit(EXIT_FAILURE);
@@ -183,31 +423,6 @@ int main(int argc, const char *argv[]) {
       exit(EXIT_FAILURE);
     }
   }
-  switch (format) {
-  case 0:
-    {
-      char s[(C25519BITS/4)+2];
-      base32_encode(s, k); printf("%s\n", s);
-    }
-    break;
-
-  case 1:
-    printf("%08x%08x%08x%08x%08x%08x%08x%08x\n",
-	   curve25519key_getuint32(k, 7), curve25519key_getuint32(k, 6), curve25519key_getuint32(k, 5), curve25519key_getuint32(k, 4),
-	   curve25519key_getuint32(k, 3), curve25519key_getuint32(k, 2), curve25519key_getuint32(k, 1), curve25519key_getuint32(k, 0));
-    break;
-
-  default:
-    printf("%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x\n",
-	   curve25519key_getbyte(k, 0), curve25519key_getbyte(k, 1), curve25519key_getbyte(k, 2), curve25519key_getbyte(k, 3),
-	   curve25519key_getbyte(k, 4), curve25519key_getbyte(k, 5), curve25519key_getbyte(k, 6), curve25519key_getbyte(k, 7),
-	   curve25519key_getbyte(k, 8), curve25519key_getbyte(k, 9), curve25519key_getbyte(k, 10), curve25519key_getbyte(k, 11),
-	   curve25519key_getbyte(k, 12), curve25519key_getbyte(k, 13), curve25519key_getbyte(k, 14), curve25519key_getbyte(k, 15),
-	   curve25519key_getbyte(k, 16), curve25519key_getbyte(k, 17), curve25519key_getbyte(k, 18), curve25519key_getbyte(k, 19),
-	   curve25519key_getbyte(k, 20), curve25519key_getbyte(k, 21), curve25519key_getbyte(k, 22), curve25519key_getbyte(k, 23),
-	   curve25519key_getbyte(k, 24), curve25519key_getbyte(k, 25), curve25519key_getbyte(k, 26), curve25519key_getbyte(k, 27),
-	   curve25519key_getbyte(k, 28), curve25519key_getbyte(k, 29), curve25519key_getbyte(k, 30), curve25519key_getbyte(k, 31));
-    break;
-  }
+  printkey(stdout, format, k);
   exit(EXIT_SUCCESS);
 }
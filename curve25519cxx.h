@@ -0,0 +1,35 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CURVE25519LIB_CXX_H__
+#define __CURVE25519LIB_CXX_H__
+
+/* C entry point to the C++ field template of fe25519.hh, compiled in
+ * with 'make CXX25519=1': curve25519() then runs a ladder specialized
+ * and inlined for a single field type, radix 2^51 unless
+ * C25519_CXX_RADIX is 64. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void curve25519cxx(curve25519key_t *r, curve25519key_t *f, curve25519key_t *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CURVE25519LIB_CXX_H__ */
@@ -0,0 +1,1115 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* curve25519d: computes curve25519() and curve25519_base() for local
+ * clients, over a Unix domain socket or shared-memory rings (the
+ * protocol is in curve25519d.h).
+ *
+ * A single thread runs the event loop: it accepts connections, reads
+ * the requests, scans the rings when their eventfd is written and sends
+ * the responses.  Each request becomes a run of keys in one queue.  The
+ * worker threads, pinned to their own processors, take up to --batch
+ * keys at a time from the queue, across requests, and compute them with
+ * a single curve25519_batch() call; a batch that is not full waits until
+ * the oldest key in the queue has been there for --deadline
+ * microseconds, so that under load batches fill up while a lone request
+ * is never held longer than that.  Completed requests go back to the
+ * event loop through a list and an eventfd, except the ring slots, which
+ * the workers complete themselves.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include "curve25519.h"
+#include "curve25519d.h"
+
+/* Latency histogram: bucket i counts the requests that took 2^i to
+   2^(i+1) - 1 ns, from being queued to being complete */
+#define BUCKETS 40
+
+enum { LISTEN, SIGNALS, DONE, CONN, BELL };
+
+/* What an epoll event points to */
+struct watch {
+  int kind;
+};
+
+struct conn;
+
+/* The keys of one socket request, or of a run of ring slots, then its
+   response */
+struct req {
+  struct conn *conn;
+  uint32_t op, n;
+  uint64_t id;
+  uint64_t t0;			/* ns, when it was queued */
+  unsigned int next;		/* first key not yet taken by a worker */
+  atomic_uint left;		/* keys not yet computed */
+  curve25519key_t *f, *c, *r;
+  uint32_t *slots;		/* ring slots, or NULL */
+  unsigned char *out;		/* response to send */
+  size_t outlen, sent;
+  int fds[3], nfds;		/* to send along with the response */
+  struct req *qnext;		/* in the queue, the done list or the output */
+};
+
+struct ring {
+  struct watch w;
+  struct conn *conn;
+  curve25519dring_t *r;		/* shared with the client */
+  size_t size;
+  int memfd, bell, done;
+  uint32_t slots, tail;		/* our own copies */
+};
+
+struct conn {
+  struct watch w;
+  int fd;
+  unsigned int refs;		/* the socket, and requests not yet released */
+  int closed, pollout;
+  curve25519dmsg_t hdr;
+  size_t got;			/* bytes of hdr read */
+  unsigned char *body;
+  size_t need, have;
+  struct req *outhead, *outtail;
+  struct ring *ring;
+  struct conn *dead;		/* in the list of connections to free */
+};
+
+/* Counters of a worker, only written by it */
+struct worker {
+  pthread_t thread;
+  unsigned int id;
+  int cpu;
+  uint64_t batches, keys, busy;
+  uint64_t requests, latency[BUCKETS];
+};
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  struct req *head, *tail;	/* queued requests */
+  unsigned int pending;		/* keys queued and not yet taken */
+  unsigned int maxpending;
+  int stop;
+  struct req *done;		/* completed, for the event loop */
+  int donefd;
+  unsigned int batch;
+  uint64_t deadline;		/* ns */
+  unsigned int nthreads;
+  struct worker *workers;
+} d;
+
+/* Only used by the event loop */
+static int epfd;
+static struct conn *dead;
+static unsigned long long connections, rings, requests;
+
+static uint64_t
+now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void
+counter(uint64_t *c, uint64_t v) {
+  __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+static uint64_t
+load(uint64_t *c) {
+  return __atomic_load_n(c, __ATOMIC_RELAXED);
+}
+
+/* Queueing and batching */
+
+static void
+enqueue(struct req *q) {
+  int wake;
+  q->t0 = now();
+  q->next = 0;
+  atomic_init(&q->left, q->n);
+  q->qnext = NULL;
+  pthread_mutex_lock(&d.lock);
+  /* A waiting worker has to start timing the deadline, or a full batch
+     is ready */
+  wake = !d.head;
+  if (d.tail) {
+    d.tail->qnext = q;
+  } else {
+    d.head = q;
+  }
+  d.tail = q;
+  d.pending += q->n;
+  if (d.pending > d.maxpending) {
+    d.maxpending = d.pending;
+  }
+  if (wake || (d.pending >= d.batch)) {
+    pthread_cond_signal(&d.work);
+  }
+  pthread_mutex_unlock(&d.lock);
+}
+
+struct span {
+  struct req *q;
+  unsigned int first, n;
+};
+
+/* Takes up to d.batch keys of the same operation from the front of the
+   queue; returns the number of spans */
+static unsigned int
+take(struct span *s) {
+  unsigned int k = 0, n = 0;
+  uint32_t op = d.head->op;
+  while (d.head && (d.head->op == op) && (n < d.batch)) {
+    struct req *q = d.head;
+    unsigned int m = q->n - q->next;
+    if (m > d.batch - n) {
+      m = d.batch - n;
+    }
+    s[k].q = q;
+    s[k].first = q->next;
+    s[k].n = m;
+    k++;
+    q->next += m;
+    n += m;
+    if (q->next == q->n) {
+      d.head = q->qnext;
+      if (!d.head) {
+	d.tail = NULL;
+      }
+    }
+  }
+  d.pending -= n;
+  return k;
+}
+
+static void
+record(struct worker *w, uint64_t t) {
+  unsigned int b = t ? 63 - __builtin_clzll(t) : 0;
+  if (b >= BUCKETS) {
+    b = BUCKETS - 1;
+  }
+  counter(&w->requests, 1);
+  counter(w->latency + b, 1);
+}
+
+/* Hands a completed request back to the event loop; ring slots are
+   completed right away */
+static void
+complete(struct worker *w, struct req *q, uint64_t t) {
+  uint64_t one = 1;
+  int wake;
+  record(w, t - q->t0);
+  if (q->slots) {
+    struct ring *g = q->conn->ring;
+    uint32_t i, mask = g->slots - 1;
+    for (i = 0; i < q->n; i++) {
+      curve25519dslot_t *s = g->r->slot + (q->slots[i] & mask);
+      curve25519key_to_bytes(s->r, q->r + i);
+      atomic_store_explicit(&s->state, C25519D_DONE, memory_order_release);
+    }
+    if (write(g->done, &one, sizeof(one)) < 0) {
+      /* The counter is saturated: the client has been woken anyway */
+    }
+  } else {
+    curve25519dmsg_t *h = (curve25519dmsg_t *)q->out;
+    h->status = 0;
+    curve25519key_to_bytes_n(q->out + sizeof(*h), q->r, q->n);
+  }
+  pthread_mutex_lock(&d.lock);
+  wake = !d.done;
+  q->qnext = d.done;
+  d.done = q;
+  pthread_mutex_unlock(&d.lock);
+  if (wake && (write(d.donefd, &one, sizeof(one)) < 0)) {
+    /* Likewise */
+  }
+}
+
+static void
+compute(struct worker *w, struct span *s, unsigned int k, curve25519key_t *f, curve25519key_t *c, curve25519key_t *r) {
+  unsigned int i, n = 0;
+  uint64_t t0 = now(), t;
+  for (i = 0; i < k; i++) {
+    memcpy(f + n, s[i].q->f + s[i].first, s[i].n * sizeof(*f));
+    if (s[i].q->op == C25519D_DH) {
+      memcpy(c + n, s[i].q->c + s[i].first, s[i].n * sizeof(*c));
+    }
+    n += s[i].n;
+  }
+  if (s[0].q->op == C25519D_DH) {
+    curve25519_batch(r, f, c, n);
+  } else {
+    for (i = 0; i < n; i++) {
+      curve25519_base(r + i, f + i);
+    }
+  }
+  t = now();
+  n = 0;
+  for (i = 0; i < k; i++) {
+    struct req *q = s[i].q;
+    memcpy(q->r + s[i].first, r + n, s[i].n * sizeof(*r));
+    n += s[i].n;
+    if (atomic_fetch_sub(&q->left, s[i].n) == s[i].n) {
+      complete(w, q, t);
+    }
+  }
+  counter(&w->batches, 1);
+  counter(&w->keys, n);
+  counter(&w->busy, t - t0);
+}
+
+static void *
+work(void *a) {
+  struct worker *w = a;
+  struct span *s = malloc(d.batch * (sizeof(*s) + 3 * sizeof(curve25519key_t)));
+  curve25519key_t *f = (curve25519key_t *)(s + d.batch), *c = f + d.batch, *r = c + d.batch;
+  if (!s) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  if (w->cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+  pthread_mutex_lock(&d.lock);
+  for (;;) {
+    unsigned int k;
+    if (!d.head) {
+      if (d.stop) {
+	break;
+      }
+      pthread_cond_wait(&d.work, &d.lock);
+      continue;
+    }
+    if ((d.pending < d.batch) && !d.stop) {
+      uint64_t due = d.head->t0 + d.deadline;
+      if (now() < due) {
+	struct timespec ts;
+	ts.tv_sec = due / 1000000000;
+	ts.tv_nsec = due % 1000000000;
+	pthread_cond_timedwait(&d.work, &d.lock, &ts);
+	continue;
+      }
+    }
+    k = take(s);
+    if (d.head) {
+      pthread_cond_signal(&d.work);
+    }
+    pthread_mutex_unlock(&d.lock);
+    compute(w, s, k, f, c, r);
+    pthread_mutex_lock(&d.lock);
+  }
+  pthread_mutex_unlock(&d.lock);
+  free(s);
+  return NULL;
+}
+
+/* The event loop */
+
+static void
+watch(int fd, struct watch *w, uint32_t events, int op) {
+  struct epoll_event e;
+  e.events = events;
+  e.data.ptr = w;
+  if (epoll_ctl(epfd, op, fd, &e) < 0) {
+    perror("epoll_ctl");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void
+freering(struct ring *g) {
+  munmap(g->r, g->size);
+  close(g->memfd);
+  close(g->bell);
+  close(g->done);
+  free(g);
+}
+
+/* Connections are only freed between two rounds of events, by bury():
+   the handling of an event may close the connection it is for, and
+   later events of the same round may still point to it */
+static void
+unref(struct conn *c) {
+  if (--c->refs == 0) {
+    c->dead = dead;
+    dead = c;
+  }
+}
+
+static void
+bury(void) {
+  struct conn *c;
+  while ((c = dead)) {
+    dead = c->dead;
+    if (c->ring) {
+      freering(c->ring);
+    }
+    free(c->body);
+    free(c);
+  }
+}
+
+/* Requests are allocated with their keys and response in one block */
+static struct req *
+newreq(struct conn *c, uint32_t op, uint32_t n, size_t extra) {
+  size_t keys = (op == C25519D_DH) ? 3 : 2;
+  struct req *q;
+  if ((op != C25519D_DH) && (op != C25519D_BASE)) {
+    keys = 0;
+  }
+  q = calloc(1, sizeof(*q) + n * keys * sizeof(curve25519key_t) + extra);
+  if (!q) {
+    return NULL;
+  }
+  q->conn = c;
+  q->op = op;
+  q->n = n;
+  q->f = (curve25519key_t *)(q + 1);
+  q->r = q->f + n;
+  q->c = (keys == 3) ? q->r + n : NULL;
+  q->out = (unsigned char *)(q->f + n * keys);
+  c->refs++;
+  return q;
+}
+
+static void
+release(struct req *q) {
+  struct conn *c = q->conn;
+  int i;
+  for (i = 0; i < q->nfds; i++) {
+    close(q->fds[i]);
+  }
+  free(q);
+  unref(c);
+}
+
+static void
+closeconn(struct conn *c) {
+  struct req *q;
+  if (c->closed) {
+    return;
+  }
+  c->closed = 1;
+  epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  if (c->ring) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->ring->bell, NULL);
+  }
+  while ((q = c->outhead)) {
+    c->outhead = q->qnext;
+    release(q);
+  }
+  connections--;
+  unref(c);
+}
+
+/* Sends what it can of the queued responses */
+static void
+flush(struct conn *c) {
+  struct req *q;
+  if (c->closed) {
+    return;
+  }
+  while ((q = c->outhead)) {
+    ssize_t k;
+    if ((q->sent == 0) && q->nfds) {
+      struct msghdr m;
+      struct iovec v;
+      union {
+	char b[CMSG_SPACE(sizeof(q->fds))];
+	struct cmsghdr align;
+      } u;
+      struct cmsghdr *h;
+      memset(&m, 0, sizeof(m));
+      v.iov_base = q->out;
+      v.iov_len = q->outlen;
+      m.msg_iov = &v;
+      m.msg_iovlen = 1;
+      m.msg_control = u.b;
+      m.msg_controllen = CMSG_SPACE(q->nfds * sizeof(int));
+      h = CMSG_FIRSTHDR(&m);
+      h->cmsg_level = SOL_SOCKET;
+      h->cmsg_type = SCM_RIGHTS;
+      h->cmsg_len = CMSG_LEN(q->nfds * sizeof(int));
+      memcpy(CMSG_DATA(h), q->fds, q->nfds * sizeof(int));
+      k = sendmsg(c->fd, &m, MSG_NOSIGNAL);
+    } else {
+      k = send(c->fd, q->out + q->sent, q->outlen - q->sent, MSG_NOSIGNAL);
+    }
+    if (k < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+	break;
+      }
+      closeconn(c);
+      return;
+    }
+    q->sent += k;
+    if (q->sent < q->outlen) {
+      continue;
+    }
+    c->outhead = q->qnext;
+    if (!c->outhead) {
+      c->outtail = NULL;
+    }
+    release(q);
+  }
+  if (!c->outhead != !c->pollout) {
+    c->pollout = !!c->outhead;
+    watch(c->fd, &c->w, EPOLLIN | (c->pollout ? EPOLLOUT : 0), EPOLL_CTL_MOD);
+  }
+}
+
+static void
+respond(struct req *q) {
+  struct conn *c = q->conn;
+  if (c->closed) {
+    release(q);
+    return;
+  }
+  q->qnext = NULL;
+  if (c->outtail) {
+    c->outtail->qnext = q;
+  } else {
+    c->outhead = q;
+  }
+  c->outtail = q;
+  if (!c->pollout) {
+    flush(c);
+  }
+}
+
+/* A response with no keys; returns -1 if there is no memory */
+static int
+status(struct conn *c, uint32_t op, uint64_t id, int32_t err) {
+  struct req *q = newreq(c, op, 0, sizeof(curve25519dmsg_t));
+  curve25519dmsg_t *h;
+  if (!q) {
+    return -1;
+  }
+  h = (curve25519dmsg_t *)q->out;
+  h->op = op;
+  h->id = id;
+  h->status = err;
+  q->outlen = sizeof(*h);
+  respond(q);
+  return 0;
+}
+
+static unsigned long long
+quantile(unsigned long long *h, unsigned long long n, double p) {
+  unsigned long long s = 0;
+  unsigned int b;
+  if (n == 0) {
+    return 0;
+  }
+  for (b = 0; b < BUCKETS - 1; b++) {
+    s += h[b];
+    if (s > n * p) {
+      break;
+    }
+  }
+  return (1ull << (b + 1)) / 1000;
+}
+
+static char *
+metrics(size_t *len) {
+  unsigned long long batches = 0, keys = 0, reqs = 0, h[BUCKETS];
+  unsigned int pending, maxpending, i, b;
+  size_t size = 4096 + 128 * d.nthreads, n = 0;
+  char *s = malloc(size);
+  if (!s) {
+    return NULL;
+  }
+  memset(h, 0, sizeof(h));
+  for (i = 0; i < d.nthreads; i++) {
+    struct worker *w = d.workers + i;
+    batches += load(&w->batches);
+    keys += load(&w->keys);
+    reqs += load(&w->requests);
+    for (b = 0; b < BUCKETS; b++) {
+      h[b] += load(w->latency + b);
+    }
+  }
+  pthread_mutex_lock(&d.lock);
+  pending = d.pending;
+  maxpending = d.maxpending;
+  pthread_mutex_unlock(&d.lock);
+#define P(...) n += snprintf(s + n, size - n, __VA_ARGS__)
+  P("curve25519d_threads %u\n", d.nthreads);
+  P("curve25519d_batch_max %u\n", d.batch);
+  P("curve25519d_deadline_us %llu\n", (unsigned long long)d.deadline / 1000);
+  P("curve25519d_connections %llu\n", connections);
+  P("curve25519d_rings %llu\n", rings);
+  P("curve25519d_queue_depth %u\n", pending);
+  P("curve25519d_queue_depth_max %u\n", maxpending);
+  P("curve25519d_requests_total %llu\n", requests);
+  P("curve25519d_requests_completed_total %llu\n", reqs);
+  P("curve25519d_keys_total %llu\n", keys);
+  P("curve25519d_batches_total %llu\n", batches);
+  P("curve25519d_batch_keys_avg %.2f\n", batches ? (double)keys / batches : 0.0);
+  P("curve25519d_latency_us{quantile=\"0.5\"} %llu\n", quantile(h, reqs, 0.5));
+  P("curve25519d_latency_us{quantile=\"0.9\"} %llu\n", quantile(h, reqs, 0.9));
+  P("curve25519d_latency_us{quantile=\"0.99\"} %llu\n", quantile(h, reqs, 0.99));
+  for (b = 0; b < BUCKETS; b++) {
+    if (h[b]) {
+      P("curve25519d_latency_ns_bucket{ge=\"%llu\"} %llu\n", 1ull << b, h[b]);
+    }
+  }
+  for (i = 0; i < d.nthreads; i++) {
+    struct worker *w = d.workers + i;
+    P("curve25519d_worker_busy_seconds{worker=\"%u\",cpu=\"%d\"} %.6f\n", i, w->cpu, load(&w->busy) / 1e9);
+  }
+#undef P
+  *len = (n < size) ? n : size - 1;
+  return s;
+}
+
+static int
+newring(struct conn *c, curve25519dmsg_t *m) {
+  struct ring *g;
+  struct req *q;
+  curve25519dmsg_t *h;
+  uint32_t slots = m->n;
+  if (c->ring) {
+    return status(c, m->op, m->id, -EEXIST);
+  }
+  if ((slots == 0) || (slots > C25519D_MAXKEYS) || (slots & (slots - 1))) {
+    return status(c, m->op, m->id, -EINVAL);
+  }
+  g = calloc(1, sizeof(*g));
+  q = newreq(c, m->op, 0, sizeof(*h));
+  if (!g || !q) {
+    free(g);
+    if (q) {
+      release(q);
+    }
+    return -1;
+  }
+  g->w.kind = BELL;
+  g->conn = c;
+  g->size = offsetof(curve25519dring_t, slot) + slots * sizeof(curve25519dslot_t);
+  g->memfd = memfd_create("curve25519d", MFD_CLOEXEC);
+  g->bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  g->done = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  g->r = MAP_FAILED;
+  if ((g->memfd < 0) || (g->bell < 0) || (g->done < 0) || (ftruncate(g->memfd, g->size) < 0) ||
+      ((g->r = mmap(NULL, g->size, PROT_READ | PROT_WRITE, MAP_SHARED, g->memfd, 0)) == MAP_FAILED)) {
+    int e = errno;
+    if (g->r == MAP_FAILED) {
+      g->r = NULL;
+    }
+    if (g->memfd >= 0) close(g->memfd);
+    if (g->bell >= 0) close(g->bell);
+    if (g->done >= 0) close(g->done);
+    free(g);
+    release(q);
+    return status(c, m->op, m->id, -e);
+  }
+  g->slots = slots;
+  g->r->magic = C25519D_MAGIC;
+  g->r->slots = slots;
+  c->ring = g;
+  rings++;
+  watch(g->bell, &g->w, EPOLLIN, EPOLL_CTL_ADD);
+  h = (curve25519dmsg_t *)q->out;
+  h->op = m->op;
+  h->n = slots;
+  h->id = m->id;
+  q->outlen = sizeof(*h);
+  /* Duplicates, closed once sent */
+  q->fds[0] = dup(g->memfd);
+  q->fds[1] = dup(g->bell);
+  q->fds[2] = dup(g->done);
+  q->nfds = 3;
+  if ((q->fds[0] < 0) || (q->fds[1] < 0) || (q->fds[2] < 0)) {
+    for (; q->nfds > 0; q->nfds--) {
+      if (q->fds[q->nfds - 1] >= 0) {
+	close(q->fds[q->nfds - 1]);
+      }
+    }
+    h->status = -EMFILE;
+  }
+  respond(q);
+  return 0;
+}
+
+/* A complete message has been read */
+static int
+handle(struct conn *c) {
+  curve25519dmsg_t *m = &c->hdr;
+  struct req *q;
+  char *s;
+  size_t n;
+  switch (m->op) {
+  case C25519D_DH:
+  case C25519D_BASE:
+    q = newreq(c, m->op, m->n, sizeof(curve25519dmsg_t) + m->n * 32);
+    if (!q) {
+      return -1;
+    }
+    q->id = m->id;
+    if (m->op == C25519D_DH) {
+      unsigned int i;
+      for (i = 0; i < m->n; i++) {
+	curve25519key_from_bytes(q->f + i, c->body + 64 * i);
+	curve25519key_from_bytes(q->c + i, c->body + 64 * i + 32);
+      }
+    } else {
+      curve25519key_from_bytes_n(q->f, c->body, m->n);
+    }
+    ((curve25519dmsg_t *)q->out)->op = m->op;
+    ((curve25519dmsg_t *)q->out)->n = m->n;
+    ((curve25519dmsg_t *)q->out)->id = m->id;
+    q->outlen = sizeof(curve25519dmsg_t) + m->n * 32;
+    requests++;
+    if (m->n == 0) {
+      respond(q);
+    } else {
+      enqueue(q);
+    }
+    return 0;
+
+  case C25519D_METRICS:
+    s = metrics(&n);
+    q = s ? newreq(c, m->op, 0, sizeof(curve25519dmsg_t) + n) : NULL;
+    if (!q) {
+      free(s);
+      return -1;
+    }
+    ((curve25519dmsg_t *)q->out)->op = m->op;
+    ((curve25519dmsg_t *)q->out)->n = n;
+    ((curve25519dmsg_t *)q->out)->id = m->id;
+    memcpy(q->out + sizeof(curve25519dmsg_t), s, n);
+    free(s);
+    q->outlen = sizeof(curve25519dmsg_t) + n;
+    respond(q);
+    return 0;
+
+  case C25519D_RING:
+    return newring(c, m);
+  }
+  return status(c, m->op, m->id, -EINVAL);
+}
+
+static void
+readconn(struct conn *c) {
+  for (;;) {
+    ssize_t k;
+    if (c->got < sizeof(c->hdr)) {
+      k = recv(c->fd, (char *)&c->hdr + c->got, sizeof(c->hdr) - c->got, 0);
+    } else {
+      k = recv(c->fd, c->body + c->have, c->need - c->have, 0);
+    }
+    if (k <= 0) {
+      if ((k < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+	return;
+      }
+      closeconn(c);
+      return;
+    }
+    if (c->got < sizeof(c->hdr)) {
+      c->got += k;
+      if (c->got < sizeof(c->hdr)) {
+	continue;
+      }
+      /* The length of the body is known: anything too large ends the
+	 connection, as the rest of the stream can no longer be parsed */
+      c->need = 0;
+      if ((c->hdr.op == C25519D_DH) || (c->hdr.op == C25519D_BASE)) {
+	if (c->hdr.n > C25519D_MAXKEYS) {
+	  status(c, c->hdr.op, c->hdr.id, -E2BIG);
+	  flush(c);
+	  closeconn(c);
+	  return;
+	}
+	c->need = (size_t)c->hdr.n * ((c->hdr.op == C25519D_DH) ? 64 : 32);
+      }
+      c->have = 0;
+      if (c->need) {
+	free(c->body);
+	if (!(c->body = malloc(c->need))) {
+	  closeconn(c);
+	  return;
+	}
+	continue;
+      }
+    } else {
+      c->have += k;
+      if (c->have < c->need) {
+	continue;
+      }
+    }
+    c->got = 0;
+    if (handle(c) < 0) {
+      closeconn(c);
+      return;
+    }
+    if (c->closed) {
+      return;
+    }
+  }
+}
+
+static void
+acceptconn(int lfd) {
+  for (;;) {
+    int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    struct conn *c;
+    if (fd < 0) {
+      return;
+    }
+    c = calloc(1, sizeof(*c));
+    if (!c) {
+      close(fd);
+      continue;
+    }
+    c->w.kind = CONN;
+    c->fd = fd;
+    c->refs = 1;
+    connections++;
+    watch(fd, &c->w, EPOLLIN, EPOLL_CTL_ADD);
+  }
+}
+
+/* Queues the run of k ring slots idx, of the same operation, copying
+   their keys out of the shared memory */
+static int
+submit(struct ring *g, uint32_t op, uint32_t *idx, uint32_t k) {
+  struct req *q = newreq(g->conn, op, k, k * sizeof(uint32_t));
+  uint32_t i, mask = g->slots - 1;
+  if (!q) {
+    return -1;
+  }
+  q->slots = (uint32_t *)q->out;
+  for (i = 0; i < k; i++) {
+    curve25519dslot_t *t = g->r->slot + (idx[i] & mask);
+    q->slots[i] = idx[i];
+    curve25519key_from_bytes(q->f + i, t->f);
+    if (op == C25519D_DH) {
+      curve25519key_from_bytes(q->c + i, t->c);
+    }
+  }
+  requests++;
+  enqueue(q);
+  return 0;
+}
+
+/* Takes the READY slots from the last position on, going around the
+   ring at most once.  Each is marked BUSY as soon as it is taken, so
+   that it cannot be taken again before the client has reused it. */
+static void
+scanring(struct ring *g) {
+  uint64_t v;
+  uint32_t mask = g->slots - 1, k = 0, idx[64], op = 0, n, i;
+  if (read(g->bell, &v, sizeof(v)) < 0) {
+    /* Nothing new: still scan, it costs little */
+  }
+  for (n = 0; n < g->slots; n++) {
+    curve25519dslot_t *s = g->r->slot + (g->tail & mask);
+    uint32_t sop;
+    if (atomic_load_explicit(&s->state, memory_order_acquire) != C25519D_READY) {
+      break;
+    }
+    sop = s->op;
+    if ((sop != C25519D_DH) && (sop != C25519D_BASE)) {
+      memset(s->r, 0, sizeof(s->r));
+      atomic_store_explicit(&s->state, C25519D_DONE, memory_order_release);
+      g->tail++;
+      continue;
+    }
+    if (k && ((sop != op) || (k == sizeof(idx) / sizeof(*idx)))) {
+      if (submit(g, op, idx, k) < 0) {
+	break;
+      }
+      k = 0;
+    }
+    atomic_store_explicit(&s->state, C25519D_BUSY, memory_order_relaxed);
+    op = sop;
+    idx[k++] = g->tail++;
+  }
+  if (k && (submit(g, op, idx, k) < 0)) {
+    /* Given back, for the next scan */
+    for (i = 0; i < k; i++) {
+      atomic_store_explicit(&g->r->slot[idx[i] & mask].state, C25519D_READY, memory_order_relaxed);
+    }
+    g->tail -= k;
+  }
+  atomic_store_explicit(&g->r->tail, g->tail, memory_order_release);
+}
+
+static void
+finished(void) {
+  struct req *q, *n;
+  uint64_t v;
+  if (read(d.donefd, &v, sizeof(v)) < 0) {
+    /* Already drained */
+  }
+  pthread_mutex_lock(&d.lock);
+  q = d.done;
+  d.done = NULL;
+  pthread_mutex_unlock(&d.lock);
+  for (; q; q = n) {
+    n = q->qnext;
+    if (q->slots) {
+      release(q);
+    } else {
+      respond(q);
+    }
+  }
+}
+
+static int
+listenon(const char *path) {
+  struct sockaddr_un a;
+  struct stat st;
+  int fd;
+  if (strlen(path) >= sizeof(a.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    return -1;
+  }
+  memset(&a, 0, sizeof(a));
+  a.sun_family = AF_UNIX;
+  strcpy(a.sun_path, path);
+  /* A socket left by a previous run is replaced */
+  if ((stat(path, &st) == 0) && S_ISSOCK(st.st_mode)) {
+    unlink(path);
+  }
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if ((fd < 0) || (bind(fd, (struct sockaddr *)&a, sizeof(a)) < 0) || (listen(fd, 128) < 0)) {
+    perror(path);
+    return -1;
+  }
+  return fd;
+}
+
+static void
+usage(FILE *f, const char *p) {
+  fprintf(f,
+	  "Usage: %s [--socket PATH] [--threads N] [--batch N] [--deadline US] [--no-pin]\n"
+	  "       %s --metrics [--socket PATH]\n\n"
+	  "Serves curve25519() and curve25519_base() to local clients over the\n"
+	  "Unix domain socket PATH (default curve25519d.sock), accessible to its\n"
+	  "owner only, and over shared-memory rings (see curve25519d.h).\n"
+	  "Requests are computed together in batches of up to N keys (default\n"
+	  "64), each waiting at most US microseconds (default 100) for a batch\n"
+	  "to fill, by N worker threads (default one per available processor),\n"
+	  "each pinned to its own processor unless --no-pin is given.\n"
+	  "--metrics prints the metrics of the daemon listening at PATH.\n",
+	  p, p);
+}
+
+static unsigned int
+number(int argc, char **argv, int *i) {
+  char *e;
+  unsigned long v;
+  if (*i + 1 >= argc) {
+    usage(stderr, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  v = strtoul(argv[++*i], &e, 10);
+  if (*e || (v > 1000000000)) {
+    usage(stderr, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  return v;
+}
+
+int
+main(int argc, char **argv) {
+  const char *path = "curve25519d.sock";
+  unsigned int threads = 0, batch = 64, deadline = 100, i;
+  int pin = 1, query = 0, lfd, sfd, a;
+  struct watch wl = { LISTEN }, ws = { SIGNALS }, wd = { DONE };
+  pthread_condattr_t ca;
+  cpu_set_t cpus;
+  sigset_t sigs;
+  int *cpu = NULL, ncpu = 0;
+
+  for (a = 1; a < argc; a++) {
+    if (strcmp(argv[a], "--socket") == 0) {
+      if (a + 1 >= argc) {
+	usage(stderr, argv[0]);
+	exit(EXIT_FAILURE);
+      }
+      path = argv[++a];
+    } else if (strcmp(argv[a], "--threads") == 0) {
+      threads = number(argc, argv, &a);
+    } else if (strcmp(argv[a], "--batch") == 0) {
+      batch = number(argc, argv, &a);
+    } else if (strcmp(argv[a], "--deadline") == 0) {
+      deadline = number(argc, argv, &a);
+    } else if (strcmp(argv[a], "--no-pin") == 0) {
+      pin = 0;
+    } else if (strcmp(argv[a], "--metrics") == 0) {
+      query = 1;
+    } else {
+      usage((strcmp(argv[a], "--help") == 0) ? stdout : stderr, argv[0]);
+      exit((strcmp(argv[a], "--help") == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+  if (batch == 0) {
+    usage(stderr, argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  if (query) {
+    curve25519d_t *c = curve25519d_connect(path);
+    char *s = c ? curve25519d_metrics(c) : NULL;
+    if (!s) {
+      perror(path);
+      exit(EXIT_FAILURE);
+    }
+    fputs(s, stdout);
+    free(s);
+    curve25519d_close(c);
+    exit(EXIT_SUCCESS);
+  }
+
+  /* The processors this process may run on, one per worker in turn */
+  if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+    cpu = malloc(CPU_SETSIZE * sizeof(int));
+    for (i = 0; cpu && (i < CPU_SETSIZE); i++) {
+      if (CPU_ISSET(i, &cpus)) {
+	cpu[ncpu++] = i;
+      }
+    }
+  }
+  if (threads == 0) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = (ncpu > 0) ? ncpu : ((n > 0) ? n : 1);
+  }
+
+  /* Signals are only taken by the event loop, through a signalfd */
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  umask(077);
+  if ((lfd = listenon(path)) < 0) {
+    exit(EXIT_FAILURE);
+  }
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  sfd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+  d.donefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if ((epfd < 0) || (sfd < 0) || (d.donefd < 0)) {
+    perror("curve25519d");
+    exit(EXIT_FAILURE);
+  }
+  watch(lfd, &wl, EPOLLIN, EPOLL_CTL_ADD);
+  watch(sfd, &ws, EPOLLIN, EPOLL_CTL_ADD);
+  watch(d.donefd, &wd, EPOLLIN, EPOLL_CTL_ADD);
+
+  pthread_mutex_init(&d.lock, NULL);
+  pthread_condattr_init(&ca);
+  pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+  pthread_cond_init(&d.work, &ca);
+  d.batch = batch;
+  d.deadline = (uint64_t)deadline * 1000;
+  d.nthreads = threads;
+  d.workers = calloc(threads, sizeof(*d.workers));
+  if (!d.workers) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < threads; i++) {
+    struct worker *w = d.workers + i;
+    w->id = i;
+    w->cpu = (pin && (ncpu > 0)) ? cpu[i % ncpu] : -1;
+    if (pthread_create(&w->thread, NULL, work, w) != 0) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  free(cpu);
+
+  for (;;) {
+    struct epoll_event e[64];
+    int n = epoll_wait(epfd, e, 64, -1), k;
+    if ((n < 0) && (errno != EINTR)) {
+      perror("epoll_wait");
+      break;
+    }
+    for (k = 0; k < n; k++) {
+      struct watch *w = e[k].data.ptr;
+      switch (w->kind) {
+      case LISTEN:
+	acceptconn(lfd);
+	break;
+
+      case SIGNALS:
+	goto stop;
+
+      case DONE:
+	finished();
+	break;
+
+      case BELL:
+	if (!((struct ring *)w)->conn->closed) {
+	  scanring((struct ring *)w);
+	}
+	break;
+
+      case CONN:
+	if (e[k].events & EPOLLOUT) {
+	  flush((struct conn *)w);
+	}
+	if ((e[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !((struct conn *)w)->closed) {
+	  readconn((struct conn *)w);
+	}
+	break;
+      }
+    }
+    bury();
+  }
+
+ stop:
+  unlink(path);
+  pthread_mutex_lock(&d.lock);
+  d.stop = 1;
+  pthread_cond_broadcast(&d.work);
+  pthread_mutex_unlock(&d.lock);
+  for (i = 0; i < threads; i++) {
+    pthread_join(d.workers[i].thread, NULL);
+  }
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,102 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CURVE25519LIB_D_H__
+#define __CURVE25519LIB_D_H__
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "curve25519.h"
+
+/* The protocol of curve25519d, the local scalar multiplication daemon,
+ * and a client for it.
+ *
+ * Over the Unix domain socket, every message starts with a
+ * curve25519dmsg_t header, in host byte order.  A C25519D_DH request is
+ * followed by n pairs of 32-byte little-endian keys (private, then
+ * public), a C25519D_BASE request by n private keys; the response, with
+ * the same op and id, carries the n results.  Requests may be pipelined
+ * on a connection, and their responses may come back in another order.
+ * C25519D_METRICS returns n bytes of text, one "name value" per line.
+ *
+ * C25519D_RING asks for a shared-memory ring of n slots (a power of
+ * two).  The response comes with three file descriptors: the memory
+ * holding a curve25519dring_t, an eventfd the client writes to after
+ * filling slots, and one the daemon writes to after completing some.
+ * Keys then go through the ring without any copy through the socket.
+ * A slot belongs to the client while FREE: it fills it and sets it to
+ * READY; the daemon takes READY slots in order, from the position after
+ * the last one it took, and sets them to DONE with the result.  The
+ * client sets them back to FREE once it has read them.
+ */
+
+#define C25519D_DH	1
+#define C25519D_BASE	2
+#define C25519D_METRICS	3
+#define C25519D_RING	4
+
+/* Keys accepted in a single request */
+#define C25519D_MAXKEYS 65536
+
+typedef struct {
+  uint32_t op;
+  uint32_t n;
+  uint64_t id;		/* chosen by the client, echoed back */
+  int32_t status;	/* in responses: 0, or a negated errno value */
+  uint32_t reserved;
+} curve25519dmsg_t;
+
+#define C25519D_FREE	0
+#define C25519D_READY	1
+#define C25519D_BUSY	2
+#define C25519D_DONE	3
+
+typedef struct {
+  unsigned char f[32], c[32], r[32];
+  uint32_t op;		/* C25519D_DH or C25519D_BASE */
+  _Atomic uint32_t state;
+  uint64_t tag;		/* for the client */
+  unsigned char reserved[16];
+} curve25519dslot_t;
+
+typedef struct {
+  uint32_t magic, slots;
+  _Alignas(64) _Atomic uint32_t head;	/* next slot the client fills */
+  _Alignas(64) _Atomic uint32_t tail;	/* next slot the daemon looks at */
+  _Alignas(64) curve25519dslot_t slot[];
+} curve25519dring_t;
+
+#define C25519D_MAGIC 0x32353564	/* "d552" */
+
+typedef struct curve25519d curve25519d_t;
+
+/* Connects to the daemon listening at path; NULL on failure, with errno
+ * set */
+extern curve25519d_t *curve25519d_connect(const char *path);
+/* Closes the connection, and unmaps the ring if there is one */
+extern void curve25519d_close(curve25519d_t *d);
+
+/* r[i] = curve25519(f[i], c[i]), or curve25519_base(f[i]) if c is NULL,
+ * for i < n, through the socket.  Returns 0, or -1 with errno set. */
+extern int curve25519d_compute(curve25519d_t *d, curve25519key_t *r, curve25519key_t *f, curve25519key_t *c, unsigned int n);
+/* The same through a ring of the given number of slots, set up on the
+ * first call; the keys are copied into the slots, which are all
+ * submitted with a single write to the eventfd. */
+extern int curve25519d_compute_ring(curve25519d_t *d, curve25519key_t *r, curve25519key_t *f, curve25519key_t *c, unsigned int n, unsigned int slots);
+/* The text of the metrics, NUL-terminated, to be released with free() */
+extern char *curve25519d_metrics(curve25519d_t *d);
+
+#endif /* __CURVE25519LIB_D_H__ */
@@ -0,0 +1,348 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include "curve25519d.h"
+
+struct curve25519d {
+  int fd;
+  uint64_t id;
+  curve25519dring_t *ring;
+  size_t size;
+  int bell, done;
+};
+
+static int
+sendall(int fd, const void *p, size_t n) {
+  while (n) {
+    ssize_t k = send(fd, p, n, MSG_NOSIGNAL);
+    if (k < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      return -1;
+    }
+    p = (const char *)p + k;
+    n -= k;
+  }
+  return 0;
+}
+
+static int
+recvall(int fd, void *p, size_t n) {
+  while (n) {
+    ssize_t k = recv(fd, p, n, 0);
+    if (k <= 0) {
+      if ((k < 0) && (errno == EINTR)) {
+	continue;
+      }
+      if (k == 0) {
+	errno = ECONNRESET;
+      }
+      return -1;
+    }
+    p = (char *)p + k;
+    n -= k;
+  }
+  return 0;
+}
+
+/* Sends a request and reads the header of its response, which the
+   requests of this client always get in order, one at a time */
+static int
+request(curve25519d_t *d, curve25519dmsg_t *m, const void *body, size_t len) {
+  uint64_t id = m->id = ++d->id;
+  uint32_t op = m->op;
+  if ((sendall(d->fd, m, sizeof(*m)) < 0) || (len && (sendall(d->fd, body, len) < 0)) ||
+      (recvall(d->fd, m, sizeof(*m)) < 0)) {
+    return -1;
+  }
+  if ((m->id != id) || (m->op != op)) {
+    errno = EPROTO;
+    return -1;
+  }
+  if (m->status) {
+    errno = -m->status;
+    return -1;
+  }
+  return 0;
+}
+
+curve25519d_t *
+curve25519d_connect(const char *path) {
+  struct sockaddr_un a;
+  curve25519d_t *d;
+  if (strlen(path) >= sizeof(a.sun_path)) {
+    errno = ENAMETOOLONG;
+    return NULL;
+  }
+  if (!(d = calloc(1, sizeof(*d)))) {
+    return NULL;
+  }
+  memset(&a, 0, sizeof(a));
+  a.sun_family = AF_UNIX;
+  strcpy(a.sun_path, path);
+  d->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if ((d->fd < 0) || (connect(d->fd, (struct sockaddr *)&a, sizeof(a)) < 0)) {
+    int e = errno;
+    if (d->fd >= 0) {
+      close(d->fd);
+    }
+    free(d);
+    errno = e;
+    return NULL;
+  }
+  d->bell = d->done = -1;
+  return d;
+}
+
+void
+curve25519d_close(curve25519d_t *d) {
+  if (d->ring) {
+    munmap(d->ring, d->size);
+    close(d->bell);
+    close(d->done);
+  }
+  close(d->fd);
+  free(d);
+}
+
+int
+curve25519d_compute(curve25519d_t *d, curve25519key_t *r, curve25519key_t *f, curve25519key_t *c, unsigned int n) {
+  while (n) {
+    unsigned int k = (n < C25519D_MAXKEYS) ? n : C25519D_MAXKEYS, i;
+    size_t len = (size_t)k * (c ? 64 : 32);
+    unsigned char *b = malloc(len);
+    curve25519dmsg_t m;
+    if (!b) {
+      return -1;
+    }
+    if (c) {
+      for (i = 0; i < k; i++) {
+	curve25519key_to_bytes(b + 64 * i, f + i);
+	curve25519key_to_bytes(b + 64 * i + 32, c + i);
+      }
+    } else {
+      curve25519key_to_bytes_n(b, f, k);
+    }
+    memset(&m, 0, sizeof(m));
+    m.op = c ? C25519D_DH : C25519D_BASE;
+    m.n = k;
+    if ((request(d, &m, b, len) < 0) || ((m.n != k) && (errno = EPROTO)) ||
+	(recvall(d->fd, b, (size_t)k * 32) < 0)) {
+      free(b);
+      return -1;
+    }
+    curve25519key_from_bytes_n(r, b, k);
+    free(b);
+    r += k;
+    f += k;
+    if (c) {
+      c += k;
+    }
+    n -= k;
+  }
+  return 0;
+}
+
+char *
+curve25519d_metrics(curve25519d_t *d) {
+  curve25519dmsg_t m;
+  char *s;
+  memset(&m, 0, sizeof(m));
+  m.op = C25519D_METRICS;
+  if (request(d, &m, NULL, 0) < 0) {
+    return NULL;
+  }
+  if (!(s = malloc(m.n + 1))) {
+    return NULL;
+  }
+  if (recvall(d->fd, s, m.n) < 0) {
+    free(s);
+    return NULL;
+  }
+  s[m.n] = 0;
+  return s;
+}
+
+/* Asks for a ring and maps it */
+static int
+ring(curve25519d_t *d, unsigned int slots) {
+  curve25519dmsg_t m;
+  struct msghdr h;
+  struct iovec v;
+  union {
+    char b[CMSG_SPACE(3 * sizeof(int))];
+    struct cmsghdr align;
+  } u;
+  struct cmsghdr *cm;
+  int fds[3];
+  size_t got = 0;
+  curve25519dring_t *p;
+  memset(&m, 0, sizeof(m));
+  m.op = C25519D_RING;
+  m.n = slots;
+  m.id = ++d->id;
+  if (sendall(d->fd, &m, sizeof(m)) < 0) {
+    return -1;
+  }
+  /* The descriptors come with the first byte of the response */
+  memset(&h, 0, sizeof(h));
+  v.iov_base = &m;
+  v.iov_len = sizeof(m);
+  h.msg_iov = &v;
+  h.msg_iovlen = 1;
+  h.msg_control = u.b;
+  h.msg_controllen = sizeof(u.b);
+  for (;;) {
+    ssize_t k = recvmsg(d->fd, &h, MSG_CMSG_CLOEXEC);
+    if (k < 0 && errno == EINTR) {
+      continue;
+    }
+    if (k <= 0) {
+      if (k == 0) {
+	errno = ECONNRESET;
+      }
+      return -1;
+    }
+    got = k;
+    break;
+  }
+  fds[0] = fds[1] = fds[2] = -1;
+  for (cm = CMSG_FIRSTHDR(&h); cm; cm = CMSG_NXTHDR(&h, cm)) {
+    if ((cm->cmsg_level == SOL_SOCKET) && (cm->cmsg_type == SCM_RIGHTS) &&
+	(cm->cmsg_len == CMSG_LEN(sizeof(fds)))) {
+      memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+    }
+  }
+  if ((got < sizeof(m)) && (recvall(d->fd, (char *)&m + got, sizeof(m) - got) < 0)) {
+    goto fail;
+  }
+  if (m.status) {
+    errno = -m.status;
+    goto fail;
+  }
+  if ((m.op != C25519D_RING) || (m.n != slots) || (fds[0] < 0)) {
+    errno = EPROTO;
+    goto fail;
+  }
+  d->size = offsetof(curve25519dring_t, slot) + slots * sizeof(curve25519dslot_t);
+  p = mmap(NULL, d->size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+  if (p == MAP_FAILED) {
+    goto fail;
+  }
+  close(fds[0]);
+  fds[0] = -1;
+  if ((p->magic != C25519D_MAGIC) || (p->slots != slots)) {
+    munmap(p, d->size);
+    errno = EPROTO;
+    goto fail;
+  }
+  d->ring = p;
+  d->bell = fds[1];
+  d->done = fds[2];
+  return 0;
+
+ fail:
+  {
+    int e = errno, i;
+    for (i = 0; i < 3; i++) {
+      if (fds[i] >= 0) {
+	close(fds[i]);
+      }
+    }
+    errno = e;
+  }
+  return -1;
+}
+
+int
+curve25519d_compute_ring(curve25519d_t *d, curve25519key_t *r, curve25519key_t *f, curve25519key_t *c, unsigned int n, unsigned int slots) {
+  uint32_t mask, head;
+  if (!d->ring && (ring(d, slots) < 0)) {
+    return -1;
+  }
+  if (d->ring->slots != slots) {
+    errno = EINVAL;
+    return -1;
+  }
+  mask = slots - 1;
+  head = atomic_load_explicit(&d->ring->head, memory_order_relaxed);
+  while (n) {
+    unsigned int k = (n < slots) ? n : slots, i;
+    uint64_t one = 1;
+    /* The slots from head on are FREE: the previous calls have read
+       all theirs */
+    for (i = 0; i < k; i++) {
+      curve25519dslot_t *s = d->ring->slot + ((head + i) & mask);
+      curve25519key_to_bytes(s->f, f + i);
+      if (c) {
+	curve25519key_to_bytes(s->c, c + i);
+      }
+      s->op = c ? C25519D_DH : C25519D_BASE;
+      atomic_store_explicit(&s->state, C25519D_READY, memory_order_release);
+    }
+    atomic_store_explicit(&d->ring->head, head + k, memory_order_relaxed);
+    if (write(d->bell, &one, sizeof(one)) < 0) {
+      return -1;
+    }
+    /* Batches may complete out of order: wait for each slot in turn */
+    for (i = 0; i < k; i++) {
+      curve25519dslot_t *s = d->ring->slot + ((head + i) & mask);
+      unsigned int spin;
+      for (spin = 0; atomic_load_explicit(&s->state, memory_order_acquire) != C25519D_DONE; spin++) {
+	if (spin >= 1000) {
+	  struct pollfd p[2];
+	  uint64_t v;
+	  p[0].fd = d->done;
+	  p[0].events = POLLIN;
+	  p[1].fd = d->fd;
+	  p[1].events = 0;
+	  if ((poll(p, 2, 100) < 0) && (errno != EINTR)) {
+	    return -1;
+	  }
+	  if (p[1].revents & (POLLHUP | POLLERR)) {
+	    errno = ECONNRESET;
+	    return -1;
+	  }
+	  if (read(d->done, &v, sizeof(v)) < 0) {
+	    /* Nothing yet */
+	  }
+	  spin = 0;
+	}
+      }
+      curve25519key_from_bytes(r + i, s->r);
+      atomic_store_explicit(&s->state, C25519D_FREE, memory_order_relaxed);
+    }
+    head += k;
+    r += k;
+    f += k;
+    if (c) {
+      c += k;
+    }
+    n -= k;
+  }
+  return 0;
+}
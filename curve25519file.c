@@ -0,0 +1,218 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Processing of binary key files through memory mappings.
+ *
+ * On little-endian hosts a 32-byte little-endian key has the same layout
+ * as a curve25519key_t, so the records are used where they are mapped:
+ * the keys are read from the input mapping and the results computed into
+ * the output mapping with the strided batch functions.  The files are
+ * mapped one window at a time, and the next window is mapped and queued
+ * while the workers are still on the current one.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "curve25519.h"
+#include "curve25519pool.h"
+#include "curve25519file.h"
+
+/* Bytes of records mapped at once from each file; make check also
+   builds with a few KiB, so that its files span several windows */
+#ifndef C25519FILEWINDOW
+#define C25519FILEWINDOW (1 << 26)
+#endif
+
+static const unsigned char magic[8] = "C25519KF";
+
+static void
+put(unsigned char *b, uint64_t v, unsigned int n) {
+  unsigned int i;
+  for (i = 0; i < n; i++) {
+    b[i] = v >> (8 * i);
+  }
+}
+
+static uint64_t
+get(const unsigned char *b, unsigned int n) {
+  uint64_t v = 0;
+  while (n-- > 0) {
+    v = (v << 8) | b[n];
+  }
+  return v;
+}
+
+extern unsigned int
+curve25519file_header(unsigned char h[C25519FILEHEADER], unsigned int keys, unsigned long long count, int flags) {
+  unsigned int s = 32 * keys;
+  if ((keys < 1) || (keys > 2)) {
+    return 0;
+  }
+  if (flags & C25519FILE_ALIGN) {
+    s = 64;
+  }
+  memset(h, 0, C25519FILEHEADER);
+  memcpy(h, magic, sizeof(magic));
+  put(h + 8, 1, 4);
+  put(h + 12, keys, 4);
+  put(h + 16, s, 4);
+  put(h + 32, count, 8);
+  return s;
+}
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+
+struct window {
+  void *in, *out;		/* the mappings */
+  size_t inlen, outlen;
+  curve25519job_t *job;
+};
+
+/* Maps len bytes at off, which need not be page aligned; returns a
+ * pointer to the byte at off, or NULL */
+static unsigned char *
+map(int fd, off_t off, size_t len, int prot, int flags, void **m, size_t *mlen) {
+  off_t a = off - off % sysconf(_SC_PAGESIZE);
+  void *p;
+  *mlen = len + (off - a);
+  p = mmap(NULL, *mlen, prot, MAP_SHARED, fd, a);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+  madvise(p, *mlen, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  if (flags & C25519FILE_HUGEPAGES) {
+    madvise(p, *mlen, MADV_HUGEPAGE);
+  }
+#endif
+  *m = p;
+  return (unsigned char *)p + (off - a);
+}
+
+static void
+unmap(struct window *w) {
+  if (w->job) {
+    curve25519job_wait(w->job);
+    w->job = NULL;
+  }
+  if (w->in) {
+    munmap(w->in, w->inlen);
+    w->in = NULL;
+  }
+  if (w->out) {
+    munmap(w->out, w->outlen);
+    w->out = NULL;
+  }
+}
+
+extern long long
+curve25519file_process(const char *in, const char *out, curve25519pool_t *p, int flags) {
+  unsigned char h[C25519FILEHEADER];
+  struct window w[2];
+  struct stat st;
+  ssize_t got;
+  unsigned int keys, is, os, n, c = 0;
+  unsigned long long count = 0, i;
+  int fi, fo = -1, e = 0;
+  memset(w, 0, sizeof(w));
+  fi = open(in, O_RDONLY);
+  if (fi < 0) {
+    return -1;
+  }
+  if ((fstat(fi, &st) < 0) || ((got = pread(fi, h, sizeof(h), 0)) < 0)) {
+    e = errno;
+    goto done;
+  }
+  keys = get(h + 12, 4);
+  is = get(h + 16, 4);
+  count = get(h + 32, 8);
+  if ((got != sizeof(h)) || memcmp(h, magic, sizeof(magic)) || (get(h + 8, 4) != 1) ||
+      (keys < 1) || (keys > 2) || ((is != 32 * keys) && (is != 64)) ||
+      (count > (st.st_size - C25519FILEHEADER) / is)) {
+    e = EINVAL;
+    goto done;
+  }
+  os = curve25519file_header(h, 1, count, flags);
+  fo = open(out, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if ((fo < 0) || (pwrite(fo, h, sizeof(h), 0) != sizeof(h)) ||
+      (ftruncate(fo, C25519FILEHEADER + count * os) < 0)) {
+    e = errno;
+    goto done;
+  }
+  posix_fadvise(fi, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  n = C25519FILEWINDOW / ((is > os) ? is : os);
+  for (i = 0; i < count; i += n) {
+    struct window *v = w + c;
+    unsigned int m = (count - i < n) ? count - i : n;
+    unsigned char *f, *r;
+    f = map(fi, C25519FILEHEADER + i * is, (size_t)m * is, PROT_READ, flags, &v->in, &v->inlen);
+    r = map(fo, C25519FILEHEADER + i * os, (size_t)m * os, PROT_READ | PROT_WRITE, flags, &v->out, &v->outlen);
+    if (!f || !r) {
+      e = errno;
+      break;
+    }
+    if (i + m < count) {
+      posix_fadvise(fi, C25519FILEHEADER + (i + m) * is, (off_t)n * is, POSIX_FADV_WILLNEED);
+    }
+    if (p) {
+      v->job = curve25519pool_submit_stride(p, (curve25519key_t *)r, os / 32, (curve25519key_t *)f, is / 32, (keys == 2) ? (curve25519key_t *)f + 1 : NULL, is / 32, m, NULL, NULL);
+      if (!v->job) {
+	e = ENOMEM;
+	break;
+      }
+    } else if (keys == 2) {
+      curve25519_batch_stride((curve25519key_t *)r, os / 32, (curve25519key_t *)f, is / 32, (curve25519key_t *)f + 1, is / 32, m);
+    } else {
+      unsigned int k;
+      for (k = 0; k < m; k++) {
+	curve25519_base((curve25519key_t *)(r + k * os), (curve25519key_t *)(f + k * is));
+      }
+    }
+    /* The window before this one is done once its job is */
+    c ^= 1;
+    unmap(w + c);
+  }
+
+ done:
+  unmap(w);
+  unmap(w + 1);
+  if ((fo >= 0) && (close(fo) < 0) && !e) {
+    e = errno;
+  }
+  close(fi);
+  if (e) {
+    errno = e;
+    return -1;
+  }
+  return count;
+}
+
+#else
+
+extern long long
+curve25519file_process(const char *in, const char *out, curve25519pool_t *p, int flags) {
+  /* Records can only be used in place on little-endian hosts */
+  errno = ENOTSUP;
+  return -1;
+}
+
+#endif
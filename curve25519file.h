@@ -0,0 +1,57 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CURVE25519LIB_FILE_H__
+#define __CURVE25519LIB_FILE_H__
+
+#include "curve25519.h"
+#include "curve25519pool.h"
+
+/* Binary key files.
+ *
+ * A 64-byte header, all fields little-endian:
+ *   0  "C25519KF"
+ *   8  version (32 bits, currently 1)
+ *  12  keys per record (32 bits): 1 for private keys, 2 for a private
+ *      key followed by a public key
+ *  16  record size in bytes (32 bits): 32 * keys, or 64 when aligned
+ *  20  reserved, zero (12 bytes)
+ *  32  number of records (64 bits)
+ *  40  reserved, zero (24 bytes)
+ * followed by the records, each holding its keys as 32 little-endian
+ * bytes; padding in aligned records is zero.
+ */
+
+#define C25519FILEHEADER 64
+
+/* Pad records to 64 bytes, so that none of them crosses a cache line */
+#define C25519FILE_ALIGN 1
+/* Ask for transparent huge pages on the mappings */
+#define C25519FILE_HUGEPAGES 2
+
+/* Fills in the header of a file of count records of the given number of
+ * keys; returns the record size, or 0 if keys is not 1 or 2. */
+extern unsigned int curve25519file_header(unsigned char h[C25519FILEHEADER], unsigned int keys, unsigned long long count, int flags);
+
+/* Reads the key file in, and writes to out a file of one-key records
+ * holding curve25519_base() of each private key, or curve25519() of each
+ * pair.  Both files are mapped in windows, so they can be larger than
+ * memory, and the results are computed directly into the mapping of out.
+ * If p is not NULL, its workers do the computation.  Returns the number
+ * of records, or -1 with errno set. */
+extern long long curve25519file_process(const char *in, const char *out, curve25519pool_t *p, int flags);
+
+#endif /* __CURVE25519LIB_FILE_H__ */
@@ -0,0 +1,279 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The ring is a bounded multi-producer multi-consumer queue: each slot
+ * has a sequence number telling whether it is ready to be written or
+ * read for a given lap, and producers and consumers claim slots by
+ * compare-and-swap on their own position counters.  A keypair is thus
+ * taken by a single consumer, which wipes the slot before handing it
+ * back to the producers.
+ *
+ * The refilling threads sleep on a condition variable while the pool
+ * is above its low watermark; the consumer that takes it below wakes
+ * them up, and they go back to sleep once the high one is reached.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include "curve25519.h"
+#include "curve25519keypool.h"
+
+/* Keypairs generated by a thread between two checks of the level;
+   their private keys take 256 bytes, which getrandom() never splits */
+#define BATCH 8
+
+struct slot {
+  atomic_size_t seq;
+  curve25519key_t priv, pub;
+};
+
+struct curve25519keypool {
+  struct slot *ring;
+  size_t mask;
+  _Alignas(64) atomic_size_t head;	/* next slot to read */
+  _Alignas(64) atomic_size_t tail;	/* next slot to write */
+  _Alignas(64) atomic_uint level;
+  atomic_int filling;
+  unsigned int low, high;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  int stop;
+  unsigned int nthreads;
+  pthread_t thread[];
+};
+
+static void
+wipe(void *p, size_t n) {
+  volatile unsigned char *v = p;
+  while (n--) {
+    *v++ = 0;
+  }
+}
+
+static int
+randomkeys(curve25519key_t *k, unsigned int n) {
+  unsigned char b[BATCH * 32];
+  unsigned int i;
+  ssize_t r;
+  do {
+    r = getrandom(b, n * 32, 0);
+  } while ((r < 0) && (errno == EINTR));
+  if (r != (ssize_t)(n * 32)) {
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    b[i * 32] &= 248;
+    b[i * 32 + 31] &= 127;
+    b[i * 32 + 31] |= 64;
+  }
+  curve25519key_from_bytes_n(k, b, n);
+  wipe(b, sizeof(b));
+  return 0;
+}
+
+extern int
+curve25519_keypair(curve25519key_t *priv, curve25519key_t *pub) {
+  if (randomkeys(priv, 1) < 0) {
+    return -1;
+  }
+  curve25519_base(pub, priv);
+  return 0;
+}
+
+static int
+put(curve25519keypool_t *p, curve25519key_t *priv, curve25519key_t *pub) {
+  size_t t = atomic_load_explicit(&p->tail, memory_order_relaxed);
+  struct slot *s;
+  for (;;) {
+    intptr_t d;
+    s = p->ring + (t & p->mask);
+    d = (intptr_t)atomic_load_explicit(&s->seq, memory_order_acquire) - (intptr_t)t;
+    if (d == 0) {
+      if (atomic_compare_exchange_weak_explicit(&p->tail, &t, t + 1, memory_order_relaxed, memory_order_relaxed)) {
+	/* Counted before it can be taken, so the level never wraps */
+	atomic_fetch_add(&p->level, 1);
+	break;
+      }
+    } else if (d < 0) {
+      return -1;		/* full */
+    } else {
+      t = atomic_load_explicit(&p->tail, memory_order_relaxed);
+    }
+  }
+  memcpy(s->priv, priv, sizeof(curve25519key_t));
+  memcpy(s->pub, pub, sizeof(curve25519key_t));
+  atomic_store_explicit(&s->seq, t + 1, memory_order_release);
+  return 0;
+}
+
+static int
+take(curve25519keypool_t *p, curve25519key_t *priv, curve25519key_t *pub) {
+  size_t h = atomic_load_explicit(&p->head, memory_order_relaxed);
+  struct slot *s;
+  for (;;) {
+    intptr_t d;
+    s = p->ring + (h & p->mask);
+    d = (intptr_t)atomic_load_explicit(&s->seq, memory_order_acquire) - (intptr_t)(h + 1);
+    if (d == 0) {
+      if (atomic_compare_exchange_weak_explicit(&p->head, &h, h + 1, memory_order_relaxed, memory_order_relaxed)) {
+	break;
+      }
+    } else if (d < 0) {
+      return -1;		/* empty */
+    } else {
+      h = atomic_load_explicit(&p->head, memory_order_relaxed);
+    }
+  }
+  memcpy(priv, s->priv, sizeof(curve25519key_t));
+  memcpy(pub, s->pub, sizeof(curve25519key_t));
+  wipe(s->priv, sizeof(curve25519key_t));
+  atomic_store_explicit(&s->seq, h + p->mask + 1, memory_order_release);
+  atomic_fetch_sub(&p->level, 1);
+  return 0;
+}
+
+/* Wakes the threads up if the pool is below its low watermark */
+static void
+check(curve25519keypool_t *p) {
+  if ((atomic_load(&p->level) < p->low) && !atomic_exchange(&p->filling, 1)) {
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+  }
+}
+
+static void *
+fill(void *a) {
+  curve25519keypool_t *p = a;
+  curve25519key_t priv[BATCH], pub[BATCH];
+  unsigned int i, n;
+  for (;;) {
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop && !atomic_load(&p->filling)) {
+      pthread_cond_wait(&p->wake, &p->lock);
+    }
+    if (p->stop) {
+      pthread_mutex_unlock(&p->lock);
+      break;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    n = p->high - atomic_load(&p->level);
+    if ((int)n <= 0) {
+      n = 0;
+    } else if (n > BATCH) {
+      n = BATCH;
+    }
+    if ((n > 0) && (randomkeys(priv, n) == 0)) {
+      for (i = 0; i < n; i++) {
+	curve25519_base(pub + i, priv + i);
+      }
+      for (i = 0; (i < n) && (put(p, priv + i, pub + i) == 0); i++) {
+      }
+      wipe(priv, sizeof(priv));
+    } else if (n > 0) {
+      /* No entropy yet: leave it to the consumers to retry */
+      atomic_store(&p->filling, 0);
+      continue;
+    }
+    if (atomic_load(&p->level) >= p->high) {
+      atomic_store(&p->filling, 0);
+      /* A consumer may have taken the level down meanwhile */
+      check(p);
+    }
+  }
+  return NULL;
+}
+
+extern curve25519keypool_t *
+curve25519keypool_new(unsigned int low, unsigned int high, unsigned int threads) {
+  curve25519keypool_t *p;
+  size_t n = 1, i;
+  if ((high == 0) || (low > high)) {
+    return NULL;
+  }
+  if (threads == 0) {
+    threads = 1;
+  }
+  while (n < high) {
+    n *= 2;
+  }
+  p = calloc(1, sizeof(*p) + threads * sizeof(pthread_t));
+  if (!p) {
+    return NULL;
+  }
+  p->ring = aligned_alloc(64, ((n * sizeof(struct slot) + 63) / 64) * 64);
+  if (!p->ring) {
+    free(p);
+    return NULL;
+  }
+  p->mask = n - 1;
+  for (i = 0; i < n; i++) {
+    atomic_init(&p->ring[i].seq, i);
+  }
+  atomic_init(&p->head, 0);
+  atomic_init(&p->tail, 0);
+  atomic_init(&p->level, 0);
+  atomic_init(&p->filling, 1);
+  p->low = low;
+  p->high = high;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->wake, NULL);
+  for (p->nthreads = 0; p->nthreads < threads; p->nthreads++) {
+    if (pthread_create(p->thread + p->nthreads, NULL, fill, p) != 0) {
+      curve25519keypool_free(p);
+      return NULL;
+    }
+  }
+  return p;
+}
+
+extern void
+curve25519keypool_free(curve25519keypool_t *p) {
+  unsigned int i;
+  pthread_mutex_lock(&p->lock);
+  p->stop = 1;
+  pthread_cond_broadcast(&p->wake);
+  pthread_mutex_unlock(&p->lock);
+  for (i = 0; i < p->nthreads; i++) {
+    pthread_join(p->thread[i], NULL);
+  }
+  wipe(p->ring, (p->mask + 1) * sizeof(struct slot));
+  free(p->ring);
+  pthread_cond_destroy(&p->wake);
+  pthread_mutex_destroy(&p->lock);
+  free(p);
+}
+
+extern int
+curve25519keypool_get(curve25519keypool_t *p, curve25519key_t *priv, curve25519key_t *pub) {
+  int r = take(p, priv, pub);
+  check(p);
+  if (r == 0) {
+    return 1;
+  }
+  return curve25519_keypair(priv, pub);
+}
+
+extern unsigned int
+curve25519keypool_level(curve25519keypool_t *p) {
+  return atomic_load(&p->level);
+}
@@ -0,0 +1,48 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CURVE25519LIB_KEYPOOL_H__
+#define __CURVE25519LIB_KEYPOOL_H__
+
+#include "curve25519.h"
+
+/* Ephemeral keypairs generated ahead of time.
+ *
+ * Background threads keep a ring of fresh keypairs: when fewer than low
+ * are left they start generating, and they stop once there are high.
+ * Taking a keypair does not lock, and each one is handed out exactly
+ * once and then wiped from the ring. */
+
+typedef struct curve25519keypool curve25519keypool_t;
+
+/* Starts threads (0 for one) filling a pool of up to high keypairs.
+ * Returns NULL if low > high, high is 0, or on failure. */
+extern curve25519keypool_t *curve25519keypool_new(unsigned int low, unsigned int high, unsigned int threads);
+/* Stops the threads and wipes the keypairs not handed out */
+extern void curve25519keypool_free(curve25519keypool_t *p);
+/* Takes a keypair; returns 1 if it came from the pool, 0 if the pool
+ * was empty and it was generated on the spot, -1 if no random numbers
+ * could be read */
+extern int curve25519keypool_get(curve25519keypool_t *p, curve25519key_t *priv, curve25519key_t *pub);
+/* Number of keypairs ready */
+extern unsigned int curve25519keypool_level(curve25519keypool_t *p);
+
+/* Generates a keypair from getrandom(); the private key is clamped as
+ * usual (low three bits and top bit clear, bit 254 set).  Returns 0, or
+ * -1 if no random numbers could be read. */
+extern int curve25519_keypair(curve25519key_t *priv, curve25519key_t *pub);
+
+#endif /* __CURVE25519LIB_KEYPOOL_H__ */
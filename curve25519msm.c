@@ -0,0 +1,335 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The sum is computed on the Edwards curve of ge25519.h.  Scalars are
+ * written with signed digits of c bits, in [-2^(c-1), 2^(c-1)], so that
+ * each window needs only half as many multiples.
+ *
+ * - Straus, for few points: each point gets a table of its multiples 1
+ *   to 8, and a single chain of doublings serves all of them, adding the
+ *   digit of every scalar after each 4 doublings.
+ *
+ * - Pippenger, for many points: for each window of c bits the points
+ *   are added into the bucket of their digit, the buckets are summed
+ *   with weights 1 to 2^(c-1) by running sums, and the windows combined
+ *   by c doublings each.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "curve25519.h"
+#include "curve25519msm.h"
+#include "ge25519.h"
+
+/* Below this number of points Straus is faster */
+#define STRAUS 64
+/* Digits of c bits go up to 2^(c-1), which has to fit in an int16_t */
+#define MAXWINDOW 15
+
+/* d = -121665/121666 and sqrt(-1) */
+static const unsigned int dwords[8] = { 0x135978a3, 0x75eb4dca, 0x4141d8ab, 0x00700a4d, 0x7779e898, 0x8cc74079, 0x2b6ffe73, 0x52036cee };
+static const unsigned int sqrtm1words[8] = { 0x4a0ea0b0, 0xc4ee1b27, 0xad2fe478, 0x2f431806, 0x3dfbd7a7, 0x2b4d0099, 0x4fc1df0b, 0x2b832480 };
+
+static void
+loadwords(fe25519 *a, const unsigned int *w) {
+  curve25519key_t k;
+  int i;
+  for (i = 0; i < 8; i++) {
+    curve25519key_setuint32(&k, i, w[i]);
+  }
+  loadmodp(a, &k);
+}
+
+static int
+equalmodp(fe25519 *a, fe25519 *b) {
+  curve25519key_t x, y;
+  int i, d = 0;
+  storemodp(&x, a);
+  storemodp(&y, b);
+  for (i = 0; i < C25519N; i++) {
+    d |= x[i] != y[i];
+  }
+  return !d;
+}
+
+/* a = a^(2^252 - 3) = a^((p - 5) / 8) */
+static void
+pow22523modp(fe25519 *a) {
+  fe25519 t0, t1, t2;
+  copymodp(&t0, a); sqrmodp(&t0);				/* 2 */
+  copymodp(&t1, &t0); sqrnmodp(&t1, 2); mulmodp(&t1, a);	/* 9 */
+  mulmodp(&t0, &t1);						/* 11 */
+  sqrmodp(&t0); mulmodp(&t0, &t1);				/* 2^5 - 1 */
+  copymodp(&t1, &t0); sqrnmodp(&t1, 5); mulmodp(&t0, &t1);	/* 2^10 - 1 */
+  copymodp(&t1, &t0); sqrnmodp(&t1, 10); mulmodp(&t1, &t0);	/* 2^20 - 1 */
+  copymodp(&t2, &t1); sqrnmodp(&t2, 20); mulmodp(&t1, &t2);	/* 2^40 - 1 */
+  sqrnmodp(&t1, 10); mulmodp(&t0, &t1);				/* 2^50 - 1 */
+  copymodp(&t1, &t0); sqrnmodp(&t1, 50); mulmodp(&t1, &t0);	/* 2^100 - 1 */
+  copymodp(&t2, &t1); sqrnmodp(&t2, 100); mulmodp(&t1, &t2);	/* 2^200 - 1 */
+  sqrnmodp(&t1, 50); mulmodp(&t0, &t1);				/* 2^250 - 1 */
+  sqrnmodp(&t0, 2); mulmodp(&t0, a);				/* 2^252 - 3 */
+  copymodp(a, &t0);
+}
+
+/* x = +-sqrt((y^2 - 1) / (d y^2 + 1)), with the sign of bit 255 */
+static int
+decode(ge25519_p3 *h, curve25519key_t *s, fe25519 *d) {
+  curve25519key_t k, kx;
+  fe25519 u, v, v3, t, one, sqrtm1;
+  unsigned int sign = curve25519key_getbit(s, C25519USEDBITS);
+  int i;
+  for (i = 0; i < C25519N; i++) {
+    k[i] = s[0][i];
+  }
+  curve25519key_setbit(&k, C25519USEDBITS, 0);
+  loadmodp(&h->Y, &k);
+  setmodp(&h->Z, 1);
+  setmodp(&one, 1);
+  copymodp(&u, &h->Y); sqrmodp(&u);
+  copymodp(&v, &u); mulmodp(&v, d); addmodp(&v, &one);	/* d y^2 + 1 */
+  submodp(&u, &one); carrymodp(&u);			/* y^2 - 1 */
+  /* x = u v^3 (u v^7)^((p - 5) / 8) */
+  copymodp(&v3, &v); sqrmodp(&v3); mulmodp(&v3, &v);
+  copymodp(&h->X, &v3); sqrmodp(&h->X); mulmodp(&h->X, &v); mulmodp(&h->X, &u);
+  pow22523modp(&h->X);
+  mulmodp(&h->X, &v3); mulmodp(&h->X, &u);
+  /* v x^2 is u, or -u if x must still be multiplied by sqrt(-1) */
+  copymodp(&t, &h->X); sqrmodp(&t); mulmodp(&t, &v);
+  if (!equalmodp(&t, &u)) {
+    setmodp(&v, 0); submodp(&v, &u);
+    if (!equalmodp(&t, &v)) {
+      return -1;
+    }
+    loadwords(&sqrtm1, sqrtm1words);
+    mulmodp(&h->X, &sqrtm1);
+  }
+  storemodp(&kx, &h->X);
+  if ((unsigned int)curve25519key_getbit(&kx, 0) != sign) {
+    setmodp(&t, 0); submodp(&t, &h->X); copymodp(&h->X, &t);
+  }
+  copymodp(&h->T, &h->X); mulmodp(&h->T, &h->Y);
+  return 0;
+}
+
+static void
+negcached(ge25519_cached *r, ge25519_cached *p) {
+  copymodp(&r->YplusX, &p->YminusX);
+  copymodp(&r->YminusX, &p->YplusX);
+  copymodp(&r->Z, &p->Z);
+  setmodp(&r->T2d, 0); submodp(&r->T2d, &p->T2d);
+}
+
+/* h = h + d q, where q[i] = (i + 1) p, or nothing for d = 0 */
+static void
+addmultiple(ge25519_p3 *h, ge25519_cached *q, int d) {
+  ge25519_p1p1 t;
+  if (d > 0) {
+    ge25519_add(&t, h, q + d - 1);
+  } else if (d < 0) {
+    ge25519_sub(&t, h, q - d - 1);
+  } else {
+    return;
+  }
+  ge25519_p1p1_to_p3(h, &t);
+}
+
+/* h = 2^n h */
+static void
+dbln(ge25519_p3 *h, int n) {
+  ge25519_p2 s;
+  ge25519_p1p1 t;
+  int i;
+  ge25519_p3_to_p2(&s, h);
+  for (i = 0; i < n; i++) {
+    ge25519_p2_dbl(&t, &s);
+    if (i + 1 < n) {
+      ge25519_p1p1_to_p2(&s, &t);
+    }
+  }
+  ge25519_p1p1_to_p3(h, &t);
+}
+
+/* Number of signed digits of c bits of a 256-bit scalar; the last one
+   takes the final carry */
+#define DIGITS(c) ((C25519BITS + (c) - 1) / (c) + 1)
+
+static void
+recode(int16_t *e, curve25519key_t *k, int c) {
+  int j, b, carry = 0, w = DIGITS(c);
+  for (j = 0; j < w; j++) {
+    int v = carry;
+    for (b = 0; b < c; b++) {
+      int n = j * c + b;
+      if (n < C25519BITS) {
+	v += curve25519key_getbit(k, n) << b;
+      }
+    }
+    carry = v > (1 << (c - 1));
+    e[j] = v - (carry << c);
+  }
+}
+
+static int
+straus(ge25519_p3 *h, curve25519key_t *k, ge25519_p3 *p, unsigned int n, fe25519 *d2) {
+  ge25519_cached *q = malloc((size_t)n * 8 * sizeof(ge25519_cached));
+  int16_t *e = malloc((size_t)n * DIGITS(4) * sizeof(int16_t));
+  ge25519_p1p1 t;
+  ge25519_p3 m;
+  unsigned int i;
+  int j, l;
+  if (!q || !e) {
+    free(q);
+    free(e);
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    ge25519_cached *qi = q + 8 * i;
+    recode(e + i * DIGITS(4), k + i, 4);
+    ge25519_p3_to_cached(qi, p + i, d2);
+    m = p[i];
+    for (l = 1; l < 8; l++) {
+      ge25519_add(&t, &m, qi);
+      ge25519_p1p1_to_p3(&m, &t);
+      ge25519_p3_to_cached(qi + l, &m, d2);
+    }
+  }
+  ge25519_p3_0(h);
+  for (j = DIGITS(4) - 1; j >= 0; j--) {
+    if (j < DIGITS(4) - 1) {
+      dbln(h, 4);
+    }
+    for (i = 0; i < n; i++) {
+      addmultiple(h, q + 8 * i, e[i * DIGITS(4) + j]);
+    }
+  }
+  free(q);
+  free(e);
+  return 0;
+}
+
+static int
+pippenger(ge25519_p3 *h, curve25519key_t *k, ge25519_p3 *p, unsigned int n, fe25519 *d2) {
+  int c = 5, w, nb, j, b;
+  unsigned int i;
+  ge25519_cached *q, nq, cs;
+  ge25519_p3 *bucket, sum, acc;
+  ge25519_p1p1 t;
+  unsigned char *used;
+  int16_t *e;
+  while ((c < MAXWINDOW) && ((1u << (c + 3)) <= n)) {
+    c++;
+  }
+  w = DIGITS(c);
+  nb = 1 << (c - 1);
+  q = malloc((size_t)n * sizeof(ge25519_cached));
+  e = malloc((size_t)n * w * sizeof(int16_t));
+  bucket = malloc((size_t)nb * sizeof(ge25519_p3));
+  used = malloc(nb);
+  if (!q || !e || !bucket || !used) {
+    free(q);
+    free(e);
+    free(bucket);
+    free(used);
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    recode(e + (size_t)i * w, k + i, c);
+    ge25519_p3_to_cached(q + i, p + i, d2);
+  }
+  ge25519_p3_0(h);
+  for (j = w - 1; j >= 0; j--) {
+    if (j < w - 1) {
+      dbln(h, c);
+    }
+    for (b = 0; b < nb; b++) {
+      used[b] = 0;
+    }
+    for (i = 0; i < n; i++) {
+      int v = e[(size_t)i * w + j];
+      ge25519_cached *a = q + i;
+      if (v == 0) {
+	continue;
+      }
+      if (v < 0) {
+	negcached(&nq, a);
+	a = &nq;
+	v = -v;
+      }
+      if (!used[v - 1]) {
+	ge25519_p3_0(bucket + v - 1);
+	used[v - 1] = 1;
+      }
+      ge25519_add(&t, bucket + v - 1, a);
+      ge25519_p1p1_to_p3(bucket + v - 1, &t);
+    }
+    /* acc = sum of (b + 1) bucket[b], as the sum of the running sums */
+    ge25519_p3_0(&sum);
+    ge25519_p3_0(&acc);
+    for (b = nb - 1; b >= 0; b--) {
+      if (used[b]) {
+	ge25519_p3_to_cached(&cs, bucket + b, d2);
+	ge25519_add(&t, &sum, &cs);
+	ge25519_p1p1_to_p3(&sum, &t);
+      }
+      ge25519_p3_to_cached(&cs, &sum, d2);
+      ge25519_add(&t, &acc, &cs);
+      ge25519_p1p1_to_p3(&acc, &t);
+    }
+    ge25519_p3_to_cached(&cs, &acc, d2);
+    ge25519_add(&t, h, &cs);
+    ge25519_p1p1_to_p3(h, &t);
+  }
+  free(q);
+  free(e);
+  free(bucket);
+  free(used);
+  return 0;
+}
+
+extern int
+curve25519_msm(curve25519key_t *r, curve25519key_t *k, curve25519key_t *p, unsigned int n) {
+  ge25519_p3 *a, h;
+  fe25519 d, d2;
+  unsigned int i;
+  int e;
+  ge25519_p3_0(&h);
+  if (n == 0) {
+    ge25519_to_montgomery(r, &h);
+    return 0;
+  }
+  a = malloc((size_t)n * sizeof(ge25519_p3));
+  if (!a) {
+    return -1;
+  }
+  loadwords(&d, dwords);
+  copymodp(&d2, &d); addmodp(&d2, &d);
+  for (i = 0; i < n; i++) {
+    if (decode(a + i, p + i, &d) < 0) {
+      free(a);
+      return -1;
+    }
+  }
+  if (n < STRAUS) {
+    e = straus(&h, k, a, n, &d2);
+  } else {
+    e = pippenger(&h, k, a, n, &d2);
+  }
+  free(a);
+  if (e == 0) {
+    ge25519_to_montgomery(r, &h);
+  }
+  return e;
+}
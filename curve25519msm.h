@@ -0,0 +1,35 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CURVE25519LIB_MSM_H__
+#define __CURVE25519LIB_MSM_H__
+
+#include "curve25519.h"
+
+/* Multi-scalar multiplication: r = u(k[0] P[0] + ... + k[n-1] P[n-1]),
+ * the Montgomery u-coordinate of the sum (0 for the neutral element).
+ *
+ * Since u alone does not tell P from -P, the points are given as
+ * Edwards points in the usual compressed form: y in bits 0 to 254 and
+ * the sign of x in bit 255.  The scalars are used in full, without
+ * clamping or reduction.  The computation takes time depending on the
+ * scalars, so it is meant for public data such as batch verification.
+ *
+ * Returns 0, or -1 if a point is not on the curve or no memory is
+ * available. */
+extern int curve25519_msm(curve25519key_t *r, curve25519key_t *k, curve25519key_t *p, unsigned int n);
+
+#endif /* __CURVE25519LIB_MSM_H__ */
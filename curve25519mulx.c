@@ -0,0 +1,295 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The product is computed by rows: the first one with a plain carry
+ * chain, the others adding the low halves of MULX with ADCX (carry
+ * flag) and the high halves with ADOX (overflow flag), so that the two
+ * chains run interleaved.  The eight limbs are in r8-r15; the upper four
+ * are then folded into the lower ones times 38 = 2^256 mod p by the same
+ * pattern, leaving a value below 2^256 that is reduced only when stored.
+ */
+
+#include "curve25519.h"
+#include "fe25519.h"
+#include "curve25519mulx.h"
+
+#ifdef C25519_MULX
+
+#include <cpuid.h>
+/* Adds 38 times the carry limb %r12 to r8-r11 and folds the final
+   carry as 38 again, leaving a 256-bit value as in fe25519.h */
+#define REDUCE \
+  "imulq $38, %%r12\n\t" \
+  "addq %%r12, %%r8\n\t" \
+  "adcq $0, %%r9\n\t" \
+  "adcq $0, %%r10\n\t" \
+  "adcq $0, %%r11\n\t" \
+  "sbbq %%rax, %%rax\n\t" \
+  "andq $38, %%rax\n\t" \
+  "addq %%rax, %%r8\n\t" \
+  "movq %%r8, 0(%0)\n\t" \
+  "movq %%r9, 8(%0)\n\t" \
+  "movq %%r10, 16(%0)\n\t" \
+  "movq %%r11, 24(%0)\n\t"
+
+/* Row i > 0 of the product: t[i..i+4] += a * b[i], with t[i+4] new */
+#define ROW(b, t0, t1, t2, t3, t4) \
+  "movq " b "(%1), %%rdx\n\t" \
+  "xorl %%eax, %%eax\n\t" \
+  "mulxq 0(%0), %%rbx, %%rcx\n\t" \
+  "adcxq %%rbx, " t0 "\n\t" \
+  "adoxq %%rcx, " t1 "\n\t" \
+  "mulxq 8(%0), %%rbx, %%rcx\n\t" \
+  "adcxq %%rbx, " t1 "\n\t" \
+  "adoxq %%rcx, " t2 "\n\t" \
+  "mulxq 16(%0), %%rbx, %%rcx\n\t" \
+  "adcxq %%rbx, " t2 "\n\t" \
+  "adoxq %%rcx, " t3 "\n\t" \
+  "mulxq 24(%0), %%rbx, " t4 "\n\t" \
+  "adcxq %%rbx, " t3 "\n\t" \
+  "adoxq %%rax, " t4 "\n\t" \
+  "adcxq %%rax, " t4 "\n\t"
+
+/* r8-r11 += 38 * r12-r15, with the carry limb in r12 */
+#define FOLD \
+  "movl $38, %%edx\n\t" \
+  "xorl %%eax, %%eax\n\t" \
+  "mulxq %%r12, %%rbx, %%rcx\n\t" \
+  "adcxq %%rbx, %%r8\n\t" \
+  "adoxq %%rcx, %%r9\n\t" \
+  "mulxq %%r13, %%rbx, %%rcx\n\t" \
+  "adcxq %%rbx, %%r9\n\t" \
+  "adoxq %%rcx, %%r10\n\t" \
+  "mulxq %%r14, %%rbx, %%rcx\n\t" \
+  "adcxq %%rbx, %%r10\n\t" \
+  "adoxq %%rcx, %%r11\n\t" \
+  "mulxq %%r15, %%rbx, %%r12\n\t" \
+  "adcxq %%rbx, %%r11\n\t" \
+  "adoxq %%rax, %%r12\n\t" \
+  "adcxq %%rax, %%r12\n\t"
+
+/* The square of a into r8-r15: the six cross products once, summed in
+   r9-r14 (they stay below 2^448), doubled, then the four squares */
+#define SQR \
+  "movq 0(%0), %%rdx\n\t" \
+  "mulxq 8(%0), %%r9, %%r10\n\t" \
+  "mulxq 16(%0), %%rax, %%r11\n\t" \
+  "addq %%rax, %%r10\n\t" \
+  "mulxq 24(%0), %%rax, %%r12\n\t" \
+  "adcq %%rax, %%r11\n\t" \
+  "adcq $0, %%r12\n\t" \
+  "movq 8(%0), %%rdx\n\t" \
+  "mulxq 16(%0), %%rax, %%rbx\n\t" \
+  "mulxq 24(%0), %%rcx, %%r13\n\t" \
+  "addq %%rax, %%r11\n\t" \
+  "adcq %%rcx, %%r12\n\t" \
+  "adcq $0, %%r13\n\t" \
+  "addq %%rbx, %%r12\n\t" \
+  "adcq $0, %%r13\n\t" \
+  "movq 16(%0), %%rdx\n\t" \
+  "mulxq 24(%0), %%rax, %%r14\n\t" \
+  "addq %%rax, %%r13\n\t" \
+  "adcq $0, %%r14\n\t" \
+  "xorl %%r15d, %%r15d\n\t" \
+  "addq %%r9, %%r9\n\t" \
+  "adcq %%r10, %%r10\n\t" \
+  "adcq %%r11, %%r11\n\t" \
+  "adcq %%r12, %%r12\n\t" \
+  "adcq %%r13, %%r13\n\t" \
+  "adcq %%r14, %%r14\n\t" \
+  "adcq $0, %%r15\n\t" \
+  "movq 0(%0), %%rdx\n\t" \
+  "mulxq %%rdx, %%r8, %%rax\n\t" \
+  "addq %%rax, %%r9\n\t" \
+  "movq 8(%0), %%rdx\n\t" \
+  "mulxq %%rdx, %%rax, %%rbx\n\t" \
+  "adcq %%rax, %%r10\n\t" \
+  "adcq %%rbx, %%r11\n\t" \
+  "movq 16(%0), %%rdx\n\t" \
+  "mulxq %%rdx, %%rax, %%rbx\n\t" \
+  "adcq %%rax, %%r12\n\t" \
+  "adcq %%rbx, %%r13\n\t" \
+  "movq 24(%0), %%rdx\n\t" \
+  "mulxq %%rdx, %%rax, %%rbx\n\t" \
+  "adcq %%rax, %%r14\n\t" \
+  "adcq %%rbx, %%r15\n\t"
+
+__attribute__((target("bmi2,adx"))) static void
+mulx(mp_limb_t *a, const mp_limb_t *b) {
+  __asm__ volatile (
+    /* Row 0 */
+    "movq 0(%1), %%rdx\n\t"
+    "mulxq 0(%0), %%r8, %%r9\n\t"
+    "mulxq 8(%0), %%rax, %%r10\n\t"
+    "addq %%rax, %%r9\n\t"
+    "mulxq 16(%0), %%rax, %%r11\n\t"
+    "adcq %%rax, %%r10\n\t"
+    "mulxq 24(%0), %%rax, %%r12\n\t"
+    "adcq %%rax, %%r11\n\t"
+    "adcq $0, %%r12\n\t"
+    ROW("8", "%%r9", "%%r10", "%%r11", "%%r12", "%%r13")
+    ROW("16", "%%r10", "%%r11", "%%r12", "%%r13", "%%r14")
+    ROW("24", "%%r11", "%%r12", "%%r13", "%%r14", "%%r15")
+    FOLD
+    REDUCE
+    :
+    : "r" (a), "r" (b)
+    : "rax", "rbx", "rcx", "rdx", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15", "cc", "memory");
+}
+
+__attribute__((target("bmi2,adx"))) static void
+mulxsmall(mp_limb_t *a) {
+  __asm__ volatile (
+    "movl $121665, %%edx\n\t"
+    "mulxq 0(%0), %%r8, %%r9\n\t"
+    "mulxq 8(%0), %%rax, %%r10\n\t"
+    "addq %%rax, %%r9\n\t"
+    "mulxq 16(%0), %%rax, %%r11\n\t"
+    "adcq %%rax, %%r10\n\t"
+    "mulxq 24(%0), %%rax, %%r12\n\t"
+    "adcq %%rax, %%r11\n\t"
+    "adcq $0, %%r12\n\t"
+    REDUCE
+    :
+    : "r" (a)
+    : "rax", "rbx", "rcx", "rdx", "r8", "r9", "r10", "r11", "r12", "cc", "memory");
+}
+
+/* a = a * 121665 + b, b being added before the reduction */
+__attribute__((target("bmi2,adx"))) static void
+mulxsmalladd(mp_limb_t *a, const mp_limb_t *b) {
+  __asm__ volatile (
+    "movl $121665, %%edx\n\t"
+    "mulxq 0(%0), %%r8, %%r9\n\t"
+    "mulxq 8(%0), %%rax, %%r10\n\t"
+    "addq %%rax, %%r9\n\t"
+    "mulxq 16(%0), %%rax, %%r11\n\t"
+    "adcq %%rax, %%r10\n\t"
+    "mulxq 24(%0), %%rax, %%r12\n\t"
+    "adcq %%rax, %%r11\n\t"
+    "adcq $0, %%r12\n\t"
+    "addq 0(%1), %%r8\n\t"
+    "adcq 8(%1), %%r9\n\t"
+    "adcq 16(%1), %%r10\n\t"
+    "adcq 24(%1), %%r11\n\t"
+    "adcq $0, %%r12\n\t"
+    REDUCE
+    :
+    : "r" (a), "r" (b)
+    : "rax", "rbx", "rcx", "rdx", "r8", "r9", "r10", "r11", "r12", "cc", "memory");
+}
+
+__attribute__((target("bmi2,adx"))) static void
+mulxsqr(mp_limb_t *a) {
+  __asm__ volatile (
+    SQR
+    FOLD
+    REDUCE
+    :
+    : "r" (a)
+    : "rax", "rbx", "rcx", "rdx", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15", "cc", "memory");
+}
+
+/* n squarings within one asm block, the counter in a register */
+__attribute__((target("bmi2,adx"))) static void
+mulxsqrn(mp_limb_t *a, unsigned int n) {
+  if (!n) {
+    return;
+  }
+  __asm__ volatile (
+    "1:\n\t"
+    SQR
+    FOLD
+    REDUCE
+    "decl %1\n\t"
+    "jnz 1b\n\t"
+    : "+r" (a), "+r" (n)
+    :
+    : "rax", "rbx", "rcx", "rdx", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15", "cc", "memory");
+}
+
+static void
+mpnmul(mp_limb_t *a, const mp_limb_t *b) {
+  mpnmulmodp((fe25519*)a, (fe25519*)b);
+}
+
+static void
+mpnmulasmall(mp_limb_t *a) {
+  mpnmulasmallmodp((fe25519*)a);
+}
+
+static void
+mpnmulasmalladd(mp_limb_t *a, const mp_limb_t *b) {
+  mpnmulasmalladdmodp((fe25519*)a, (fe25519*)b);
+}
+
+static void
+mpnsqr(mp_limb_t *a) {
+  mpnsqrmodp((fe25519*)a);
+}
+
+static void
+mpnsqrn(mp_limb_t *a, unsigned int n) {
+  mpnsqrnmodp((fe25519*)a, n);
+}
+
+/* CPUID leaf 7: BMI2 is bit 8 and ADX bit 19 of EBX */
+extern int
+curve25519mulx_available(void) {
+  unsigned int a, b, c, d;
+  if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) {
+    return 0;
+  }
+  return (b & (1u << 8)) && (b & (1u << 19));
+}
+
+typedef void mul_t(mp_limb_t *a, const mp_limb_t *b);
+typedef void mulasmall_t(mp_limb_t *a);
+typedef void sqrn_t(mp_limb_t *a, unsigned int n);
+
+/* Run by the dynamic loader, before any constructor */
+static mul_t *
+resolvemul(void) {
+  return curve25519mulx_available() ? mulx : mpnmul;
+}
+
+static mulasmall_t *
+resolvemulasmall(void) {
+  return curve25519mulx_available() ? mulxsmall : mpnmulasmall;
+}
+
+static mul_t *
+resolvemulasmalladd(void) {
+  return curve25519mulx_available() ? mulxsmalladd : mpnmulasmalladd;
+}
+
+static mulasmall_t *
+resolvesqr(void) {
+  return curve25519mulx_available() ? mulxsqr : mpnsqr;
+}
+
+static sqrn_t *
+resolvesqrn(void) {
+  return curve25519mulx_available() ? mulxsqrn : mpnsqrn;
+}
+
+extern void curve25519mulx_mul(mp_limb_t *a, const mp_limb_t *b) __attribute__((ifunc("resolvemul")));
+extern void curve25519mulx_mulasmall(mp_limb_t *a) __attribute__((ifunc("resolvemulasmall")));
+extern void curve25519mulx_mulasmalladd(mp_limb_t *a, const mp_limb_t *b) __attribute__((ifunc("resolvemulasmalladd")));
+extern void curve25519mulx_sqr(mp_limb_t *a) __attribute__((ifunc("resolvesqr")));
+extern void curve25519mulx_sqrn(mp_limb_t *a, unsigned int n) __attribute__((ifunc("resolvesqrn")));
+
+#endif /* C25519_MULX */
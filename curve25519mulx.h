@@ -0,0 +1,39 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Multiplication and squaring modulo p for the GMP backend on x86-64,
+ * using the MULX, ADCX and ADOX instructions (BMI2 and ADX) when the
+ * processor has them.  The implementation is chosen once, when the
+ * library is loaded, through an indirect function: older processors get
+ * the mpn_* code of fe25519.h, at the cost of one more call. */
+
+#ifndef __CURVE25519LIB_MULX_H__
+#define __CURVE25519LIB_MULX_H__
+
+#if !defined(C25519_FE51) && defined(__GNUC__) && defined(__x86_64__) && defined(__ELF__) && (GMP_LIMB_BITS == 64) && !defined(C25519_NO_MULX)
+#define C25519_MULX
+
+extern int curve25519mulx_available(void);
+/* a = a * b, a = a * 121665, a = a * 121665 + b, a = a^2 and
+   a = a^(2^n), reduced lazily as in fe25519.h */
+extern void curve25519mulx_mul(mp_limb_t *a, const mp_limb_t *b);
+extern void curve25519mulx_mulasmall(mp_limb_t *a);
+extern void curve25519mulx_mulasmalladd(mp_limb_t *a, const mp_limb_t *b);
+extern void curve25519mulx_sqr(mp_limb_t *a);
+extern void curve25519mulx_sqrn(mp_limb_t *a, unsigned int n);
+#endif
+
+#endif /* __CURVE25519LIB_MULX_H__ */
@@ -0,0 +1,285 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Worker threads computing curve25519_batch() over chunks of a job.
+ *
+ * Jobs are queued in order and the workers all work on the oldest one.
+ * Its chunks are split evenly into one range per worker; a worker takes
+ * chunks from the front of its own range, and once that is empty it
+ * steals from the back of the others.  A range is a single 64-bit word
+ * (first << 32 | end) updated by compare-and-swap, so claiming a chunk
+ * never takes a lock.  The scratch space of curve25519_batch() is on the
+ * stack of each worker, so nothing is allocated per chunk.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "curve25519.h"
+#include "curve25519pool.h"
+
+/* Results per chunk; a multiple of the inversion batch of curve25519_batch */
+#define CHUNK 64
+
+struct curve25519job {
+  curve25519key_t *r, *f, *c;
+  unsigned int rs, fs, cs;
+  unsigned int n;
+  curve25519job_done_t *done;
+  void *arg;
+  atomic_uint left;	/* chunks not yet computed */
+  int queued;		/* still in the queue */
+  int complete;
+  unsigned int users;	/* workers looking at the ranges */
+  struct curve25519job *next;
+  curve25519pool_t *pool;
+  _Atomic uint64_t range[];
+};
+
+struct curve25519pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work;	/* a job was queued, or the pool is stopping */
+  pthread_cond_t idle;	/* a job completed */
+  curve25519job_t *head, *tail;
+  int stop;
+  unsigned int nthreads;
+  pthread_t thread[];
+};
+
+struct worker {
+  curve25519pool_t *pool;
+  unsigned int id;
+};
+
+static int
+claim(_Atomic uint64_t *range, int back) {
+  uint64_t v = atomic_load(range);
+  for (;;) {
+    uint32_t first = v >> 32, end = (uint32_t)v;
+    uint64_t n;
+    if (first >= end) {
+      return -1;
+    }
+    n = back ? (v - 1) : (v + (((uint64_t)1) << 32));
+    if (atomic_compare_exchange_weak(range, &v, n)) {
+      return back ? (int)(end - 1) : (int)first;
+    }
+  }
+}
+
+static void
+compute(curve25519job_t *j, unsigned int k) {
+  unsigned int o = k * CHUNK;
+  unsigned int m = (j->n - o < CHUNK) ? j->n - o : CHUNK, i;
+  if (j->c) {
+    curve25519_batch_stride(j->r + o * j->rs, j->rs, j->f + o * j->fs, j->fs, j->c + o * j->cs, j->cs, m);
+  } else {
+    for (i = o; i < o + m; i++) {
+      curve25519_base(j->r + i * j->rs, j->f + i * j->fs);
+    }
+  }
+}
+
+static void
+finish(curve25519job_t *j) {
+  curve25519pool_t *p = j->pool;
+  if (j->done) {
+    j->done(j->arg, j->r, j->n);
+  }
+  pthread_mutex_lock(&p->lock);
+  j->complete = 1;
+  pthread_cond_broadcast(&p->idle);
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void *
+work(void *a) {
+  struct worker *w = a;
+  curve25519pool_t *p = w->pool;
+  unsigned int id = w->id, t = p->nthreads;
+  free(w);
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    curve25519job_t *j;
+    int k;
+    unsigned int i;
+    while (!p->head && !p->stop) {
+      pthread_cond_wait(&p->work, &p->lock);
+    }
+    if (!p->head) {
+      break;
+    }
+    j = p->head;
+    j->users++;
+    pthread_mutex_unlock(&p->lock);
+
+    for (;;) {
+      k = claim(j->range + id, 0);
+      for (i = 1; (k < 0) && (i < t); i++) {
+	k = claim(j->range + (id + i) % t, 1);
+      }
+      if (k < 0) {
+	break;
+      }
+      compute(j, k);
+      if (atomic_fetch_sub(&j->left, 1) == 1) {
+	finish(j);
+      }
+    }
+
+    pthread_mutex_lock(&p->lock);
+    if (p->head == j) {
+      p->head = j->next;
+      if (!p->head) {
+	p->tail = NULL;
+      }
+      j->queued = 0;
+    }
+    j->users--;
+    if (j->users == 0) {
+      pthread_cond_broadcast(&p->idle);
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+extern curve25519pool_t *
+curve25519pool_new(unsigned int threads) {
+  curve25519pool_t *p;
+  unsigned int i;
+  if (threads == 0) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = (n > 0) ? n : 1;
+  }
+  p = malloc(sizeof(*p) + threads * sizeof(pthread_t));
+  if (!p) {
+    return NULL;
+  }
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->work, NULL);
+  pthread_cond_init(&p->idle, NULL);
+  p->head = p->tail = NULL;
+  p->stop = 0;
+  p->nthreads = threads;
+  for (i = 0; i < threads; i++) {
+    struct worker *w = malloc(sizeof(*w));
+    if (w) {
+      w->pool = p;
+      w->id = i;
+      if (pthread_create(p->thread + i, NULL, work, w) == 0) {
+	continue;
+      }
+      free(w);
+    }
+    /* Stop the workers started so far */
+    p->nthreads = i;
+    curve25519pool_free(p);
+    return NULL;
+  }
+  return p;
+}
+
+extern void
+curve25519pool_free(curve25519pool_t *p) {
+  unsigned int i;
+  pthread_mutex_lock(&p->lock);
+  p->stop = 1;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->lock);
+  for (i = 0; i < p->nthreads; i++) {
+    pthread_join(p->thread[i], NULL);
+  }
+  pthread_cond_destroy(&p->idle);
+  pthread_cond_destroy(&p->work);
+  pthread_mutex_destroy(&p->lock);
+  free(p);
+}
+
+extern unsigned int
+curve25519pool_threads(curve25519pool_t *p) {
+  return p->nthreads;
+}
+
+extern curve25519job_t *
+curve25519pool_submit_stride(curve25519pool_t *p, curve25519key_t *r, unsigned int rs, curve25519key_t *f, unsigned int fs, curve25519key_t *c, unsigned int cs, unsigned int n, curve25519job_done_t *done, void *arg) {
+  unsigned int t = p->nthreads, chunks = (n + CHUNK - 1) / CHUNK, i;
+  curve25519job_t *j = malloc(sizeof(*j) + t * sizeof(j->range[0]));
+  if (!j) {
+    return NULL;
+  }
+  j->r = r; j->f = f; j->c = c; j->n = n;
+  j->rs = rs; j->fs = fs; j->cs = cs;
+  j->done = done; j->arg = arg;
+  atomic_init(&j->left, chunks);
+  j->complete = 0;
+  j->users = 0;
+  j->next = NULL;
+  j->pool = p;
+  for (i = 0; i < t; i++) {
+    uint64_t first = (uint64_t)chunks * i / t, end = (uint64_t)chunks * (i + 1) / t;
+    atomic_init(j->range + i, (first << 32) | end);
+  }
+  if (chunks == 0) {
+    j->queued = 0;
+    finish(j);
+    return j;
+  }
+  pthread_mutex_lock(&p->lock);
+  j->queued = 1;
+  if (p->tail) {
+    p->tail->next = j;
+  } else {
+    p->head = j;
+  }
+  p->tail = j;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->lock);
+  return j;
+}
+
+extern curve25519job_t *
+curve25519pool_submit(curve25519pool_t *p, curve25519key_t *r, curve25519key_t *f, curve25519key_t *c, unsigned int n, curve25519job_done_t *done, void *arg) {
+  return curve25519pool_submit_stride(p, r, 1, f, 1, c, 1, n, done, arg);
+}
+
+extern int
+curve25519job_ready(curve25519job_t *j) {
+  return atomic_load(&j->left) == 0;
+}
+
+extern void
+curve25519job_wait(curve25519job_t *j) {
+  curve25519pool_t *p = j->pool;
+  pthread_mutex_lock(&p->lock);
+  while (!j->complete || j->queued || j->users) {
+    pthread_cond_wait(&p->idle, &p->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+  free(j);
+}
+
+extern int
+curve25519pool_run(curve25519pool_t *p, curve25519key_t *r, curve25519key_t *f, curve25519key_t *c, unsigned int n) {
+  curve25519job_t *j = curve25519pool_submit(p, r, f, c, n, NULL, NULL);
+  if (!j) {
+    return -1;
+  }
+  curve25519job_wait(j);
+  return 0;
+}
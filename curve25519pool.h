@@ -0,0 +1,53 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CURVE25519LIB_POOL_H__
+#define __CURVE25519LIB_POOL_H__
+
+#include "curve25519.h"
+
+typedef struct curve25519pool curve25519pool_t;
+typedef struct curve25519job curve25519job_t;
+
+/* Called from a worker thread once all the results of a job are ready,
+ * or for a job of no keys from curve25519pool_submit() itself */
+typedef void curve25519job_done_t(void *arg, curve25519key_t *r, unsigned int n);
+
+/* Starts a pool of worker threads; 0 means one per online processor.
+ * Returns NULL on failure. */
+extern curve25519pool_t *curve25519pool_new(unsigned int threads);
+/* Waits for all the queued jobs, then stops the workers */
+extern void curve25519pool_free(curve25519pool_t *p);
+extern unsigned int curve25519pool_threads(curve25519pool_t *p);
+
+/* Queues the computation of r[i] = curve25519(f[i], c[i]) for i < n,
+ * or of r[i] = curve25519_base(f[i]) if c is NULL.  The arrays must stay
+ * valid until the job is complete.  done, if not NULL, is called when
+ * all the results are available.  The returned job must be passed to
+ * curve25519job_wait() exactly once; NULL is returned if no memory is
+ * available. */
+extern curve25519job_t *curve25519pool_submit(curve25519pool_t *p, curve25519key_t *r, curve25519key_t *f, curve25519key_t *c, unsigned int n, curve25519job_done_t *done, void *arg);
+/* The same, with the i-th keys at r + i * rs, f + i * fs and c + i * cs */
+extern curve25519job_t *curve25519pool_submit_stride(curve25519pool_t *p, curve25519key_t *r, unsigned int rs, curve25519key_t *f, unsigned int fs, curve25519key_t *c, unsigned int cs, unsigned int n, curve25519job_done_t *done, void *arg);
+/* Non-zero if the job is complete */
+extern int curve25519job_ready(curve25519job_t *j);
+/* Waits for the job to complete and releases it */
+extern void curve25519job_wait(curve25519job_t *j);
+
+/* Submits and waits; returns -1 if the job could not be queued */
+extern int curve25519pool_run(curve25519pool_t *p, curve25519key_t *r, curve25519key_t *f, curve25519key_t *c, unsigned int n);
+
+#endif /* __CURVE25519LIB_POOL_H__ */
@@ -0,0 +1,220 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The numbers are held as five signed 62-bit limbs, the top one
+ * carrying the sign, and p = 2^255 - 19 as { -19, 0, 0, 0, 128 }.  This
+ * follows the constant-time version of the modinv64 code of
+ * libsecp256k1, specialized to p.  The loop counts and the masks
+ * depend only on the length of p, never on the value inverted. */
+
+#include <stdint.h>
+#include "curve25519.h"
+#include "curve25519safegcd.h"
+
+#ifdef C25519_HAVE_SAFEGCD
+
+typedef __int128 int128_t;
+
+#define M62 ((int64_t)(UINT64_MAX >> 2))
+/* p[0] and p[4] in the signed 62-bit form, and 1 / p mod 2^62 */
+#define P0 ((int64_t)-19)
+#define P4 ((int64_t)128)
+#define PINV62 ((uint64_t)0x39435e50d79435e5)
+
+typedef struct {
+  int64_t v[5];
+} s62_t;
+
+/* The transition matrix of a batch, scaled by 2^62 */
+typedef struct {
+  int64_t u, v, q, r;
+} trans_t;
+
+/* 59 divsteps on the low bits of f and g: zeta is -(delta + 1/2) */
+static int64_t
+divsteps59(int64_t zeta, uint64_t f0, uint64_t g0, trans_t *t) {
+  uint64_t u = 8, v = 0, q = 0, r = 8;
+  uint64_t f = f0, g = g0, x, y, z, c1, c2;
+  int i;
+  for (i = 3; i < 62; i++) {
+    /* If zeta < 0 and g is odd: (f, g) = (g, (g - f) / 2), else
+       g = (g + (g & 1) * f) / 2, both as masks */
+    c1 = (uint64_t)(zeta >> 63);
+    c2 = 0 - (g & 1);
+    x = (f ^ c1) - c1;
+    y = (u ^ c1) - c1;
+    z = (v ^ c1) - c1;
+    g += x & c2;
+    q += y & c2;
+    r += z & c2;
+    c1 &= c2;
+    zeta = (zeta ^ (int64_t)c1) - 1;
+    f += g & c1;
+    u += q & c1;
+    v += r & c1;
+    g >>= 1;
+    u <<= 1;
+    v <<= 1;
+  }
+  t->u = (int64_t)u;
+  t->v = (int64_t)v;
+  t->q = (int64_t)q;
+  t->r = (int64_t)r;
+  return zeta;
+}
+
+/* (d, e) = t (d, e) / 2^62 (mod p), adding the multiple of p that makes
+   the division exact; d and e stay in (-2p, p) */
+static void
+updatede(s62_t *d, s62_t *e, const trans_t *t) {
+  const int64_t d0 = d->v[0], d1 = d->v[1], d2 = d->v[2], d3 = d->v[3], d4 = d->v[4];
+  const int64_t e0 = e->v[0], e1 = e->v[1], e2 = e->v[2], e3 = e->v[3], e4 = e->v[4];
+  const int64_t u = t->u, v = t->v, q = t->q, r = t->r;
+  int64_t md, me, sd, se;
+  int128_t cd, ce;
+  /* Add p times u or v for the negative inputs, so that the result
+     cannot go below -p */
+  sd = d4 >> 63;
+  se = e4 >> 63;
+  md = (u & sd) + (v & se);
+  me = (q & sd) + (r & se);
+  cd = (int128_t)u * d0 + (int128_t)v * e0;
+  ce = (int128_t)q * d0 + (int128_t)r * e0;
+  /* Then choose the low bits of the multiples to clear those of cd, ce */
+  md -= (int64_t)((PINV62 * (uint64_t)cd + (uint64_t)md) & M62);
+  me -= (int64_t)((PINV62 * (uint64_t)ce + (uint64_t)me) & M62);
+  cd += (int128_t)P0 * md;
+  ce += (int128_t)P0 * me;
+  cd >>= 62;
+  ce >>= 62;
+  cd += (int128_t)u * d1 + (int128_t)v * e1;
+  ce += (int128_t)q * d1 + (int128_t)r * e1;
+  d->v[0] = (int64_t)cd & M62;
+  e->v[0] = (int64_t)ce & M62;
+  cd >>= 62;
+  ce >>= 62;
+  cd += (int128_t)u * d2 + (int128_t)v * e2;
+  ce += (int128_t)q * d2 + (int128_t)r * e2;
+  d->v[1] = (int64_t)cd & M62;
+  e->v[1] = (int64_t)ce & M62;
+  cd >>= 62;
+  ce >>= 62;
+  cd += (int128_t)u * d3 + (int128_t)v * e3;
+  ce += (int128_t)q * d3 + (int128_t)r * e3;
+  d->v[2] = (int64_t)cd & M62;
+  e->v[2] = (int64_t)ce & M62;
+  cd >>= 62;
+  ce >>= 62;
+  cd += (int128_t)u * d4 + (int128_t)v * e4;
+  ce += (int128_t)q * d4 + (int128_t)r * e4;
+  cd += (int128_t)P4 * md;
+  ce += (int128_t)P4 * me;
+  d->v[3] = (int64_t)cd & M62;
+  e->v[3] = (int64_t)ce & M62;
+  cd >>= 62;
+  ce >>= 62;
+  d->v[4] = (int64_t)cd;
+  e->v[4] = (int64_t)ce;
+}
+
+/* (f, g) = t (f, g) / 2^62, which is exact */
+static void
+updatefg(s62_t *f, s62_t *g, const trans_t *t) {
+  const int64_t u = t->u, v = t->v, q = t->q, r = t->r;
+  int128_t cf, cg;
+  int i;
+  cf = (int128_t)u * f->v[0] + (int128_t)v * g->v[0];
+  cg = (int128_t)q * f->v[0] + (int128_t)r * g->v[0];
+  cf >>= 62;
+  cg >>= 62;
+  for (i = 1; i < 5; i++) {
+    cf += (int128_t)u * f->v[i] + (int128_t)v * g->v[i];
+    cg += (int128_t)q * f->v[i] + (int128_t)r * g->v[i];
+    f->v[i - 1] = (int64_t)cf & M62;
+    g->v[i - 1] = (int64_t)cg & M62;
+    cf >>= 62;
+    cg >>= 62;
+  }
+  f->v[4] = (int64_t)cf;
+  g->v[4] = (int64_t)cg;
+}
+
+/* Brings r from (-2p, p) to [0, p), negated if sign < 0 */
+static void
+normalize(s62_t *r, int64_t sign) {
+  int64_t r0 = r->v[0], r1 = r->v[1], r2 = r->v[2], r3 = r->v[3], r4 = r->v[4];
+  int64_t m;
+  m = r4 >> 63;
+  r0 += P0 & m;
+  r4 += P4 & m;
+  m = sign >> 63;
+  r0 = (r0 ^ m) - m;
+  r1 = (r1 ^ m) - m;
+  r2 = (r2 ^ m) - m;
+  r3 = (r3 ^ m) - m;
+  r4 = (r4 ^ m) - m;
+  r1 += r0 >> 62; r0 &= M62;
+  r2 += r1 >> 62; r1 &= M62;
+  r3 += r2 >> 62; r2 &= M62;
+  r4 += r3 >> 62; r3 &= M62;
+  m = r4 >> 63;
+  r0 += P0 & m;
+  r4 += P4 & m;
+  r1 += r0 >> 62; r0 &= M62;
+  r2 += r1 >> 62; r1 &= M62;
+  r3 += r2 >> 62; r2 &= M62;
+  r4 += r3 >> 62; r3 &= M62;
+  r->v[0] = r0;
+  r->v[1] = r1;
+  r->v[2] = r2;
+  r->v[3] = r3;
+  r->v[4] = r4;
+}
+
+extern void
+curve25519safegcd(curve25519key_t *r, curve25519key_t *a) {
+  s62_t d = { { 0, 0, 0, 0, 0 } }, e = { { 1, 0, 0, 0, 0 } };
+  s62_t f = { { P0, 0, 0, 0, P4 } }, g;
+  uint64_t w[4] = { 0, 0, 0, 0 };
+  int64_t zeta = -1;
+  unsigned int i;
+  trans_t t;
+  for (i = 0; i < C25519N; i++) {
+    w[i * C25519LIMBBITS / 64] |= (uint64_t)a[0][i] << (i * C25519LIMBBITS % 64);
+  }
+  g.v[0] = (int64_t)(w[0] & M62);
+  g.v[1] = (int64_t)(((w[0] >> 62) | (w[1] << 2)) & M62);
+  g.v[2] = (int64_t)(((w[1] >> 60) | (w[2] << 4)) & M62);
+  g.v[3] = (int64_t)(((w[2] >> 58) | (w[3] << 6)) & M62);
+  g.v[4] = (int64_t)(w[3] >> 56);
+  /* 590 divsteps suffice for any input below 2^256 */
+  for (i = 0; i < 10; i++) {
+    zeta = divsteps59(zeta, (uint64_t)f.v[0], (uint64_t)g.v[0], &t);
+    updatede(&d, &e, &t);
+    updatefg(&f, &g, &t);
+  }
+  /* Now f = +-1 and d = +-1 / a, or f = p and d = 0 if a = 0 */
+  normalize(&d, f.v[4]);
+  w[0] = (uint64_t)d.v[0] | ((uint64_t)d.v[1] << 62);
+  w[1] = ((uint64_t)d.v[1] >> 2) | ((uint64_t)d.v[2] << 60);
+  w[2] = ((uint64_t)d.v[2] >> 4) | ((uint64_t)d.v[3] << 58);
+  w[3] = ((uint64_t)d.v[3] >> 6) | ((uint64_t)d.v[4] << 56);
+  for (i = 0; i < C25519N; i++) {
+    r[0][i] = (curve25519limb_t)(w[i * C25519LIMBBITS / 64] >> (i * C25519LIMBBITS % 64));
+  }
+}
+
+#endif /* C25519_HAVE_SAFEGCD */
@@ -0,0 +1,33 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Inversion modulo p by the safegcd algorithm of Bernstein and Yang
+ * ("Fast constant-time gcd computation and modular inversion", 2019),
+ * in constant time: ten batches of 59 divsteps on the low 62 bits of f
+ * and g, each applied to the full numbers as a 2x2 matrix.  Needs a
+ * compiler providing __int128. */
+
+#ifndef __CURVE25519LIB_SAFEGCD_H__
+#define __CURVE25519LIB_SAFEGCD_H__
+
+#ifdef __SIZEOF_INT128__
+#define C25519_HAVE_SAFEGCD
+
+/* r = 1 / a (mod p), with a < p; 0 gives 0.  r and a may be the same */
+extern void curve25519safegcd(curve25519key_t *r, curve25519key_t *a);
+#endif
+
+#endif /* __CURVE25519LIB_SAFEGCD_H__ */
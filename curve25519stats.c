@@ -0,0 +1,178 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "curve25519stats.h"
+#include "stats25519.h"
+
+static const char *opnames[C25519OPS] = {
+  "add", "sub", "mul", "sqr", "mulasmall", "inv"
+};
+
+static const char *phasenames[C25519PHASES] = {
+  "curve25519", "curve25519_batch", "curve25519_base",
+  "ladder", "invert", "validate"
+};
+
+#ifdef C25519_STATS
+
+#include <pthread.h>
+
+_Thread_local struct stats25519 *stats25519_local;
+
+/* The threads registered so far, and the sum of the ones that exited */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static struct stats25519 *threads;
+static struct stats25519 retired;
+/* Shared by the threads that could not allocate their own, which update
+   it with atomic adds */
+static struct stats25519 fallback = { .shared = 1 };
+
+static void
+add(struct stats25519 *r, struct stats25519 *s) {
+  uint64_t *a = r->ops, *b = s->ops;
+  unsigned int i, n = offsetof(struct stats25519, next) / sizeof(uint64_t);
+  for (i = 0; i < n; i++) {
+    a[i] += __atomic_load_n(b + i, __ATOMIC_RELAXED);
+  }
+}
+
+static void
+unregister(void *v) {
+  struct stats25519 *s = v, **p;
+  pthread_mutex_lock(&lock);
+  for (p = &threads; *p; p = &(*p)->next) {
+    if (*p == s) {
+      *p = s->next;
+      break;
+    }
+  }
+  add(&retired, s);
+  pthread_mutex_unlock(&lock);
+  free(s);
+}
+
+static void
+init(void) {
+  pthread_key_create(&key, unregister);
+}
+
+extern struct stats25519 *
+stats25519_register(void) {
+  struct stats25519 *s = calloc(1, sizeof(*s));
+  pthread_once(&once, init);
+  if (!s || (pthread_setspecific(key, s) != 0)) {
+    free(s);
+    s = &fallback;
+  } else {
+    pthread_mutex_lock(&lock);
+    s->next = threads;
+    threads = s;
+    pthread_mutex_unlock(&lock);
+  }
+  stats25519_local = s;
+  return s;
+}
+
+extern int
+curve25519_stats_snapshot(curve25519stats_t *r) {
+  struct stats25519 t, *s;
+  unsigned int i, j;
+  memset(&t, 0, sizeof(t));
+  memset(r, 0, sizeof(*r));
+  pthread_mutex_lock(&lock);
+  add(&t, &retired);
+  add(&t, &fallback);
+  for (s = threads; s; s = s->next) {
+    add(&t, s);
+    r->threads++;
+  }
+  pthread_mutex_unlock(&lock);
+  r->cycles = C25519STATSCYCLES;
+  for (i = 0; i < C25519OPS; i++) {
+    r->ops[i] = t.ops[i];
+  }
+  for (i = 0; i < C25519PHASES; i++) {
+    r->count[i] = t.count[i];
+    r->time[i] = t.time[i];
+    for (j = 0; j < C25519STATSBUCKETS; j++) {
+      r->hist[i][j] = t.hist[i][j];
+    }
+  }
+  return 0;
+}
+
+static void
+clear(struct stats25519 *s) {
+  uint64_t *a = s->ops;
+  unsigned int i, n = offsetof(struct stats25519, next) / sizeof(uint64_t);
+  for (i = 0; i < n; i++) {
+    __atomic_store_n(a + i, 0, __ATOMIC_RELAXED);
+  }
+}
+
+extern void
+curve25519_stats_reset(void) {
+  struct stats25519 *s;
+  pthread_mutex_lock(&lock);
+  clear(&retired);
+  clear(&fallback);
+  for (s = threads; s; s = s->next) {
+    clear(s);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+#else
+
+extern int
+curve25519_stats_snapshot(curve25519stats_t *r) {
+  memset(r, 0, sizeof(*r));
+  return -1;
+}
+
+extern void
+curve25519_stats_reset(void) {
+}
+
+#endif /* C25519_STATS */
+
+extern void
+curve25519_stats_print(FILE *f, curve25519stats_t *s) {
+  const char *u = s->cycles ? "cycles" : "ns";
+  unsigned int i, j;
+  fprintf(f, "threads: %u\n", s->threads);
+  for (i = 0; i < C25519OPS; i++) {
+    fprintf(f, "%s: %llu\n", opnames[i], s->ops[i]);
+  }
+  for (i = 0; i < C25519PHASES; i++) {
+    if (s->count[i] == 0) {
+      continue;
+    }
+    fprintf(f, "%s: %llu in %llu %s, %.1f %s each\n", phasenames[i],
+	    s->count[i], s->time[i], u, (double)s->time[i] / s->count[i], u);
+    for (j = 0; j < C25519STATSBUCKETS; j++) {
+      if (s->hist[i][j]) {
+	fprintf(f, "  %s >= 2^%u: %llu\n", u, j, s->hist[i][j]);
+      }
+    }
+  }
+}
@@ -0,0 +1,61 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CURVE25519LIB_STATS_H__
+#define __CURVE25519LIB_STATS_H__
+
+#include <stdio.h>
+
+/* Statistics collected when the library is built with C25519_STATS
+ * defined ('make STATS=1'); otherwise none of this costs anything and
+ * curve25519_stats_snapshot() just fails. */
+
+/* Field operations */
+enum {
+  C25519OP_ADD, C25519OP_SUB, C25519OP_MUL, C25519OP_SQR,
+  C25519OP_MULASMALL, C25519OP_INV,
+  C25519OPS
+};
+
+/* Timed phases; the first three are whole calls to the public
+ * functions, the others parts of them */
+enum {
+  C25519PHASE_CURVE25519, C25519PHASE_BATCH, C25519PHASE_BASE,
+  C25519PHASE_LADDER, C25519PHASE_INVERT, C25519PHASE_VALIDATE,
+  C25519PHASES
+};
+
+/* Bucket i of a histogram counts the runs that took 2^i to 2^(i+1) - 1
+ * time units */
+#define C25519STATSBUCKETS 48
+
+typedef struct {
+  unsigned int threads;		/* live threads that used the library */
+  int cycles;			/* time in cycles if non-zero, else in ns */
+  unsigned long long ops[C25519OPS];
+  unsigned long long count[C25519PHASES];
+  unsigned long long time[C25519PHASES];
+  unsigned long long hist[C25519PHASES][C25519STATSBUCKETS];
+} curve25519stats_t;
+
+/* Sums up the statistics of all the threads, including the ones that
+ * have exited.  Returns 0, or -1 if they are not being collected. */
+extern int curve25519_stats_snapshot(curve25519stats_t *s);
+extern void curve25519_stats_reset(void);
+/* Prints a snapshot in human-readable form */
+extern void curve25519_stats_print(FILE *f, curve25519stats_t *s);
+
+#endif /* __CURVE25519LIB_STATS_H__ */
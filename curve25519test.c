@@ -1,5 +1,5 @@
 /* Copyright (c) 2007 Michele Bini
- * 
+ *
  * This program is free software: you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published by
  * the Free Software Foundation, either version 3 of the License, or (at your
@@ -21,50 +21,1117 @@
  *
  */
 
+/* Without options, prints the output of test-curve25519.  With
+ * --digest, hashes it with SHA-256 instead, printing the digest after
+ * 10, 100, 1000... iterations and checking it against the known ones.
+ *
+ * The state of the chain after a number of iterations, together with
+ * the state of the hash, is a checkpoint.  --save writes checkpoints to
+ * a file while running; --load reads them back, and then the iterations
+ * between consecutive checkpoints are independent and are run by
+ * --threads threads, each checking that it arrives at the next
+ * checkpoint.
+ *
+ * --vectors FILE reads lines of three keys in inverted-bytes
+ * hexadecimal, e k and curve25519(e, k), such as curve25519test.txt,
+ * and checks the other entry points of the library against them.  With
+ * --daemon PATH, it checks those of the curve25519d listening at PATH
+ * as well.
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "curve25519.h"
+#include "curve25519avx2.h"
+#include "curve25519msm.h"
+#include "curve25519cache.h"
+#include "curve25519keypool.h"
+#include "curve25519pool.h"
+#include "curve25519stats.h"
+#include "curve25519d.h"
+#include "curve25519file.h"
+#include "base32.h"
+#include "hex.h"
+#include "sha256.h"
+
+typedef struct {
+  unsigned long long n;		/* iterations done */
+  curve25519key_t e1, e2, k;
+  sha256_t sha;
+} state_t;
+
+/* Each iteration writes four lines, then one for each failure */
+#define LINE 195
+#define OUTPUT (4 * LINE + 5 * C25519N)
 
-void doit(curve25519key_t *ek,curve25519key_t *e,curve25519key_t *k)
+/* Digests of the output of the first 10^i iterations */
+static const char *known[] = {
+  NULL,
+  "65695547eeefa84bbc2aeb4faeef975189a02b289854939eb85024872e90033b",
+  "5399a7fe1b3b647961fb1fac7986e9d2ff08ac23d2255f2b7c2aa9712b000f7e",
+  "fef252d8e17489b3fef67ee490684e23157a88a97f6e0f385b5f0e1b0d3b1228",
+  "52e3014e8f3a85da249675f9979efb57d81a339a9a028f61172fcb92c9dd32cc",
+  "f02295e2a3f18c62a9442585485091f848ebb9c3c56bdc3cfff1a857b631db8e",
+  "9d7f6074ab193ae3c77087d771dd05b67131c000cfc3b8396a597169e3f754b7",
+};
+#define KNOWN (sizeof(known) / sizeof(*known))
+
+static void
+init(state_t *s) {
+  memset(s, 0, sizeof(*s));
+  s->e1[0] = 3;
+  s->e2[0] = 5;
+  s->k[0] = 9;
+  sha256_init(&s->sha);
+}
+
+static void
+doit(char *s, curve25519key_t *ek, curve25519key_t *e, curve25519key_t *k)
 {
+  ibh_encode(s, e); s[64] = ' ';
+  ibh_encode(s + 65, k); s[129] = ' ';
+  curve25519(ek, e, k);
+  ibh_encode(s + 130, ek); s[194] = '\n';
+}
+
+/* Writes the output of the next iteration to s and returns its length,
+ * or its complement if the two shared secrets differ */
+static long
+iterate(char *s, state_t *t) {
+  curve25519key_t e1k, e2k, e1e2k, e2e1k;
+  long n = 4 * LINE, f = 0;
   int i;
-#if 0
-  char s[64];
-  base32_encode(s, e); printf("%s ", s);
-  base32_encode(s, k); printf("%s ", s);
-  curve25519(ek,e,k);
-  base32_encode(s, ek); printf("%s\n", s);
+  doit(s, &e1k, &t->e1, &t->k);
+  doit(s + LINE, &e2e1k, &t->e2, &e1k);
+  doit(s + 2 * LINE, &e2k, &t->e2, &t->k);
+  doit(s + 3 * LINE, &e1e2k, &t->e1, &e2k);
+  for (i = 0; i < C25519N; ++i) {
+    if (e1e2k[i] != e2e1k[i]) {
+      memcpy(s + n, "fail\n", 5);
+      n += 5;
+      f = 1;
+    }
+  }
+  for (i = 0; i < C25519N; ++i) t->e1[i] ^= e2k[i];
+  for (i = 0; i < C25519N; ++i) t->e2[i] ^= e1k[i];
+  for (i = 0; i < C25519N; ++i) t->k[i] ^= e1e2k[i];
+  t->n++;
+  return f ? ~n : n;
+}
+
+/* Checkpoint files have one line per checkpoint: the number of
+ * iterations, the three keys of the chain, the state of the hash and
+ * the number of bytes hashed, followed by the pending ones if any */
+static void
+save(FILE *f, state_t *s) {
+  char e1[65], e2[65], k[65];
+  unsigned int i, u = s->sha.n % 64;
+  ibh_encode(e1, &s->e1);
+  ibh_encode(e2, &s->e2);
+  ibh_encode(k, &s->k);
+  fprintf(f, "%llu %s %s %s ", s->n, e1, e2, k);
+  for (i = 0; i < 8; i++) {
+    fprintf(f, "%08x", (unsigned int)s->sha.h[i]);
+  }
+  fprintf(f, " %llu ", (unsigned long long)s->sha.n);
+  for (i = 0; i < u; i++) {
+    fprintf(f, "%02x", s->sha.buf[i]);
+  }
+  fprintf(f, "%s\n", u ? "" : "-");
+  fflush(f);
+}
+
+static int
+load(FILE *f, state_t *s) {
+  char e1[65], e2[65], k[65], h[65], b[129];
+  unsigned long long n;
+  unsigned int i, u, v;
+  if (fscanf(f, "%llu %64s %64s %64s %64s %llu %128s", &s->n, e1, e2, k, h, &n, b) != 7) {
+    return -1;
+  }
+  if ((ibh_decode(e1, &s->e1) < 0) || (ibh_decode(e2, &s->e2) < 0) || (ibh_decode(k, &s->k) < 0)) {
+    return -1;
+  }
+  memset(&s->sha, 0, sizeof(s->sha));
+  s->sha.n = n;
+  for (i = 0; i < 8; i++) {
+    if (sscanf(h + 8 * i, "%8x", &v) != 1) {
+      return -1;
+    }
+    s->sha.h[i] = v;
+  }
+  u = n % 64;
+  if (strlen(b) != (u ? 2 * u : 1)) {
+    return -1;
+  }
+  for (i = 0; i < u; i++) {
+    if (sscanf(b + 2 * i, "%2x", &v) != 1) {
+      return -1;
+    }
+    s->sha.buf[i] = v;
+  }
+  return 0;
+}
+
+static int
+same(state_t *a, state_t *b) {
+  return (a->n == b->n) && !memcmp(a->e1, b->e1, sizeof(a->e1)) &&
+    !memcmp(a->e2, b->e2, sizeof(a->e2)) && !memcmp(a->k, b->k, sizeof(a->k)) &&
+    !memcmp(a->sha.h, b->sha.h, sizeof(a->sha.h)) && (a->sha.n == b->sha.n) &&
+    !memcmp(a->sha.buf, b->sha.buf, a->sha.n % 64);
+}
+
+/* The digests to print: after 10^i iterations, then after count */
+static unsigned long long count = 1000000000;
+static unsigned long long reports[21];
+static char digests[21][65];
+static unsigned int nreports;
+
+static void
+report(state_t *s) {
+  unsigned int i;
+  for (i = 0; i < nreports; i++) {
+    if (reports[i] == s->n) {
+      sha256_t c = s->sha;
+      unsigned char d[32];
+      unsigned int j;
+      sha256_final(&c, d);
+      for (j = 0; j < 32; j++) {
+	sprintf(digests[i] + 2 * j, "%02x", d[j]);
+      }
+    }
+  }
+}
+
+/* Runs s up to n iterations; returns -1 if the chain failed */
+static int
+run(state_t *s, unsigned long long n, FILE *f, unsigned long long interval) {
+  char b[OUTPUT];
+  int r = 0;
+  while (s->n < n) {
+    long l = iterate(b, s);
+    if (l < 0) {
+      l = ~l;
+      r = -1;
+    }
+    sha256_update(&s->sha, b, l);
+    report(s);
+    if (f && (s->n % interval == 0)) {
+      save(f, s);
+    }
+  }
+  return r;
+}
+
+/* Checkpoints read by --load, the initial state first, and the next
+ * segment between them to run */
+static state_t *checkpoints;
+static unsigned int ncheckpoints;
+static unsigned int next;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int failed;
+
+static void *
+worker(void *arg) {
+  for (;;) {
+    unsigned int i;
+    unsigned long long n;
+    state_t s;
+    pthread_mutex_lock(&lock);
+    i = next++;
+    pthread_mutex_unlock(&lock);
+    if ((i >= ncheckpoints) || (checkpoints[i].n >= count)) {
+      break;
+    }
+    s = checkpoints[i];
+    n = ((i + 1 < ncheckpoints) && (checkpoints[i + 1].n <= count)) ? checkpoints[i + 1].n : count;
+    if (run(&s, n, NULL, 0) < 0) {
+      pthread_mutex_lock(&lock);
+      fprintf(stderr, "fail between %llu and %llu\n", checkpoints[i].n, n);
+      failed = 1;
+      pthread_mutex_unlock(&lock);
+    }
+    if ((i + 1 < ncheckpoints) && (checkpoints[i + 1].n == n) && !same(&s, checkpoints + i + 1)) {
+      pthread_mutex_lock(&lock);
+      fprintf(stderr, "checkpoint %llu not reached from %llu\n", n, checkpoints[i].n);
+      failed = 1;
+      pthread_mutex_unlock(&lock);
+    }
+  }
+  return NULL;
+}
+
+/* The vectors of --vectors */
+static curve25519key_t *ve, *vk, *vr;
+static unsigned int nvectors;
+
+static int
+readvectors(const char *file) {
+  FILE *f = fopen(file, "r");
+  char e[65], k[65], r[65];
+  if (!f) {
+    perror(file);
+    return -1;
+  }
+  while (fscanf(f, "%64s %64s %64s", e, k, r) == 3) {
+    ve = realloc(ve, (nvectors + 1) * sizeof(*ve));
+    vk = realloc(vk, (nvectors + 1) * sizeof(*vk));
+    vr = realloc(vr, (nvectors + 1) * sizeof(*vr));
+    if ((ibh_decode(e, ve + nvectors) < 0) || (ibh_decode(k, vk + nvectors) < 0) ||
+	(ibh_decode(r, vr + nvectors) < 0)) {
+      break;
+    }
+    nvectors++;
+  }
+  if (!feof(f) || (nvectors == 0)) {
+    fprintf(stderr, "%s: bad vector after %u\n", file, nvectors);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  return 0;
+}
+
+/* Compares r[i] with e[i] for i < n, printing one line */
+static void
+check(const char *what, curve25519key_t *r, curve25519key_t *e, unsigned int n) {
+  unsigned int i, bad = 0;
+  for (i = 0; i < n; i++) {
+    if (memcmp(r[i], e[i], sizeof(*r))) {
+      if (bad++ == 0) {
+	char a[65], b[65];
+	ibh_encode(a, r + i);
+	ibh_encode(b, e + i);
+	fprintf(stderr, "%s: %u: %s instead of %s\n", what, i, a, b);
+      }
+    }
+  }
+  printf("%s: %u%s\n", what, n, bad ? " FAILED" : " ok");
+  if (bad) {
+    failed = 1;
+  }
+}
+
+/* The base point of curve25519_msm(), compressed, and its opposite */
+static void
+basepoint(curve25519key_t *b, int negative) {
+  unsigned char y[32];
+  memset(y, 0x66, sizeof(y));
+  y[0] = 0x58;
+  if (negative) {
+    y[31] |= 0x80;
+  }
+  curve25519key_from_bytes(b, y);
+}
+
+/* For each vector scalar k, k B + v B + v (-B) + ... with n pairs that
+   cancel out, against curve25519(k, 9) */
+static void
+msm(const char *what, unsigned int n) {
+  unsigned int m = 2 * n + 1, i, j;
+  curve25519key_t *k = malloc(m * sizeof(*k)), *p = malloc(m * sizeof(*p));
+  curve25519key_t *r = malloc(nvectors * sizeof(*r)), *e = malloc(nvectors * sizeof(*e)), nine = { 9 };
+  for (i = 0; i < nvectors; i++) {
+    memcpy(k[0], ve[i], sizeof(*k));
+    curve25519key_setbit(k, C25519USEDBITS, 0);
+    curve25519(e + i, k, &nine);
+    basepoint(p, 0);
+    for (j = 0; j < n; j++) {
+      memcpy(k[2 * j + 1], vk[(i + j) % nvectors], sizeof(*k));
+      memcpy(k[2 * j + 2], vk[(i + j) % nvectors], sizeof(*k));
+      basepoint(p + 2 * j + 1, 0);
+      basepoint(p + 2 * j + 2, 1);
+    }
+    if (curve25519_msm(r + i, k, p, m) < 0) {
+      memset(r + i, 0xff, sizeof(*r));
+    }
+  }
+  check(what, r, e, nvectors);
+  free(k);
+  free(p);
+  free(r);
+  free(e);
+}
+
+/* 32768 B + B + 0 B + ...: enough points for the widest window, whose
+   largest digit is 2^14 */
+static void
+msmwide(unsigned int n) {
+  curve25519key_t *k = calloc(n, sizeof(*k)), *p = malloc(n * sizeof(*p)), r, e, s = { 0 }, nine = { 9 };
+  unsigned int i;
+  for (i = 0; i < n; i++) {
+    basepoint(p + i, 0);
+  }
+  k[0][0] = 32768;
+  k[1][0] = 1;
+  s[0] = 32769;
+  curve25519(&e, &s, &nine);
+  if (curve25519_msm(&r, k, p, n) < 0) {
+    memset(r, 0xff, sizeof(r));
+  }
+  check("curve25519_msm (Pippenger, 2^18 points)", &r, &e, 1);
+  free(k);
+  free(p);
+}
+
+/* Clients that go away without reading their responses, which the
+   daemon then fails to send */
+static int
+hangup(const char *path, unsigned int n) {
+  struct sockaddr_un a;
+  curve25519dmsg_t m;
+  unsigned int i;
+  memset(&a, 0, sizeof(a));
+  a.sun_family = AF_UNIX;
+  strncpy(a.sun_path, path, sizeof(a.sun_path) - 1);
+  memset(&m, 0, sizeof(m));
+  m.op = C25519D_METRICS;
+  for (i = 0; i < n; i++) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((fd < 0) || (connect(fd, (struct sockaddr *)&a, sizeof(a)) < 0) ||
+	(write(fd, &m, sizeof(m)) != sizeof(m))) {
+      if (fd >= 0) {
+	close(fd);
+      }
+      return -1;
+    }
+    close(fd);
+  }
+  return 0;
+}
+
+/* Non-zero if the latency quantiles in the metrics s are all below a
+   second, as they are on a fresh daemon and on the one of make check */
+static int
+latencies(const char *s) {
+  const char *q = "curve25519d_latency_us{quantile=";
+  unsigned int n = 0;
+  while ((s = strstr(s, q))) {
+    s = strchr(s, ' ');
+    if (!s || (strtoull(s, NULL, 10) >= 1000000)) {
+      return 0;
+    }
+    n++;
+  }
+  return n == 3;
+}
+
+/* The vectors through the socket and through rings of a few sizes; the
+   daemon has to survive clients hanging up on it */
+static void
+viadaemon(const char *path, curve25519key_t *base) {
+  static const unsigned int slots[] = { 4, 64, 256 };
+  curve25519key_t *r = malloc(nvectors * sizeof(*r));
+  curve25519d_t *d = curve25519d_connect(path);
+  char what[64], *s;
+  unsigned int i;
+  if (!d) {
+    perror(path);
+    failed = 1;
+    free(r);
+    return;
+  }
+  s = curve25519d_metrics(d);
+  printf("curve25519d_metrics: %s\n", (s && latencies(s)) ? "ok" : "FAILED");
+  if (!s || !latencies(s)) {
+    failed = 1;
+  }
+  free(s);
+  memset(r, 0, nvectors * sizeof(*r));
+  if (curve25519d_compute(d, r, ve, vk, nvectors) < 0) {
+    perror("curve25519d_compute");
+  }
+  check("curve25519d_compute", r, vr, nvectors);
+  memset(r, 0, nvectors * sizeof(*r));
+  if (curve25519d_compute(d, r, ve, NULL, nvectors) < 0) {
+    perror("curve25519d_compute");
+  }
+  check("curve25519d_compute (base)", r, base, nvectors);
+  curve25519d_close(d);
+  for (i = 0; i < sizeof(slots) / sizeof(*slots); i++) {
+    if (!(d = curve25519d_connect(path))) {
+      perror(path);
+      failed = 1;
+      break;
+    }
+    memset(r, 0, nvectors * sizeof(*r));
+    if (curve25519d_compute_ring(d, r, ve, vk, nvectors, slots[i]) < 0) {
+      perror("curve25519d_compute_ring");
+    }
+    sprintf(what, "curve25519d_compute_ring (%u slots)", slots[i]);
+    check(what, r, vr, nvectors);
+    memset(r, 0, nvectors * sizeof(*r));
+    if (curve25519d_compute_ring(d, r, ve, NULL, nvectors, slots[i]) < 0) {
+      perror("curve25519d_compute_ring");
+    }
+    sprintf(what, "curve25519d_compute_ring (%u slots, base)", slots[i]);
+    check(what, r, base, nvectors);
+    curve25519d_close(d);
+  }
+  if (hangup(path, 100) < 0) {
+    perror(path);
+  }
+  d = curve25519d_connect(path);
+  s = d ? curve25519d_metrics(d) : NULL;
+  printf("curve25519d after hangups: %s\n", s ? "ok" : "FAILED");
+  if (!s) {
+    failed = 1;
+  }
+  free(s);
+  if (d) {
+    curve25519d_close(d);
+  }
+  free(r);
+}
+
+/* Chains of two scalar multiplications in projective form, and their
+   validation */
+static void
+proj(void) {
+  curve25519key_t *r = malloc(nvectors * sizeof(*r)), *e = malloc(nvectors * sizeof(*e));
+  curve25519proj_t p;
+  unsigned int i, bad = 0;
+  for (i = 0; i < nvectors; i++) {
+    curve25519key_t *f = ve + (i + 1) % nvectors;
+    curve25519proj_from_key(&p, vk + i);
+    curve25519_proj(&p, ve + i, &p);
+    curve25519_proj(&p, f, &p);
+    curve25519proj_to_key(r + i, &p);
+    curve25519(e + i, f, vr + i);
+    bad += curve25519proj_validate(&p) != curve25519key_validate(e + i);
+  }
+  check("curve25519_proj", r, e, nvectors);
+  printf("curve25519proj_validate: %u%s\n", nvectors, bad ? " FAILED" : " ok");
+  if (bad) {
+    failed = 1;
+  }
+  free(r);
+  free(e);
+}
+
+/* The keys of the vectors, followed by the unsafe ones and others equal
+   to them modulo p, each as curve25519key_validate() finds it */
+static void
+validate(void) {
+  static const char *unsafe[] = {
+    "0000000000000000000000000000000000000000000000000000000000000000",
+    "0100000000000000000000000000000000000000000000000000000000000000",
+    "e0eb7a7c3b41b8ae1656e3faf19fc46ada098deb9c32b1fd866205165f49b800",
+    "5f9c95bca3508c24b1d0b1559c83ef5b04445cc4581c8e86d8224eddd09f1157",
+    "ecffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff7f",
+    "edffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff7f",
+    "eeffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff7f",
+  };
+  unsigned int nu = sizeof(unsafe) / sizeof(*unsafe), n = nvectors + nu, i, bad = 0, rejected;
+  curve25519key_t *x = malloc(n * sizeof(*x));
+  unsigned long long *reject = malloc((n + 63) / 64 * sizeof(*reject));
+  memcpy(x, vk, nvectors * sizeof(*x));
+  for (i = 0; i < nu; i++) {
+    ibh_decode(unsafe[i], x + nvectors + i);
+  }
+  rejected = curve25519key_validate_batch(x, n, reject, 0);
+  for (i = 0; i < n; i++) {
+    int r = (reject[i / 64] >> (i % 64)) & 1;
+    bad += (r == curve25519key_validate(x + i)) || ((i >= nvectors) && !r);
+  }
+  bad += rejected != nu;
+  printf("curve25519key_validate_batch: %u%s\n", n, bad ? " FAILED" : " ok");
+  if (bad) {
+    failed = 1;
+  }
+  free(x);
+  free(reject);
+}
+
+/* Every secret twice, the second time from the cache, then forgotten */
+static void
+cache(void) {
+  curve25519cache_t *c = curve25519cache_new(1 << 20, 0);
+  curve25519key_t *r = malloc(2 * nvectors * sizeof(*r)), *e = malloc(2 * nvectors * sizeof(*e));
+  curve25519cachestats_t st;
+  unsigned int i, hits = 0;
+  for (i = 0; i < 2 * nvectors; i++) {
+    unsigned int j = i % nvectors;
+    hits += curve25519cache_compute(c, j, r + i, ve + j, vk + j);
+    memcpy(e + i, vr + j, sizeof(*e));
+  }
+  for (i = 0; i < nvectors; i++) {
+    curve25519cache_forget(c, i);
+  }
+  curve25519cache_stats(c, &st);
+  if ((hits != nvectors) || (st.entries != 0)) {
+    memset(r, 0, sizeof(*r));
+  }
+  check("curve25519cache_compute", r, e, 2 * nvectors);
+  curve25519cache_free(c);
+  free(r);
+  free(e);
+}
+
+/* Public keys of keypairs from a pool, against curve25519(priv, 9) */
+static void
+keypool(unsigned int n) {
+  curve25519keypool_t *p = curve25519keypool_new(n / 4, n / 2, 1);
+  curve25519key_t *priv = malloc(n * sizeof(*priv)), *pub = malloc(n * sizeof(*pub));
+  curve25519key_t *e = malloc(n * sizeof(*e)), nine = { 9 };
+  unsigned int i;
+  for (i = 0; i < n; i++) {
+    if (!p || (curve25519keypool_get(p, priv + i, pub + i) < 0)) {
+      memset(priv + i, 0, sizeof(*priv));
+      memset(pub + i, 0xff, sizeof(*pub));
+    }
+    curve25519(e + i, priv + i, &nine);
+  }
+  check("curve25519keypool_get", pub, e, n);
+  if (p) {
+    curve25519keypool_free(p);
+  }
+  free(priv);
+  free(pub);
+  free(e);
+}
+
+struct done {
+  unsigned int calls, n;
+  curve25519key_t *r;
+};
+
+static void
+done(void *arg, curve25519key_t *r, unsigned int n) {
+  struct done *d = arg;
+  d->calls++;
+  d->r = r;
+  d->n = n;
+}
+
+/* Jobs of uneven sizes queued together on three threads, so that the
+   chunks split unevenly and get stolen, then strided ones and
+   curve25519pool_run(), against the vectors */
+static void
+pool(unsigned int copies, curve25519key_t *base) {
+  unsigned int n = copies * nvectors, size[5] = { 0, 1, 63, 65, n }, off[5], m = 0, i, k, bad = 0;
+  curve25519pool_t *p = curve25519pool_new(3);
+  curve25519key_t *f = malloc(2 * n * sizeof(*f)), *c = f + n;
+  curve25519key_t *r = calloc(2 * n + 129, sizeof(*r)), *e = malloc((2 * n + 129) * sizeof(*e));
+  curve25519job_t *j[5];
+  struct done d[5];
+  if (!p || !f || !r || !e) {
+    perror("pool");
+    failed = 1;
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    memcpy(f + i, ve + i % nvectors, sizeof(*f));
+    memcpy(c + i, vk + i % nvectors, sizeof(*c));
+  }
+  for (k = 0; k < 5; k++) {
+    off[k] = m;
+    for (i = 0; i < size[k]; i++) {
+      memcpy(e + m++, vr + i % nvectors, sizeof(*e));
+    }
+  }
+  memset(d, 0, sizeof(d));
+  for (k = 0; k < 5; k++) {
+    j[k] = curve25519pool_submit(p, r + off[k], f, c, size[k], done, d + k);
+    if (!j[k]) {
+      bad++;
+      continue;
+    }
+    /* An empty job is done before it is even returned */
+    if ((k == 0) && (!curve25519job_ready(j[k]) || (d[k].calls != 1))) {
+      bad++;
+    }
+  }
+  while (j[4] && !curve25519job_ready(j[4])) {
+    usleep(1000);
+  }
+  for (k = 0; k < 5; k++) {
+    if (j[k]) {
+      curve25519job_wait(j[k]);
+    }
+    bad += (d[k].calls != 1) || (d[k].r != r + off[k]) || (d[k].n != size[k]);
+  }
+  if (bad) {
+    memset(r, 0, sizeof(*r));
+  }
+  check("curve25519pool_submit", r, e, m);
+
+  /* Interleaved private and public keys in, base and shared keys out */
+  for (i = 0; i < n; i++) {
+    memcpy(r + 2 * i, ve + i % nvectors, sizeof(*r));
+    memcpy(r + 2 * i + 1, vk + i % nvectors, sizeof(*r));
+    memcpy(e + 2 * i, base + i % nvectors, sizeof(*e));
+    memcpy(e + 2 * i + 1, vr + i % nvectors, sizeof(*e));
+  }
+  memcpy(f, r, 2 * n * sizeof(*f));
+  memset(r, 0, 2 * n * sizeof(*r));
+  j[0] = curve25519pool_submit_stride(p, r, 2, f, 2, NULL, 0, n, NULL, NULL);
+  j[1] = curve25519pool_submit_stride(p, r + 1, 2, f, 2, f + 1, 2, n, NULL, NULL);
+  for (k = 0; k < 2; k++) {
+    if (j[k]) {
+      curve25519job_wait(j[k]);
+    }
+  }
+  check("curve25519pool_submit_stride", r, e, 2 * n);
+
+  memset(r, 0, n * sizeof(*r));
+  for (i = 0; i < n; i++) {
+    memcpy(f + i, ve + i % nvectors, sizeof(*f));
+    memcpy(c + i, vk + i % nvectors, sizeof(*c));
+    memcpy(e + i, vr + i % nvectors, sizeof(*e));
+  }
+  if (curve25519pool_run(p, r, f, c, n) < 0) {
+    perror("curve25519pool_run");
+  }
+  check("curve25519pool_run", r, e, n);
+  curve25519pool_free(p);
+  free(f);
+  free(r);
+  free(e);
+}
+
+/* Writes copies of the vectors to a key file of records of one or two
+   keys; returns 0, or -1 */
+static int
+writekeys(const char *file, unsigned int keys, unsigned int copies, int flags) {
+  unsigned char h[C25519FILEHEADER], b[64];
+  unsigned int s = curve25519file_header(h, keys, (unsigned long long)copies * nvectors, flags), i;
+  FILE *f = fopen(file, "w");
+  if (!f) {
+    return -1;
+  }
+  fwrite(h, 1, sizeof(h), f);
+  memset(b, 0, sizeof(b));
+  for (i = 0; i < copies * nvectors; i++) {
+    curve25519key_to_bytes(b, ve + i % nvectors);
+    if (keys == 2) {
+      curve25519key_to_bytes(b + 32, vk + i % nvectors);
+    }
+    fwrite(b, 1, s, f);
+  }
+  return (fclose(f) == 0) ? 0 : -1;
+}
+
+/* Checks the n results of file against e[i % nvectors], and its header */
+static void
+readresults(const char *what, const char *file, curve25519key_t *e, unsigned int n, int flags) {
+  unsigned char h[C25519FILEHEADER], g[C25519FILEHEADER], b[64];
+  unsigned int s = curve25519file_header(g, 1, n, flags), i;
+  curve25519key_t *r = calloc(n, sizeof(*r)), *x = malloc(n * sizeof(*x));
+  FILE *f = fopen(file, "r");
+  if (f && (fread(h, 1, sizeof(h), f) == sizeof(h)) && !memcmp(h, g, sizeof(h))) {
+    for (i = 0; (i < n) && (fread(b, 1, s, f) == s); i++) {
+      curve25519key_from_bytes(r + i, b);
+    }
+  }
+  if (f) {
+    fclose(f);
+  }
+  for (i = 0; i < n; i++) {
+    memcpy(x + i, e + i % nvectors, sizeof(*x));
+  }
+  check(what, r, x, n);
+  free(r);
+  free(x);
+}
+
+/* Copies of the vectors through key files of both kinds, processed in
+   place with and without a pool; then files that must be rejected */
+static void
+keyfile(unsigned int copies, curve25519key_t *base) {
+  static const struct {
+    const char *what;
+    unsigned int keys;
+    int flags, pool;
+  } runs[] = {
+    { "curve25519file_process (pairs)", 2, 0, 1 },
+    { "curve25519file_process (pairs, aligned, no pool)", 2, C25519FILE_ALIGN, 0 },
+    { "curve25519file_process (private keys)", 1, 0, 1 },
+    { "curve25519file_process (private keys, aligned, no pool)", 1, C25519FILE_ALIGN, 0 },
+  };
+  /* The byte 0x7f at these offsets, or the last byte cut off */
+  static const long corrupt[] = { 0, 8, 16, -1 };
+  char in[] = "/tmp/curve25519test.XXXXXX", out[] = "/tmp/curve25519test.XXXXXX";
+  curve25519pool_t *p = curve25519pool_new(2);
+  unsigned int n = copies * nvectors, i, bad = 0;
+  int fi = mkstemp(in), fo = mkstemp(out);
+  if ((fi < 0) || (fo < 0) || !p) {
+    perror("keyfile");
+    failed = 1;
+    return;
+  }
+  close(fi);
+  close(fo);
+  for (i = 0; i < sizeof(runs) / sizeof(*runs); i++) {
+    if ((writekeys(in, runs[i].keys, copies, runs[i].flags) < 0) ||
+	(curve25519file_process(in, out, runs[i].pool ? p : NULL, runs[i].flags) != n)) {
+      perror(runs[i].what);
+    }
+    readresults(runs[i].what, out, (runs[i].keys == 2) ? vr : base, n, runs[i].flags);
+  }
+  /* A bad magic, version and record size, and a truncated file */
+  for (i = 0; i < sizeof(corrupt) / sizeof(*corrupt); i++) {
+    FILE *f;
+    writekeys(in, 2, copies, 0);
+    if (corrupt[i] < 0) {
+      bad += truncate(in, C25519FILEHEADER + 64 * n - 1) < 0;
+    } else if ((f = fopen(in, "r+"))) {
+      fseek(f, corrupt[i], SEEK_SET);
+      fputc(0x7f, f);
+      fclose(f);
+    }
+    bad += (curve25519file_process(in, out, p, 0) != -1) || (errno != EINVAL);
+  }
+  printf("curve25519file_process (bad files): %u%s\n", i, bad ? " FAILED" : " ok");
+  if (bad) {
+    failed = 1;
+  }
+  unlink(in);
+  unlink(out);
+  curve25519pool_free(p);
+}
+
+/* In a build with C25519_STATS, the counts of curve25519() over the
+   vectors, then all zero after a reset; nothing otherwise */
+static void
+stats(void) {
+  curve25519stats_t s;
+  curve25519key_t r;
+  unsigned int i, j, bad = 0;
+  curve25519_stats_reset();
+  for (i = 0; i < nvectors; i++) {
+    curve25519(&r, ve + i, vk + i);
+  }
+  if (curve25519_stats_snapshot(&s) < 0) {
+    return;
+  }
+  bad += (s.count[C25519PHASE_CURVE25519] != nvectors) || (s.time[C25519PHASE_CURVE25519] == 0);
+  for (i = 0; i < C25519OPS; i++) {
+    bad += (s.ops[i] == 0);
+  }
+  curve25519_stats_reset();
+  curve25519_stats_snapshot(&s);
+  for (i = 0; i < C25519OPS; i++) {
+    bad += (s.ops[i] != 0);
+  }
+  for (i = 0; i < C25519PHASES; i++) {
+    bad += (s.count[i] != 0) || (s.time[i] != 0);
+    for (j = 0; j < C25519STATSBUCKETS; j++) {
+      bad += (s.hist[i][j] != 0);
+    }
+  }
+  printf("curve25519_stats_snapshot: %u%s\n", nvectors, bad ? " FAILED" : " ok");
+  if (bad) {
+    failed = 1;
+  }
+}
+
+static int
+base32(const char *s, curve25519key_t *x) {
+  base32_decode(s, x);
+  return 0;
+}
+
+/* The bulk encoders of each text form, for n that are not multiples of
+   anything, against the single-key ones and back through the decoders;
+   then the byte conversions */
+static void
+codecs(void) {
+  static const struct {
+    const char *what;
+    size_t (*encode_n)(char *, curve25519key_t *, unsigned int);
+    void (*encode)(char *, curve25519key_t *);
+    int (*decode)(const char *, curve25519key_t *);
+  } form[] = {
+    { "hex_encode_n", hex_encode_n, hex_encode, hex_decode },
+    { "ibh_encode_n", ibh_encode_n, ibh_encode, ibh_decode },
+    { "base32_encode_n", base32_encode_n, base32_encode, base32 },
+  };
+  unsigned int ns[] = { 1, 3, 5, 7, nvectors }, i, j, k, m;
+  char *s = malloc(65 * nvectors), t[65];
+  unsigned char *b = malloc(32 * nvectors), c[32];
+  curve25519key_t *r = malloc(5 * nvectors * sizeof(*r)), *e = malloc(5 * nvectors * sizeof(*e));
+  for (k = 0; k < sizeof(form) / sizeof(*form); k++) {
+    m = 0;
+    for (j = 0; j < 5; j++) {
+      size_t len = form[k].encode_n(s, ve, ns[j]);
+      char *l = s;
+      for (i = 0; i < ns[j]; i++, m++) {
+	char *nl = memchr(l, '\n', s + len - l);
+	memcpy(e + m, ve + i, sizeof(*e));
+	memset(r + m, 0, sizeof(*r));
+	form[k].encode(t, ve + i);
+	if (nl && (nl - l == strlen(t)) && !memcmp(l, t, nl - l)) {
+	  *nl = 0;
+	  form[k].decode(l, r + m);
+	  l = nl + 1;
+	} else {
+	  break;
+	}
+      }
+      if (l != s + len) {
+	memset(r + m - i, 0xff, sizeof(*r));
+      }
+    }
+    check(form[k].what, r, e, m);
+  }
+  m = 0;
+  for (j = 0; j < 5; j++) {
+    curve25519key_to_bytes_n(b, ve, ns[j]);
+    curve25519key_from_bytes_n(r + m, b, ns[j]);
+    for (i = 0; i < ns[j]; i++, m++) {
+      memcpy(e + m, ve + i, sizeof(*e));
+      curve25519key_to_bytes(c, ve + i);
+      if (memcmp(b + 32 * i, c, 32)) {
+	memset(r + m, 0xff, sizeof(*r));
+      }
+    }
+  }
+  check("curve25519key_to_bytes_n", r, e, m);
+  free(s);
+  free(b);
+  free(r);
+  free(e);
+}
+
+/* Characters that are not digits, short and odd-length input, and upper
+   case, which base32 and hex take like lower case */
+static void
+badcodecs(void) {
+  static const char *nothex[] = { "g", "12 34", "0x12", "-1", "12\n" };
+  static const unsigned int at[] = { 0, 1, 31, 62, 63 };
+  curve25519key_t x, y;
+  char t[66];
+  unsigned int i, n = 0, bad = 0;
+  for (i = 0; i < sizeof(nothex) / sizeof(*nothex); i++, n++) {
+    bad += (hex_decode(nothex[i], &x) != -1);
+  }
+  for (i = 0; i < sizeof(at) / sizeof(*at); i++, n++) {
+    ibh_encode(t, ve);
+    t[at[i]] = 'g';
+    bad += (ibh_decode(t, &x) != -1);
+  }
+  /* 63 digits, then 65 of which the first is ignored */
+  ibh_encode(t, ve);
+  t[63] = 0;
+  bad += (ibh_decode(t, &x) != -1);
+  t[0] = '1';
+  hex_encode(t + 1, ve);
+  bad += (hex_decode(t, &x) != 0) || memcmp(x, ve, sizeof(x));
+  /* Three digits: the bytes 0xbc and 0x0a */
+  memset(y, 0, sizeof(y));
+  y[0] = 0xabc;
+  bad += (hex_decode("abc", &x) != 0) || memcmp(x, y, sizeof(x));
+  hex_encode(t, ve + 1);
+  for (i = 0; t[i]; i++) {
+    t[i] = toupper((unsigned char)t[i]);
+  }
+  bad += (hex_decode(t, &x) != 0) || memcmp(x, ve + 1, sizeof(x));
+  base32_encode(t, ve + 1);
+  for (i = 0; t[i]; i++) {
+    t[i] = toupper((unsigned char)t[i]);
+  }
+  base32_decode(t, &x);
+  bad += memcmp(x, ve + 1, sizeof(x)) != 0;
+  n += 5;
+  printf("hex_decode, ibh_decode and base32_decode (bad input): %u%s\n", n, bad ? " FAILED" : " ok");
+  if (bad) {
+    failed = 1;
+  }
+}
+
+static void
+vectors(const char *path) {
+  curve25519key_t *r = malloc(nvectors * sizeof(*r)), *e = malloc(nvectors * sizeof(*e)), nine = { 9 };
+  unsigned int i;
+  for (i = 0; i < nvectors; i++) {
+    curve25519(r + i, ve + i, vk + i);
+  }
+  check("curve25519", r, vr, nvectors);
+  /* In groups of four on the AVX2 ladder, when available */
+  memset(r, 0, nvectors * sizeof(*r));
+  curve25519_batch(r, ve, vk, nvectors);
+#ifdef C25519_AVX2
+  check(curve25519avx2_available() ? "curve25519_batch (AVX2)" : "curve25519_batch", r, vr, nvectors);
 #else
-  for (i = 0;i < 32;++i) printf("%02x",(unsigned int) curve25519key_getbyte(e,i)); printf(" ");
-  for (i = 0;i < 32;++i) printf("%02x",(unsigned int) curve25519key_getbyte(k, i)); printf(" ");
-  curve25519(ek,e,k);
-  for (i = 0;i < 32;++i) printf("%02x",(unsigned int) curve25519key_getbyte(ek, i)); printf("\n");
+  check("curve25519_batch", r, vr, nvectors);
 #endif
+  /* The first private key with all the public ones */
+  memset(r, 0, nvectors * sizeof(*r));
+  curve25519_one_to_many(r, ve, vk, nvectors);
+  for (i = 0; i < nvectors; i++) {
+    curve25519(e + i, ve, vk + i);
+  }
+  check("curve25519_one_to_many", r, e, nvectors);
+  for (i = 0; i < nvectors; i++) {
+    curve25519_base(r + i, ve + i);
+    curve25519(e + i, ve + i, &nine);
+  }
+  check("curve25519_base", r, e, nvectors);
+  codecs();
+  badcodecs();
+  proj();
+  validate();
+  cache();
+  keypool(100);
+  pool(10, e);
+  keyfile(10, e);
+  if (path) {
+    viadaemon(path, e);
+  }
+  free(r);
+  free(e);
+  msm("curve25519_msm (Straus)", 20);
+  msm("curve25519_msm (Pippenger)", 100);
+  msmwide(1 << 18);
+  stats();
 }
 
-curve25519key_t e1k, e2k, e1e2k, e2e1k;
-curve25519key_t e1 = {3};
-curve25519key_t e2 = {5};
-curve25519key_t k = {9};
+static int
+usage(void) {
+  fprintf(stderr,
+	  "Usage:\n"
+	  "  curve25519test [--count N]\n"
+	  "  curve25519test --digest [--count N] [--save FILE [--interval N]]\n"
+	  "  curve25519test --digest [--count N] --load FILE [--threads N]\n"
+	  "  curve25519test --vectors FILE [--daemon PATH]\n");
+  return EXIT_FAILURE;
+}
 
 int
-main() {
-  int loop;
-  int i;
+main(int argc, char **argv) {
+  const char *savefile = NULL, *loadfile = NULL, *vectorfile = NULL, *daemonpath = NULL;
+  unsigned long long interval = 1000000, p;
+  unsigned int threads = 1, i;
+  int digest = 0;
+  state_t s;
+
+  for (i = 1; i < (unsigned int)argc; i++) {
+    if (!strcmp(argv[i], "--digest")) {
+      digest = 1;
+    } else if (!strcmp(argv[i], "--count") && (i + 1 < (unsigned int)argc)) {
+      count = strtoull(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--save") && (i + 1 < (unsigned int)argc)) {
+      savefile = argv[++i];
+    } else if (!strcmp(argv[i], "--interval") && (i + 1 < (unsigned int)argc)) {
+      interval = strtoull(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--load") && (i + 1 < (unsigned int)argc)) {
+      loadfile = argv[++i];
+    } else if (!strcmp(argv[i], "--threads") && (i + 1 < (unsigned int)argc)) {
+      threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--vectors") && (i + 1 < (unsigned int)argc)) {
+      vectorfile = argv[++i];
+    } else if (!strcmp(argv[i], "--daemon") && (i + 1 < (unsigned int)argc)) {
+      daemonpath = argv[++i];
+    } else {
+      return usage();
+    }
+  }
+  if ((!digest && (savefile || loadfile)) || (savefile && loadfile) || (daemonpath && !vectorfile) ||
+      (interval == 0) || (threads == 0)) {
+    return usage();
+  }
+
+  if (vectorfile) {
+    if (digest) {
+      return usage();
+    }
+    if (readvectors(vectorfile) < 0) {
+      exit(EXIT_FAILURE);
+    }
+    vectors(daemonpath);
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+
+  init(&s);
+  if (!digest) {
+    char b[OUTPUT];
+    while (s.n < count) {
+      long l = iterate(b, &s);
+      fwrite(b, 1, (l < 0) ? ~l : l, stdout);
+    }
+    exit(EXIT_SUCCESS);
+  }
+
+  for (p = 10; p <= count; p *= 10) {
+    reports[nreports++] = p;
+    if (p > count / 10) {
+      break;
+    }
+  }
+  if ((nreports == 0) || (reports[nreports - 1] != count)) {
+    reports[nreports++] = count;
+  }
+
+  if (loadfile) {
+    FILE *f = fopen(loadfile, "r");
+    pthread_t *t;
+    state_t c;
+    if (!f) {
+      perror(loadfile);
+      exit(EXIT_FAILURE);
+    }
+    checkpoints = malloc(sizeof(*checkpoints));
+    checkpoints[ncheckpoints++] = s;
+    while (load(f, &c) == 0) {
+      if (c.n <= checkpoints[ncheckpoints - 1].n) {
+	fprintf(stderr, "%s: checkpoints out of order\n", loadfile);
+	exit(EXIT_FAILURE);
+      }
+      checkpoints = realloc(checkpoints, (ncheckpoints + 1) * sizeof(*checkpoints));
+      checkpoints[ncheckpoints++] = c;
+    }
+    if (!feof(f)) {
+      fprintf(stderr, "%s: bad checkpoint after %llu\n", loadfile, checkpoints[ncheckpoints - 1].n);
+      exit(EXIT_FAILURE);
+    }
+    fclose(f);
+    t = malloc(threads * sizeof(*t));
+    for (i = 0; i < threads; i++) {
+      pthread_create(t + i, NULL, worker, NULL);
+    }
+    for (i = 0; i < threads; i++) {
+      pthread_join(t[i], NULL);
+    }
+    free(t);
+    free(checkpoints);
+  } else {
+    FILE *f = NULL;
+    if (savefile && !(f = fopen(savefile, "w"))) {
+      perror(savefile);
+      exit(EXIT_FAILURE);
+    }
+    if (run(&s, count, f, interval) < 0) {
+      fprintf(stderr, "fail\n");
+      failed = 1;
+    }
+    if (f && (fclose(f) != 0)) {
+      perror(savefile);
+      exit(EXIT_FAILURE);
+    }
+  }
 
-  for (loop = 0;loop < 1000000000;++loop) {
-    doit(&e1k,&e1,&k);
-    doit(&e2e1k,&e2,&e1k);
-    doit(&e2k,&e2,&k);
-    doit(&e1e2k,&e1,&e2k);
-    for (i = 0;i < C25519N; ++i) {
-      if (e1e2k[i] != e2e1k[i]) {
-	printf("fail\n");
+  for (i = 0; i < nreports; i++) {
+    unsigned int j;
+    const char *r = "";
+    for (j = 1, p = 10; j < KNOWN; j++, p *= 10) {
+      if (p == reports[i]) {
+	if (strcmp(known[j], digests[i])) {
+	  r = " FAILED";
+	  failed = 1;
+	} else {
+	  r = " ok";
+	}
       }
     }
-    for (i = 0;i < C25519N; ++i) e1[i] ^= e2k[i];
-    for (i = 0;i < C25519N; ++i) e2[i] ^= e1k[i];
-    for (i = 0;i < C25519N; ++i) k[i] ^= e1e2k[i];
+    printf("%llu %s%s\n", reports[i], digests[i], r);
   }
-  exit(EXIT_SUCCESS);
+  exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
 }
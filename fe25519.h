@@ -0,0 +1,558 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Arithmetic modulo p = 2^255 - 19, internal to the library.
+ *
+ * Two backends are available, selected at build time:
+ *
+ * - GMP (default): field elements are curve25519key_t values, reduced
+ *   lazily: any value in [0, 2^256) is allowed, a carry out of the top
+ *   limb being added back as 2^256 = 38 (mod p), so that no operation
+ *   compares against p.  Every operation goes through mpn_* calls,
+ *   except the multiplications on x86-64 processors with MULX and ADX
+ *   (curve25519mulx.h).
+ *
+ * - FE51 (C25519_FE51 defined): field elements are five 51-bit limbs in
+ *   uint64_t words, products are computed with unsigned __int128 and
+ *   carries are only propagated by the multiplicative operations.
+ *
+ * All operations work in place: addmodp(a, b) computes a = a + b.
+ * loadmodp()/storemodp() convert from and to the key representation;
+ * storemodp() always produces the canonical value in [0, p).
+ *
+ * fe25519.hh has the same arithmetic as a C++ template, for the ladder
+ * of 'make CXX25519=1'.
+ */
+
+#ifndef __CURVE25519LIB_FE25519_H__
+#define __CURVE25519LIB_FE25519_H__
+
+#include "curve25519.h"
+#include "stats25519.h"
+#include "curve25519safegcd.h"
+
+#ifdef C25519_FE51
+
+#include <stdint.h>
+
+typedef uint64_t fe25519[5];
+
+#define FE51MASK ((((uint64_t)1)<<51) - 1)
+
+static inline void
+copymodp(fe25519 *n, fe25519 *x) {
+  n[0][0] = x[0][0];
+  n[0][1] = x[0][1];
+  n[0][2] = x[0][2];
+  n[0][3] = x[0][3];
+  n[0][4] = x[0][4];
+}
+
+static inline void
+setmodp(fe25519 *a, unsigned int v) {
+  a[0][0] = v;
+  a[0][1] = 0;
+  a[0][2] = 0;
+  a[0][3] = 0;
+  a[0][4] = 0;
+}
+
+/* a = b if v is 1, unchanged if v is 0, without branching on v */
+static inline void
+cmovmodp(fe25519 *a, fe25519 *b, unsigned int v) {
+  uint64_t m = -(uint64_t)v;
+  a[0][0] ^= (a[0][0] ^ b[0][0]) & m;
+  a[0][1] ^= (a[0][1] ^ b[0][1]) & m;
+  a[0][2] ^= (a[0][2] ^ b[0][2]) & m;
+  a[0][3] ^= (a[0][3] ^ b[0][3]) & m;
+  a[0][4] ^= (a[0][4] ^ b[0][4]) & m;
+}
+
+/* Exchanges a and b if v is 1, without branching on v */
+static inline void
+cswapmodp(fe25519 *a, fe25519 *b, unsigned int v) {
+  uint64_t m = -(uint64_t)v, t;
+  int i;
+  for (i = 0; i < 5; i++) {
+    t = (a[0][i] ^ b[0][i]) & m;
+    a[0][i] ^= t;
+    b[0][i] ^= t;
+  }
+}
+
+/* Propagates carries, so that the result can be subtracted again */
+static inline void
+carrymodp(fe25519 *a) {
+  a[0][1] += a[0][0] >> 51; a[0][0] &= FE51MASK;
+  a[0][2] += a[0][1] >> 51; a[0][1] &= FE51MASK;
+  a[0][3] += a[0][2] >> 51; a[0][2] &= FE51MASK;
+  a[0][4] += a[0][3] >> 51; a[0][3] &= FE51MASK;
+  a[0][0] += 19 * (a[0][4] >> 51); a[0][4] &= FE51MASK;
+}
+
+/* The whole 256-bit key is taken modulo p: bit 255 counts as 2^255 = 19 */
+static inline void
+loadmodp(fe25519 *a, curve25519key_t *k) {
+  uint64_t k0 = k[0][0], k1 = k[0][1], k2 = k[0][2], k3 = k[0][3];
+  a[0][0] = (k0 & FE51MASK) + 19 * (k3 >> 63);
+  a[0][1] = ((k0 >> 51) | (k1 << 13)) & FE51MASK;
+  a[0][2] = ((k1 >> 38) | (k2 << 26)) & FE51MASK;
+  a[0][3] = ((k2 >> 25) | (k3 << 39)) & FE51MASK;
+  a[0][4] = (k3 >> 12) & FE51MASK;
+}
+
+static inline void
+storemodp(curve25519key_t *k, fe25519 *a) {
+  uint64_t t0 = a[0][0], t1 = a[0][1], t2 = a[0][2], t3 = a[0][3], t4 = a[0][4];
+  uint64_t q;
+  int i;
+  for (i = 0; i < 2; i++) {
+    t1 += t0 >> 51; t0 &= FE51MASK;
+    t2 += t1 >> 51; t1 &= FE51MASK;
+    t3 += t2 >> 51; t2 &= FE51MASK;
+    t4 += t3 >> 51; t3 &= FE51MASK;
+    t0 += 19 * (t4 >> 51); t4 &= FE51MASK;
+  }
+  /* Now t < 2^255; q = 1 iff t >= p */
+  q = (t0 + 19) >> 51;
+  q = (t1 + q) >> 51;
+  q = (t2 + q) >> 51;
+  q = (t3 + q) >> 51;
+  q = (t4 + q) >> 51;
+  t0 += 19 * q;
+  t1 += t0 >> 51; t0 &= FE51MASK;
+  t2 += t1 >> 51; t1 &= FE51MASK;
+  t3 += t2 >> 51; t2 &= FE51MASK;
+  t4 += t3 >> 51; t3 &= FE51MASK;
+  t4 &= FE51MASK;
+  k[0][0] = t0 | (t1 << 51);
+  k[0][1] = (t1 >> 13) | (t2 << 38);
+  k[0][2] = (t2 >> 26) | (t3 << 25);
+  k[0][3] = (t3 >> 39) | (t4 << 12);
+}
+
+/* Limbs may grow up to 2^54 between multiplications; carries are
+   propagated only by mulmodp and mulasmall */
+static inline void
+addmodp(fe25519 *a, fe25519 *b) {
+  C25519COUNT(ADD);
+  a[0][0] += b[0][0];
+  a[0][1] += b[0][1];
+  a[0][2] += b[0][2];
+  a[0][3] += b[0][3];
+  a[0][4] += b[0][4];
+}
+
+/* a + 4p - b, so that no limb underflows as long as b < 2^53 */
+static inline void
+submodp(fe25519 *a, fe25519 *b) {
+  C25519COUNT(SUB);
+  a[0][0] = (a[0][0] + 0x1fffffffffffb4) - b[0][0];
+  a[0][1] = (a[0][1] + 0x1ffffffffffffc) - b[0][1];
+  a[0][2] = (a[0][2] + 0x1ffffffffffffc) - b[0][2];
+  a[0][3] = (a[0][3] + 0x1ffffffffffffc) - b[0][3];
+  a[0][4] = (a[0][4] + 0x1ffffffffffffc) - b[0][4];
+}
+
+static inline void
+mulmodp(fe25519 *a, fe25519 *b) {
+  C25519COUNT(MUL);
+  typedef unsigned __int128 u128;
+  uint64_t a0 = a[0][0], a1 = a[0][1], a2 = a[0][2], a3 = a[0][3], a4 = a[0][4];
+  uint64_t b0 = b[0][0], b1 = b[0][1], b2 = b[0][2], b3 = b[0][3], b4 = b[0][4];
+  uint64_t b1_19 = b1 * 19, b2_19 = b2 * 19, b3_19 = b3 * 19, b4_19 = b4 * 19;
+  u128 t0, t1, t2, t3, t4;
+  uint64_t c;
+
+  t0 = (u128)a0 * b0 + (u128)a1 * b4_19 + (u128)a2 * b3_19 + (u128)a3 * b2_19 + (u128)a4 * b1_19;
+  t1 = (u128)a0 * b1 + (u128)a1 * b0 + (u128)a2 * b4_19 + (u128)a3 * b3_19 + (u128)a4 * b2_19;
+  t2 = (u128)a0 * b2 + (u128)a1 * b1 + (u128)a2 * b0 + (u128)a3 * b4_19 + (u128)a4 * b3_19;
+  t3 = (u128)a0 * b3 + (u128)a1 * b2 + (u128)a2 * b1 + (u128)a3 * b0 + (u128)a4 * b4_19;
+  t4 = (u128)a0 * b4 + (u128)a1 * b3 + (u128)a2 * b2 + (u128)a3 * b1 + (u128)a4 * b0;
+
+  t1 += (uint64_t)(t0 >> 51); a0 = (uint64_t)t0 & FE51MASK;
+  t2 += (uint64_t)(t1 >> 51); a1 = (uint64_t)t1 & FE51MASK;
+  t3 += (uint64_t)(t2 >> 51); a2 = (uint64_t)t2 & FE51MASK;
+  t4 += (uint64_t)(t3 >> 51); a3 = (uint64_t)t3 & FE51MASK;
+  c = (uint64_t)(t4 >> 51); a4 = (uint64_t)t4 & FE51MASK;
+  a0 += c * 19;
+  a1 += a0 >> 51; a0 &= FE51MASK;
+
+  a[0][0] = a0; a[0][1] = a1; a[0][2] = a2; a[0][3] = a3; a[0][4] = a4;
+}
+
+/* n squarings, with the limbs kept in local variables throughout: each
+   cross product is computed once, doubled through d0, d1 and d4 */
+static inline void
+fe51sqrnmodp(fe25519 *a, unsigned int n) {
+  typedef unsigned __int128 u128;
+  uint64_t a0 = a[0][0], a1 = a[0][1], a2 = a[0][2], a3 = a[0][3], a4 = a[0][4];
+  uint64_t d0, d1, d2, d4, a4_19, c;
+  u128 t0, t1, t2, t3, t4;
+
+  while (n--) {
+    d0 = a0 * 2; d1 = a1 * 2; d2 = a2 * 2 * 19;
+    a4_19 = a4 * 19; d4 = a4_19 * 2;
+
+    t0 = (u128)a0 * a0 + (u128)d4 * a1 + (u128)d2 * a3;
+    t1 = (u128)d0 * a1 + (u128)d4 * a2 + (u128)a3 * (a3 * 19);
+    t2 = (u128)d0 * a2 + (u128)a1 * a1 + (u128)d4 * a3;
+    t3 = (u128)d0 * a3 + (u128)d1 * a2 + (u128)a4 * a4_19;
+    t4 = (u128)d0 * a4 + (u128)d1 * a3 + (u128)a2 * a2;
+
+    t1 += (uint64_t)(t0 >> 51); a0 = (uint64_t)t0 & FE51MASK;
+    t2 += (uint64_t)(t1 >> 51); a1 = (uint64_t)t1 & FE51MASK;
+    t3 += (uint64_t)(t2 >> 51); a2 = (uint64_t)t2 & FE51MASK;
+    t4 += (uint64_t)(t3 >> 51); a3 = (uint64_t)t3 & FE51MASK;
+    c = (uint64_t)(t4 >> 51); a4 = (uint64_t)t4 & FE51MASK;
+    a0 += c * 19;
+    a1 += a0 >> 51; a0 &= FE51MASK;
+  }
+
+  a[0][0] = a0; a[0][1] = a1; a[0][2] = a2; a[0][3] = a3; a[0][4] = a4;
+}
+
+static inline void
+sqrmodp(fe25519 *a) {
+  C25519COUNT(SQR);
+  fe51sqrnmodp(a, 1);
+}
+
+/* n squarings in a row: a = a ** (2^n) */
+static inline void
+sqrnmodp(fe25519 *a, unsigned int n) {
+  C25519COUNTN(SQR, n);
+  fe51sqrnmodp(a, n);
+}
+
+static inline void
+mulasmall(fe25519 *a) {
+  C25519COUNT(MULASMALL);
+  typedef unsigned __int128 u128;
+  const uint64_t s = 121665; /* (486662 - 2) / 4; */
+  u128 t0 = (u128)a[0][0] * s, t1 = (u128)a[0][1] * s, t2 = (u128)a[0][2] * s;
+  u128 t3 = (u128)a[0][3] * s, t4 = (u128)a[0][4] * s;
+  uint64_t c;
+  t1 += (uint64_t)(t0 >> 51); a[0][0] = (uint64_t)t0 & FE51MASK;
+  t2 += (uint64_t)(t1 >> 51); a[0][1] = (uint64_t)t1 & FE51MASK;
+  t3 += (uint64_t)(t2 >> 51); a[0][2] = (uint64_t)t2 & FE51MASK;
+  t4 += (uint64_t)(t3 >> 51); a[0][3] = (uint64_t)t3 & FE51MASK;
+  c = (uint64_t)(t4 >> 51); a[0][4] = (uint64_t)t4 & FE51MASK;
+  a[0][0] += c * 19;
+}
+
+/* a = a * 121665 + b, as mulasmall(a); addmodp(a, b) but carried once */
+static inline void
+mulasmalladdmodp(fe25519 *a, fe25519 *b) {
+  C25519COUNT(MULASMALL);
+  C25519COUNT(ADD);
+  typedef unsigned __int128 u128;
+  const uint64_t s = 121665; /* (486662 - 2) / 4; */
+  u128 t0 = (u128)a[0][0] * s + b[0][0], t1 = (u128)a[0][1] * s + b[0][1];
+  u128 t2 = (u128)a[0][2] * s + b[0][2], t3 = (u128)a[0][3] * s + b[0][3];
+  u128 t4 = (u128)a[0][4] * s + b[0][4];
+  uint64_t c;
+  t1 += (uint64_t)(t0 >> 51); a[0][0] = (uint64_t)t0 & FE51MASK;
+  t2 += (uint64_t)(t1 >> 51); a[0][1] = (uint64_t)t1 & FE51MASK;
+  t3 += (uint64_t)(t2 >> 51); a[0][2] = (uint64_t)t2 & FE51MASK;
+  t4 += (uint64_t)(t3 >> 51); a[0][3] = (uint64_t)t3 & FE51MASK;
+  c = (uint64_t)(t4 >> 51); a[0][4] = (uint64_t)t4 & FE51MASK;
+  a[0][0] += c * 19;
+}
+
+#else /* GMP backend */
+
+#include <gmp.h>
+#include "curve25519mulx.h"
+
+typedef mp_limb_t fe25519[C25519N];
+
+#if GMP_LIMB_BITS == 32
+static const fe25519 p25519 = { 0xffffffed, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0x7fffffff };
+#elif GMP_LIMB_BITS == 64
+static const fe25519 p25519 = { 0xffffffffffffffed, 0xffffffffffffffff, 0xffffffffffffffff, 0x7fffffffffffffff };
+#else
+#error "GMP_LIMBS_BITS not supported for this architecture"
+#endif
+
+static inline void
+copymodp(fe25519 *n, fe25519 *x) {
+  int c;
+  for (c = 0; c < C25519N; c++) {
+    n[0][c] = x[0][c];
+  }
+}
+
+static inline void
+setmodp(fe25519 *a, unsigned int v) {
+  int c;
+  a[0][0] = v;
+  for (c = 1; c < C25519N; c++) {
+    a[0][c] = 0;
+  }
+}
+
+static inline void
+cmovmodp(fe25519 *a, fe25519 *b, unsigned int v) {
+  mp_limb_t m = -(mp_limb_t)v;
+  int c;
+  for (c = 0; c < C25519N; c++) {
+    a[0][c] ^= (a[0][c] ^ b[0][c]) & m;
+  }
+}
+
+static inline void
+cswapmodp(fe25519 *a, fe25519 *b, unsigned int v) {
+  mp_limb_t m = -(mp_limb_t)v, t;
+  int c;
+  for (c = 0; c < C25519N; c++) {
+    t = (a[0][c] ^ b[0][c]) & m;
+    a[0][c] ^= t;
+    b[0][c] ^= t;
+  }
+}
+
+#define C25519TOPLIMBBIT (((mp_limb_t)1) << (GMP_LIMB_BITS - 1))
+
+/* Nothing to carry: the limbs are saturated */
+static inline void
+carrymodp(fe25519 *a) {
+}
+
+/* Any 256-bit key is a valid value as it is */
+static inline void
+loadmodp(fe25519 *a, curve25519key_t *k) {
+  copymodp(a, (fe25519*)k);
+}
+
+/* The canonical value, without branches: bit 255 counts as 2^255 = 19,
+   then p is subtracted if the value + 19 reaches 2^255 */
+static inline void
+storemodp(curve25519key_t *k, fe25519 *a) {
+  mp_limb_t t[C25519N], h, m;
+  int c;
+  copymodp((fe25519*)k, a);
+  h = k[0][C25519N - 1] >> (GMP_LIMB_BITS - 1);
+  k[0][C25519N - 1] &= ~C25519TOPLIMBBIT;
+  mpn_add_1((mp_limb_t*)k, (mp_limb_t*)k, C25519N, h * 19);
+  mpn_add_1(t, (mp_limb_t*)k, C25519N, 19);
+  m = 0 - (t[C25519N - 1] >> (GMP_LIMB_BITS - 1));
+  t[C25519N - 1] &= ~C25519TOPLIMBBIT;
+  for (c = 0; c < C25519N; c++) {
+    k[0][c] ^= (k[0][c] ^ t[c]) & m;
+  }
+}
+
+/* A carry out of the top limb is added back as 38; if that carries
+   again the value left is below 38, so the last addition cannot */
+static inline
+void addmodp(fe25519 *a, fe25519 *b) {
+  mp_limb_t c;
+  C25519COUNT(ADD);
+  c = mpn_add_n((mp_limb_t*)a, (mp_limb_t*)a, (mp_limb_t*)b, C25519N);
+  c = mpn_add_1((mp_limb_t*)a, (mp_limb_t*)a, C25519N, c * 38);
+  a[0][0] += c * 38;
+}
+
+/* Likewise a borrow is taken back as 38 */
+static inline
+void submodp(fe25519 *a, fe25519 *b) {
+  mp_limb_t c;
+  C25519COUNT(SUB);
+  c = mpn_sub_n((mp_limb_t*)a, (mp_limb_t*)a, (mp_limb_t*)b, C25519N);
+  c = mpn_sub_1((mp_limb_t*)a, (mp_limb_t*)a, C25519N, c * 38);
+  a[0][0] -= c * 38;
+}
+
+/* a = d mod 2^256 - 38, for a 512-bit d: the upper half times
+   2^256 = 38, then the carry again */
+static inline void
+mpnreducemodp(fe25519 *a, mp_limb_t *d) {
+  mp_limb_t r = mpn_addmul_1(d, d+C25519N, C25519N, 19*2);
+  r = mpn_add_1((mp_limb_t*)a, d, C25519N, r * (19*2));
+  a[0][0] += r * (19*2);
+}
+
+static inline void
+mpnmulmodp(fe25519 *a, fe25519 *b) {
+  mp_limb_t d[C25519N*2];
+  mpn_mul_n(d, (mp_limb_t*)a, (mp_limb_t*)b, C25519N);
+  if (0) {
+    // unoptimized, this makes the curve25519 function ~150% slower
+    mp_limb_t r[C25519N+1];
+    mpn_tdiv_qr(r, (mp_limb_t*)a, 0, d, C25519N*2, (mp_limb_t*)&p25519, C25519N);
+  } else {
+    mpnreducemodp(a, d);
+  }
+}
+
+/* mpn_sqr computes each cross product once */
+static inline void
+mpnsqrmodp(fe25519 *a) {
+  mp_limb_t d[C25519N*2];
+  mpn_sqr(d, (mp_limb_t*)a, C25519N);
+  mpnreducemodp(a, d);
+}
+
+static inline void
+mpnsqrnmodp(fe25519 *a, unsigned int n) {
+  mp_limb_t d[C25519N*2];
+  while (n--) {
+    mpn_sqr(d, (mp_limb_t*)a, C25519N);
+    mpnreducemodp(a, d);
+  }
+}
+
+static inline void
+mpnmulasmallmodp(fe25519 *a) {
+  const mp_limb_t asmall = 121665; /* (486662 - 2) / 4; */
+  if (0) {
+    // unoptimized: this makes the function ~5 % slower
+    mp_limb_t d[C25519N+1]; mp_limb_t r[2];
+    d[C25519N] = mpn_mul_1(d, (mp_limb_t*)a, C25519N, asmall);
+    mpn_tdiv_qr(r, (mp_limb_t*)a, 0, d, C25519N+1, (mp_limb_t*)&p25519, C25519N);
+  } else {
+    mp_limb_t r = mpn_mul_1((mp_limb_t*)a, (mp_limb_t*)a, C25519N, asmall);
+    // Limb size must be at least 32-bits for this to work
+    // r = mpn_mul_1((mp_limb_t*)a, (mp_limb_t*)a, C25519N, r*19*2);
+    r = mpn_add_1((mp_limb_t*)a, (mp_limb_t*)a, C25519N, r * (19*2));
+    a[0][0] += r * (19*2);
+  }
+}
+
+/* a = a * 121665 + b, with a single carry out of the top limb */
+static inline void
+mpnmulasmalladdmodp(fe25519 *a, fe25519 *b) {
+  mp_limb_t t[C25519N], r;
+  mpn_copyi(t, (mp_limb_t*)b, C25519N);
+  r = mpn_addmul_1(t, (mp_limb_t*)a, C25519N, 121665);
+  r = mpn_add_1((mp_limb_t*)a, t, C25519N, r * (19*2));
+  a[0][0] += r * (19*2);
+}
+
+/* With C25519_MULX these go through the implementation chosen for the
+   processor when the library was loaded */
+static inline void
+mulmodp(fe25519 *a, fe25519 *b) {
+  C25519COUNT(MUL);
+#ifdef C25519_MULX
+  curve25519mulx_mul((mp_limb_t*)a, (mp_limb_t*)b);
+#else
+  mpnmulmodp(a, b);
+#endif
+}
+
+static inline void
+sqrmodp(fe25519 *a) {
+  C25519COUNT(SQR);
+#ifdef C25519_MULX
+  curve25519mulx_sqr((mp_limb_t*)a);
+#else
+  mpnsqrmodp(a);
+#endif
+}
+
+/* n squarings in a row: a = a ** (2^n) */
+static inline void
+sqrnmodp(fe25519 *a, unsigned int n) {
+  C25519COUNTN(SQR, n);
+#ifdef C25519_MULX
+  curve25519mulx_sqrn((mp_limb_t*)a, n);
+#else
+  mpnsqrnmodp(a, n);
+#endif
+}
+
+static inline void
+mulasmall(fe25519 *a) {
+  C25519COUNT(MULASMALL);
+#ifdef C25519_MULX
+  curve25519mulx_mulasmall((mp_limb_t*)a);
+#else
+  mpnmulasmallmodp(a);
+#endif
+}
+
+/* a = a * 121665 + b, as mulasmall(a); addmodp(a, b) */
+static inline void
+mulasmalladdmodp(fe25519 *a, fe25519 *b) {
+  C25519COUNT(MULASMALL);
+  C25519COUNT(ADD);
+#ifdef C25519_MULX
+  curve25519mulx_mulasmalladd((mp_limb_t*)a, (mp_limb_t*)b);
+#else
+  mpnmulasmalladdmodp(a, b);
+#endif
+}
+
+#endif /* C25519_FE51 */
+
+/* a = a ** (p-2), by the usual chain of 254 squarings and 11
+   multiplications: t = a ** (2^k - 1) for k = 5, 10, 20, 50, 100 then
+   250, and a ** (p-2) = (a ** (2^250 - 1)) ** 32 * a ** 11 */
+static inline void
+invchainmodp(fe25519 *a) {
+  fe25519 a2, a11, t5, t10, t50, t;
+  copymodp(&a2, a); sqrmodp(&a2);
+  copymodp(&t, &a2); sqrnmodp(&t, 2);
+  mulmodp(&t, a);			/* 9 */
+  copymodp(&a11, &t); mulmodp(&a11, &a2);	/* 11 */
+  copymodp(&t5, &a11); sqrmodp(&t5);
+  mulmodp(&t5, &t);			/* 2^5 - 1 */
+  copymodp(&t10, &t5); sqrnmodp(&t10, 5);
+  mulmodp(&t10, &t5);			/* 2^10 - 1 */
+  copymodp(&t, &t10); sqrnmodp(&t, 10);
+  mulmodp(&t, &t10);			/* 2^20 - 1 */
+  copymodp(&t50, &t); sqrnmodp(&t50, 20);
+  mulmodp(&t50, &t);			/* 2^40 - 1 */
+  sqrnmodp(&t50, 10);
+  mulmodp(&t50, &t10);			/* 2^50 - 1 */
+  copymodp(&t, &t50); sqrnmodp(&t, 50);
+  mulmodp(&t, &t50);			/* 2^100 - 1 */
+  copymodp(&t10, &t); sqrnmodp(&t10, 100);
+  mulmodp(&t10, &t);			/* 2^200 - 1 */
+  sqrnmodp(&t10, 50);
+  mulmodp(&t10, &t50);			/* 2^250 - 1 */
+  sqrnmodp(&t10, 5);
+  mulmodp(&t10, &a11);			/* 2^255 - 21 */
+  copymodp(a, &t10);
+}
+
+#ifdef C25519_HAVE_SAFEGCD
+/* The same through safegcd (curve25519safegcd.h), on the stored form */
+static inline void
+invgcdmodp(fe25519 *a) {
+  curve25519key_t k;
+  storemodp(&k, a);
+  curve25519safegcd(&k, &k);
+  loadmodp(a, &k);
+}
+#endif
+
+/* invmodp(0) = 0.  safegcd takes about half the time of the chain
+   with either backend (see curve25519bench); C25519_INV_CHAIN, or INV
+   in the Makefile, selects the chain instead */
+static inline void
+invmodp(fe25519 *a) {
+  C25519COUNT(INV);
+#if defined(C25519_HAVE_SAFEGCD) && !defined(C25519_INV_CHAIN)
+  invgcdmodp(a);
+#else
+  invchainmodp(a);
+#endif
+}
+
+#endif /* __CURVE25519LIB_FE25519_H__ */
@@ -0,0 +1,513 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Arithmetic modulo p = 2^255 - 19 as a C++ template, internal to the
+ * library (see curve25519cxx.cc).
+ *
+ * Fe25519<Radix, Limbs> keeps an element in Limbs words of Radix bits.
+ * Fe25519<64, 4> is saturated, with values anywhere in [0, 2^256);
+ * the unsaturated ones, such as Fe25519<51, 5>, let the limbs grow
+ * between multiplications as the FE51 backend of fe25519.h.  All the
+ * loops have compile-time bounds, so each operation is unrolled and
+ * inlined into the ladder, which is written once over the field type.
+ *
+ * As in fe25519.h, the operations work in place: a.add(b) computes
+ * a = a + b; load() takes the whole 256-bit key modulo p, and store()
+ * always gives the canonical value in [0, p).
+ */
+
+#ifndef __CURVE25519LIB_FE25519_HH__
+#define __CURVE25519LIB_FE25519_HH__
+
+#include <stdint.h>
+#include "curve25519.h"
+
+#ifndef __SIZEOF_INT128__
+#error "Fe25519 requires unsigned __int128"
+#endif
+
+namespace c25519 {
+
+typedef unsigned __int128 u128;
+
+/* The loops over the limbs are unrolled whatever the optimization level */
+#if defined(__clang__)
+#define C25519UNROLL _Pragma("unroll")
+#elif defined(__GNUC__)
+#define C25519UNROLL _Pragma("GCC unroll 16")
+#else
+#define C25519UNROLL
+#endif
+
+/* Word i of the key, least significant first, whatever its limb size */
+static inline uint64_t
+keyword(const curve25519key_t *k, unsigned int i) {
+#if C25519LIMBBITS == 64
+  return k[0][i];
+#else
+  return k[0][2 * i] | ((uint64_t)k[0][2 * i + 1] << 32);
+#endif
+}
+
+static inline void
+setkeyword(curve25519key_t *k, unsigned int i, uint64_t v) {
+#if C25519LIMBBITS == 64
+  k[0][i] = v;
+#else
+  k[0][2 * i] = (curve25519limb_t)v;
+  k[0][2 * i + 1] = (curve25519limb_t)(v >> 32);
+#endif
+}
+
+/* Unsaturated limbs: 2^(Radix * Limbs) = 2^255 = 19 */
+template <unsigned Radix, unsigned Limbs>
+struct Fe25519 {
+  static_assert(Radix < 64 && Radix * Limbs == 255, "the limbs must hold exactly 255 bits");
+  /* A column of a product sums Limbs products of limbs below
+     2^(Radix + 3), some of them times 38 */
+  static_assert(2 * (Radix + 3) + 6 + 5 < 128, "the columns of a product would overflow");
+
+  static constexpr uint64_t mask = (((uint64_t)1) << Radix) - 1;
+  /* 4p, limb by limb, so that subtracting a carried value never
+     underflows */
+  static constexpr uint64_t p4lo = 4 * (mask - 18);
+  static constexpr uint64_t p4 = 4 * mask;
+
+  uint64_t v[Limbs];
+
+  void set(unsigned int x) {
+    v[0] = x;
+    C25519UNROLL
+    for (unsigned int i = 1; i < Limbs; i++) {
+      v[i] = 0;
+    }
+  }
+
+  /* Exchanges a and b if s is 1, without branching on s */
+  static void cswap(Fe25519 &a, Fe25519 &b, unsigned int s) {
+    uint64_t m = -(uint64_t)s;
+    C25519UNROLL
+    for (unsigned int i = 0; i < Limbs; i++) {
+      uint64_t t = (a.v[i] ^ b.v[i]) & m;
+      a.v[i] ^= t;
+      b.v[i] ^= t;
+    }
+  }
+
+  void load(const curve25519key_t *k) {
+    C25519UNROLL
+    for (unsigned int i = 0; i < Limbs; i++) {
+      unsigned int b = i * Radix, w = b / 64, o = b % 64;
+      uint64_t x = keyword(k, w) >> o;
+      if ((o + Radix > 64) && (w < 3)) {
+	x |= keyword(k, w + 1) << (64 - o);
+      }
+      v[i] = x & mask;
+    }
+    v[0] += 19 * (keyword(k, 3) >> 63);
+  }
+
+  void carry() {
+    C25519UNROLL
+    for (unsigned int i = 0; i + 1 < Limbs; i++) {
+      v[i + 1] += v[i] >> Radix;
+      v[i] &= mask;
+    }
+    v[0] += 19 * (v[Limbs - 1] >> Radix);
+    v[Limbs - 1] &= mask;
+  }
+
+  void store(curve25519key_t *k) const {
+    Fe25519 t = *this;
+    uint64_t q, w[4] = { 0, 0, 0, 0 };
+    t.carry();
+    t.carry();
+    /* Now t < 2^255; q = 1 iff t >= p */
+    q = (t.v[0] + 19) >> Radix;
+    C25519UNROLL
+    for (unsigned int i = 1; i < Limbs; i++) {
+      q = (t.v[i] + q) >> Radix;
+    }
+    t.v[0] += 19 * q;
+    C25519UNROLL
+    for (unsigned int i = 0; i + 1 < Limbs; i++) {
+      t.v[i + 1] += t.v[i] >> Radix;
+      t.v[i] &= mask;
+    }
+    t.v[Limbs - 1] &= mask;
+    C25519UNROLL
+    for (unsigned int i = 0; i < Limbs; i++) {
+      unsigned int b = i * Radix, o = b % 64;
+      w[b / 64] |= t.v[i] << o;
+      if ((o + Radix > 64) && (b / 64 < 3)) {
+	w[b / 64 + 1] |= t.v[i] >> (64 - o);
+      }
+    }
+    C25519UNROLL
+    for (unsigned int i = 0; i < 4; i++) {
+      setkeyword(k, i, w[i]);
+    }
+  }
+
+  void add(const Fe25519 &b) {
+    C25519UNROLL
+    for (unsigned int i = 0; i < Limbs; i++) {
+      v[i] += b.v[i];
+    }
+  }
+
+  void sub(const Fe25519 &b) {
+    v[0] = (v[0] + p4lo) - b.v[0];
+    C25519UNROLL
+    for (unsigned int i = 1; i < Limbs; i++) {
+      v[i] = (v[i] + p4) - b.v[i];
+    }
+  }
+
+  /* Column k collects the products a[i] b[j] with i + j = k, and 19
+     times those with i + j = k + Limbs */
+  void reduce(u128 *t) {
+    uint64_t c;
+    C25519UNROLL
+    for (unsigned int i = 0; i + 1 < Limbs; i++) {
+      t[i + 1] += (uint64_t)(t[i] >> Radix);
+      v[i] = (uint64_t)t[i] & mask;
+    }
+    c = (uint64_t)(t[Limbs - 1] >> Radix);
+    v[Limbs - 1] = (uint64_t)t[Limbs - 1] & mask;
+    v[0] += c * 19;
+    v[1] += v[0] >> Radix;
+    v[0] &= mask;
+  }
+
+  void mul(const Fe25519 &b) {
+    u128 t[Limbs];
+    uint64_t b19[Limbs];
+    C25519UNROLL
+    for (unsigned int j = 0; j < Limbs; j++) {
+      b19[j] = 19 * b.v[j];
+    }
+    C25519UNROLL
+    for (unsigned int k = 0; k < Limbs; k++) {
+      t[k] = 0;
+      C25519UNROLL
+      for (unsigned int i = 0; i < Limbs; i++) {
+	t[k] += (u128)v[i] * ((i <= k) ? b.v[k - i] : b19[k + Limbs - i]);
+      }
+    }
+    reduce(t);
+  }
+
+  /* Each product of two different limbs is taken once, and doubled */
+  void sqr() {
+    u128 t[Limbs];
+    uint64_t d[Limbs], d19[Limbs];
+    C25519UNROLL
+    for (unsigned int i = 0; i < Limbs; i++) {
+      d[i] = 2 * v[i];
+      d19[i] = 38 * v[i];
+      t[i] = 0;
+    }
+    C25519UNROLL
+    for (unsigned int i = 0; i < Limbs; i++) {
+      t[(2 * i) % Limbs] += (u128)v[i] * ((2 * i < Limbs) ? v[i] : 19 * v[i]);
+      C25519UNROLL
+      for (unsigned int j = i + 1; j < Limbs; j++) {
+	t[(i + j) % Limbs] += (u128)v[j] * ((i + j < Limbs) ? d[i] : d19[i]);
+      }
+    }
+    reduce(t);
+  }
+
+  void mulasmall() {
+    u128 t[Limbs];
+    C25519UNROLL
+    for (unsigned int i = 0; i < Limbs; i++) {
+      t[i] = (u128)v[i] * 121665;
+    }
+    reduce(t);
+  }
+};
+
+/* Saturated limbs, reduced modulo 2^256 - 38 = 2p: every value in
+   [0, 2^256) is allowed, and store() makes it canonical */
+template <>
+struct Fe25519<64, 4> {
+  uint64_t v[4];
+
+  void set(unsigned int x) {
+    v[0] = x;
+    v[1] = v[2] = v[3] = 0;
+  }
+
+  static void cswap(Fe25519 &a, Fe25519 &b, unsigned int s) {
+    uint64_t m = -(uint64_t)s;
+    C25519UNROLL
+    for (unsigned int i = 0; i < 4; i++) {
+      uint64_t t = (a.v[i] ^ b.v[i]) & m;
+      a.v[i] ^= t;
+      b.v[i] ^= t;
+    }
+  }
+
+  void load(const curve25519key_t *k) {
+    C25519UNROLL
+    for (unsigned int i = 0; i < 4; i++) {
+      v[i] = keyword(k, i);
+    }
+  }
+
+  void store(curve25519key_t *k) const {
+    uint64_t x[4], t[4], c, m;
+    /* Bit 255 counts as 19; then x < 2^255 + 19 */
+    c = 19 * (v[3] >> 63);
+    x[3] = v[3] & 0x7fffffffffffffff;
+    C25519UNROLL
+    for (unsigned int i = 0; i < 3; i++) {
+      x[i] = v[i] + c;
+      c = x[i] < c;
+    }
+    x[3] += c;
+    /* x >= p iff x + 19 >= 2^255, and then x - p = x + 19 - 2^255 */
+    c = 19;
+    C25519UNROLL
+    for (unsigned int i = 0; i < 4; i++) {
+      t[i] = x[i] + c;
+      c = t[i] < c;
+    }
+    m = -(t[3] >> 63);
+    t[3] &= 0x7fffffffffffffff;
+    C25519UNROLL
+    for (unsigned int i = 0; i < 4; i++) {
+      setkeyword(k, i, x[i] ^ ((x[i] ^ t[i]) & m));
+    }
+  }
+
+  /* v = t + 38 c, where 2^256 c has been dropped from the value, c small */
+  void fold(const uint64_t *t, uint64_t c) {
+    u128 s = (u128)t[0] + (u128)c * 38;
+    v[0] = (uint64_t)s;
+    C25519UNROLL
+    for (unsigned int i = 1; i < 4; i++) {
+      s = (u128)t[i] + (uint64_t)(s >> 64);
+      v[i] = (uint64_t)s;
+    }
+    /* A last carry leaves v small, so adding 38 again cannot carry */
+    v[0] += 38 * (uint64_t)(s >> 64);
+  }
+
+  void add(const Fe25519 &b) {
+    uint64_t t[4];
+    u128 s = 0;
+    C25519UNROLL
+    for (unsigned int i = 0; i < 4; i++) {
+      s = (u128)v[i] + b.v[i] + (uint64_t)(s >> 64);
+      t[i] = (uint64_t)s;
+    }
+    fold(t, (uint64_t)(s >> 64));
+  }
+
+  /* a - b + 2^256 when it borrows, minus 38 for that 2^256 */
+  void sub(const Fe25519 &b) {
+    uint64_t t[4], c = 0;
+    C25519UNROLL
+    for (unsigned int i = 0; i < 4; i++) {
+      u128 d = (u128)v[i] - b.v[i] - c;
+      t[i] = (uint64_t)d;
+      c = (uint64_t)(d >> 64) & 1;
+    }
+    u128 d = (u128)t[0] - 38 * c;
+    v[0] = (uint64_t)d;
+    c = (uint64_t)(d >> 64) & 1;
+    C25519UNROLL
+    for (unsigned int i = 1; i < 4; i++) {
+      d = (u128)t[i] - c;
+      v[i] = (uint64_t)d;
+      c = (uint64_t)(d >> 64) & 1;
+    }
+    /* A second borrow leaves v[0] >= 2^64 - 38 * 2, so the next cannot */
+    v[0] -= 38 * c;
+  }
+
+  /* r = the 512-bit t folded into 256 bits */
+  void reduce(const uint64_t *t) {
+    uint64_t l[4];
+    u128 s = 0;
+    C25519UNROLL
+    for (unsigned int i = 0; i < 4; i++) {
+      s = (u128)t[i + 4] * 38 + t[i] + (uint64_t)(s >> 64);
+      l[i] = (uint64_t)s;
+    }
+    fold(l, (uint64_t)(s >> 64));
+  }
+
+  void mul(const Fe25519 &b) {
+    uint64_t t[8];
+    C25519UNROLL
+    for (unsigned int i = 0; i < 8; i++) {
+      t[i] = 0;
+    }
+    C25519UNROLL
+    for (unsigned int i = 0; i < 4; i++) {
+      uint64_t c = 0;
+      C25519UNROLL
+      for (unsigned int j = 0; j < 4; j++) {
+	u128 p = (u128)v[i] * b.v[j] + t[i + j] + c;
+	t[i + j] = (uint64_t)p;
+	c = (uint64_t)(p >> 64);
+      }
+      t[i + 4] = c;
+    }
+    reduce(t);
+  }
+
+  /* The products of two different limbs once, doubled by a shift, then
+     the squares of the limbs */
+  void sqr() {
+    uint64_t t[8], c;
+    C25519UNROLL
+    for (unsigned int i = 0; i < 8; i++) {
+      t[i] = 0;
+    }
+    C25519UNROLL
+    for (unsigned int i = 0; i < 3; i++) {
+      c = 0;
+      C25519UNROLL
+      for (unsigned int j = i + 1; j < 4; j++) {
+	u128 p = (u128)v[i] * v[j] + t[i + j] + c;
+	t[i + j] = (uint64_t)p;
+	c = (uint64_t)(p >> 64);
+      }
+      t[i + 4] = c;
+    }
+    t[7] = t[6] >> 63;
+    C25519UNROLL
+    for (unsigned int i = 6; i > 0; i--) {
+      t[i] = (t[i] << 1) | (t[i - 1] >> 63);
+    }
+    c = 0;
+    C25519UNROLL
+    for (unsigned int i = 0; i < 4; i++) {
+      u128 p = (u128)v[i] * v[i];
+      u128 s = (u128)t[2 * i] + (uint64_t)p + c;
+      t[2 * i] = (uint64_t)s;
+      s = (u128)t[2 * i + 1] + (uint64_t)(p >> 64) + (uint64_t)(s >> 64);
+      t[2 * i + 1] = (uint64_t)s;
+      c = (uint64_t)(s >> 64);
+    }
+    reduce(t);
+  }
+
+  void mulasmall() {
+    uint64_t t[4];
+    u128 s = 0;
+    C25519UNROLL
+    for (unsigned int i = 0; i < 4; i++) {
+      s = (u128)v[i] * 121665 + (uint64_t)(s >> 64);
+      t[i] = (uint64_t)s;
+    }
+    fold(t, (uint64_t)(s >> 64));
+  }
+};
+
+/* a^(p-2) = a^(2^255 - 21), by the usual chain of 254 squarings and 11
+   multiplications */
+template <class F>
+static inline void
+sqrn(F &a, unsigned int n) {
+  while (n--) {
+    a.sqr();
+  }
+}
+
+template <class F>
+static inline void
+invert(F &a) {
+  F t0, t1, t2, t3;
+  t0 = a; t0.sqr();			/* 2 */
+  t1 = t0; sqrn(t1, 2);			/* 8 */
+  t1.mul(a);				/* 9 */
+  t0.mul(t1);				/* 11 */
+  t2 = t0; t2.sqr();			/* 22 */
+  t1.mul(t2);				/* 2^5 - 1 */
+  t2 = t1; sqrn(t2, 5); t1.mul(t2);	/* 2^10 - 1 */
+  t2 = t1; sqrn(t2, 10); t2.mul(t1);	/* 2^20 - 1 */
+  t3 = t2; sqrn(t3, 20); t2.mul(t3);	/* 2^40 - 1 */
+  sqrn(t2, 10); t1.mul(t2);		/* 2^50 - 1 */
+  t2 = t1; sqrn(t2, 50); t2.mul(t1);	/* 2^100 - 1 */
+  t3 = t2; sqrn(t3, 100); t2.mul(t3);	/* 2^200 - 1 */
+  sqrn(t2, 50); t1.mul(t2);		/* 2^250 - 1 */
+  sqrn(t1, 5); t1.mul(t0);		/* 2^255 - 21 */
+  a = t1;
+}
+
+/* As ladderstep() in mont25519.h */
+template <class F>
+static inline void
+ladderstep(F &x_2, F &z_2, F &x_3, F &z_3, const F &x_1) {
+  F a = x_2, b = x_2, c = x_3, d = x_3, e;
+  a.add(z_2);				/* A = x_2 + z_2 */
+  b.sub(z_2);				/* B = x_2 - z_2 */
+  c.add(z_3);				/* C = x_3 + z_3 */
+  d.sub(z_3);				/* D = x_3 - z_3 */
+  d.mul(a);				/* DA */
+  c.mul(b);				/* CB */
+  a.sqr();				/* AA */
+  b.sqr();				/* BB */
+  x_3 = d; x_3.add(c); x_3.sqr();	/* (DA + CB)^2 */
+  z_3 = d; z_3.sub(c); z_3.sqr();	/* (DA - CB)^2 */
+  z_3.mul(x_1);
+  x_2 = a; x_2.mul(b);			/* AA BB */
+  e = a; e.sub(b);			/* E = AA - BB */
+  z_2 = e; z_2.mulasmall();
+  z_2.add(a);
+  z_2.mul(e);				/* E (AA + 121665 E) */
+}
+
+/* r = curve25519(f, c), processing all the 256 bits of f with
+   conditional swaps, as ladderproj() in curve25519.c */
+template <class F>
+static inline void
+scalarmult(curve25519key_t *r, const curve25519key_t *f, const curve25519key_t *c) {
+  F x_1, x_2, z_2, x_3, z_3;
+  unsigned int s = 0;
+  int n;
+
+  x_1.load(c);
+  x_2.set(1);
+  z_2.set(0);
+  x_3 = x_1;
+  z_3.set(1);
+  for (n = C25519BITS - 1; n >= 0; n--) {
+    unsigned int b = (keyword(f, n / 64) >> (n % 64)) & 1;
+    F::cswap(x_2, x_3, s ^ b);
+    F::cswap(z_2, z_3, s ^ b);
+    s = b;
+    ladderstep(x_2, z_2, x_3, z_3, x_1);
+  }
+  F::cswap(x_2, x_3, s);
+  F::cswap(z_2, z_3, s);
+
+  invert(z_2);
+  x_2.mul(z_2);
+  x_2.store(r);
+}
+
+} /* namespace c25519 */
+
+#undef C25519UNROLL
+
+#endif /* __CURVE25519LIB_FE25519_HH__ */
@@ -0,0 +1,151 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "curve25519.h"
+#include "ge25519.h"
+
+extern void
+ge25519_p3_0(ge25519_p3 *h) {
+  setmodp(&h->X, 0);
+  setmodp(&h->Y, 1);
+  setmodp(&h->Z, 1);
+  setmodp(&h->T, 0);
+}
+
+extern void
+ge25519_precomp_0(ge25519_precomp *h) {
+  setmodp(&h->yplusx, 1);
+  setmodp(&h->yminusx, 1);
+  setmodp(&h->xy2d, 0);
+}
+
+extern void
+ge25519_p3_to_p2(ge25519_p2 *r, ge25519_p3 *p) {
+  copymodp(&r->X, &p->X);
+  copymodp(&r->Y, &p->Y);
+  copymodp(&r->Z, &p->Z);
+}
+
+extern void
+ge25519_p3_to_cached(ge25519_cached *r, ge25519_p3 *p, fe25519 *d2) {
+  copymodp(&r->YplusX, &p->Y); addmodp(&r->YplusX, &p->X);
+  copymodp(&r->YminusX, &p->Y); submodp(&r->YminusX, &p->X);
+  copymodp(&r->Z, &p->Z);
+  copymodp(&r->T2d, &p->T); mulmodp(&r->T2d, d2);
+}
+
+extern void
+ge25519_p1p1_to_p2(ge25519_p2 *r, ge25519_p1p1 *p) {
+  copymodp(&r->X, &p->X); mulmodp(&r->X, &p->T);
+  copymodp(&r->Y, &p->Y); mulmodp(&r->Y, &p->Z);
+  copymodp(&r->Z, &p->Z); mulmodp(&r->Z, &p->T);
+}
+
+extern void
+ge25519_p1p1_to_p3(ge25519_p3 *r, ge25519_p1p1 *p) {
+  copymodp(&r->X, &p->X); mulmodp(&r->X, &p->T);
+  copymodp(&r->Y, &p->Y); mulmodp(&r->Y, &p->Z);
+  copymodp(&r->Z, &p->Z); mulmodp(&r->Z, &p->T);
+  copymodp(&r->T, &p->X); mulmodp(&r->T, &p->Y);
+}
+
+extern void
+ge25519_p2_dbl(ge25519_p1p1 *r, ge25519_p2 *p) {
+  fe25519 t0;
+  copymodp(&r->X, &p->X); sqrmodp(&r->X);
+  copymodp(&r->Z, &p->Y); sqrmodp(&r->Z);
+  copymodp(&r->T, &p->Z); sqrmodp(&r->T); addmodp(&r->T, &r->T);
+  copymodp(&t0, &p->X); addmodp(&t0, &p->Y); sqrmodp(&t0);
+  copymodp(&r->Y, &r->Z); addmodp(&r->Y, &r->X);
+  submodp(&r->Z, &r->X);
+  copymodp(&r->X, &t0); submodp(&r->X, &r->Y);
+  carrymodp(&r->Z);
+  submodp(&r->T, &r->Z);
+}
+
+extern void
+ge25519_add(ge25519_p1p1 *r, ge25519_p3 *p, ge25519_cached *q) {
+  fe25519 t0;
+  copymodp(&r->X, &p->Y); addmodp(&r->X, &p->X);
+  copymodp(&r->Y, &p->Y); submodp(&r->Y, &p->X);
+  copymodp(&r->Z, &r->X); mulmodp(&r->Z, &q->YplusX);
+  mulmodp(&r->Y, &q->YminusX);
+  copymodp(&r->T, &q->T2d); mulmodp(&r->T, &p->T);
+  copymodp(&r->X, &p->Z); mulmodp(&r->X, &q->Z);
+  copymodp(&t0, &r->X); addmodp(&t0, &r->X);
+  copymodp(&r->X, &r->Z); submodp(&r->X, &r->Y);
+  addmodp(&r->Y, &r->Z);
+  copymodp(&r->Z, &t0); addmodp(&r->Z, &r->T);
+  submodp(&t0, &r->T); copymodp(&r->T, &t0);
+}
+
+extern void
+ge25519_sub(ge25519_p1p1 *r, ge25519_p3 *p, ge25519_cached *q) {
+  fe25519 t0;
+  copymodp(&r->X, &p->Y); addmodp(&r->X, &p->X);
+  copymodp(&r->Y, &p->Y); submodp(&r->Y, &p->X);
+  copymodp(&r->Z, &r->X); mulmodp(&r->Z, &q->YminusX);
+  mulmodp(&r->Y, &q->YplusX);
+  copymodp(&r->T, &q->T2d); mulmodp(&r->T, &p->T);
+  copymodp(&r->X, &p->Z); mulmodp(&r->X, &q->Z);
+  copymodp(&t0, &r->X); addmodp(&t0, &r->X);
+  copymodp(&r->X, &r->Z); submodp(&r->X, &r->Y);
+  addmodp(&r->Y, &r->Z);
+  copymodp(&r->Z, &t0); submodp(&r->Z, &r->T);
+  addmodp(&t0, &r->T); copymodp(&r->T, &t0);
+}
+
+extern void
+ge25519_madd(ge25519_p1p1 *r, ge25519_p3 *p, ge25519_precomp *q) {
+  fe25519 t0;
+  copymodp(&r->X, &p->Y); addmodp(&r->X, &p->X);
+  copymodp(&r->Y, &p->Y); submodp(&r->Y, &p->X);
+  copymodp(&r->Z, &r->X); mulmodp(&r->Z, &q->yplusx);
+  mulmodp(&r->Y, &q->yminusx);
+  copymodp(&r->T, &q->xy2d); mulmodp(&r->T, &p->T);
+  copymodp(&t0, &p->Z); addmodp(&t0, &p->Z);
+  copymodp(&r->X, &r->Z); submodp(&r->X, &r->Y);
+  addmodp(&r->Y, &r->Z);
+  copymodp(&r->Z, &t0); addmodp(&r->Z, &r->T);
+  submodp(&t0, &r->T); copymodp(&r->T, &t0);
+}
+
+extern void
+ge25519_precomp_cmov(ge25519_precomp *t, ge25519_precomp *b, unsigned int v) {
+  cmovmodp(&t->yplusx, &b->yplusx, v);
+  cmovmodp(&t->yminusx, &b->yminusx, v);
+  cmovmodp(&t->xy2d, &b->xy2d, v);
+}
+
+extern void
+ge25519_precomp_cneg(ge25519_precomp *t, unsigned int v) {
+  fe25519 n;
+  copymodp(&n, &t->yplusx);
+  cmovmodp(&t->yplusx, &t->yminusx, v);
+  cmovmodp(&t->yminusx, &n, v);
+  setmodp(&n, 0); submodp(&n, &t->xy2d);
+  cmovmodp(&t->xy2d, &n, v);
+}
+
+extern void
+ge25519_to_montgomery(curve25519key_t *u, ge25519_p3 *p) {
+  fe25519 n, d;
+  copymodp(&n, &p->Z); addmodp(&n, &p->Y);
+  copymodp(&d, &p->Z); submodp(&d, &p->Y);
+  invmodp(&d);
+  mulmodp(&n, &d);
+  storemodp(u, &n);
+}
@@ -0,0 +1,57 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Points of the twisted Edwards curve -x^2 + y^2 = 1 + d x^2 y^2, with
+ * d = -121665/121666, which is birationally equivalent to Curve25519
+ * through u = (1 + y) / (1 - y).  Internal to the library.
+ *
+ * Representations follow the "ref10" code by Bernstein et al.:
+ *   ge25519_p2:      (X:Y:Z) with x = X/Z, y = Y/Z
+ *   ge25519_p3:      (X:Y:Z:T) with additionally XY = ZT
+ *   ge25519_p1p1:    ((X:Z), (Y:T)) with x = X/Z, y = Y/T
+ *   ge25519_precomp: (y+x, y-x, 2dxy), affine
+ *   ge25519_cached:  (Y+X, Y-X, Z, 2dT)
+ */
+
+#ifndef __CURVE25519LIB_GE25519_H__
+#define __CURVE25519LIB_GE25519_H__
+
+#include "fe25519.h"
+
+typedef struct { fe25519 X, Y, Z; } ge25519_p2;
+typedef struct { fe25519 X, Y, Z, T; } ge25519_p3;
+typedef struct { fe25519 X, Y, Z, T; } ge25519_p1p1;
+typedef struct { fe25519 yplusx, yminusx, xy2d; } ge25519_precomp;
+typedef struct { fe25519 YplusX, YminusX, Z, T2d; } ge25519_cached;
+
+extern void ge25519_p3_0(ge25519_p3 *h);
+extern void ge25519_precomp_0(ge25519_precomp *h);
+extern void ge25519_p3_to_p2(ge25519_p2 *r, ge25519_p3 *p);
+extern void ge25519_p3_to_cached(ge25519_cached *r, ge25519_p3 *p, fe25519 *d2);
+extern void ge25519_p1p1_to_p2(ge25519_p2 *r, ge25519_p1p1 *p);
+extern void ge25519_p1p1_to_p3(ge25519_p3 *r, ge25519_p1p1 *p);
+extern void ge25519_p2_dbl(ge25519_p1p1 *r, ge25519_p2 *p);
+extern void ge25519_add(ge25519_p1p1 *r, ge25519_p3 *p, ge25519_cached *q);
+extern void ge25519_sub(ge25519_p1p1 *r, ge25519_p3 *p, ge25519_cached *q);
+extern void ge25519_madd(ge25519_p1p1 *r, ge25519_p3 *p, ge25519_precomp *q);
+/* t = b if v is 1, unchanged if v is 0 */
+extern void ge25519_precomp_cmov(ge25519_precomp *t, ge25519_precomp *b, unsigned int v);
+/* t = -t if v is 1, unchanged if v is 0 */
+extern void ge25519_precomp_cneg(ge25519_precomp *t, unsigned int v);
+/* Montgomery u = (Z + Y) / (Z - Y), 0 for the neutral element */
+extern void ge25519_to_montgomery(curve25519key_t *u, ge25519_p3 *p);
+
+#endif /* __CURVE25519LIB_GE25519_H__ */
@@ -0,0 +1,177 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Hexadecimal key codecs.  Keys are converted to bytes once, then each
+ * byte to two characters through a table; on processors supporting AVX2
+ * the bulk encoders do all the 32 bytes of a key at once.
+ */
+
+#include <string.h>
+#include "curve25519.h"
+#include "curve25519avx2.h"
+#include "hex.h"
+
+static const char hexchars[16] = {
+  '0', '1', '2', '3', '4', '5', '6', '7',
+  '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+/* 0xff for the characters that are not digits */
+static const unsigned char hexvalues[256] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+/* Writes the 32 bytes as 64 digits, in reverse order if rev is set */
+static void
+encode(char *s, const unsigned char *b, int rev) {
+  unsigned int i;
+  for (i = 0; i < 32; i++) {
+    unsigned int v = b[rev ? 31 - i : i];
+    s[2 * i] = hexchars[v >> 4];
+    s[2 * i + 1] = hexchars[v & 15];
+  }
+}
+
+#ifdef C25519_AVX2
+
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static void
+encode_avx2(char *s, const unsigned char *b, int rev) {
+  const __m256i chars = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+					 '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+					 '0', '1', '2', '3', '4', '5', '6', '7',
+					 '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+  const __m256i mask = _mm256_set1_epi8(15);
+  __m256i v = _mm256_loadu_si256((const __m256i *)b), hi, lo, a, c;
+  if (rev) {
+    const __m256i r = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+				       15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    v = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, r), 0x4e);
+  }
+  hi = _mm256_shuffle_epi8(chars, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+  lo = _mm256_shuffle_epi8(chars, _mm256_and_si256(v, mask));
+  /* Interleaving works within each 128-bit half */
+  a = _mm256_unpacklo_epi8(hi, lo);
+  c = _mm256_unpackhi_epi8(hi, lo);
+  _mm256_storeu_si256((__m256i *)s, _mm256_permute2x128_si256(a, c, 0x20));
+  _mm256_storeu_si256((__m256i *)(s + 32), _mm256_permute2x128_si256(a, c, 0x31));
+}
+
+#endif
+
+static size_t
+encode_n(char *s, curve25519key_t *x, unsigned int n, int rev) {
+  unsigned char b[32];
+  unsigned int i;
+#ifdef C25519_AVX2
+  if (curve25519avx2_available()) {
+    for (i = 0; i < n; i++) {
+      curve25519key_to_bytes(b, x + i);
+      encode_avx2(s + 65 * i, b, rev);
+      s[65 * i + 64] = '\n';
+    }
+    return (size_t)65 * n;
+  }
+#endif
+  for (i = 0; i < n; i++) {
+    curve25519key_to_bytes(b, x + i);
+    encode(s + 65 * i, b, rev);
+    s[65 * i + 64] = '\n';
+  }
+  return (size_t)65 * n;
+}
+
+extern void
+hex_encode(char *s, curve25519key_t *x) {
+  unsigned char b[32];
+  curve25519key_to_bytes(b, x);
+  encode(s, b, 1);
+  s[64] = 0;
+}
+
+extern int
+hex_decode(const char *s, curve25519key_t *x) {
+  unsigned char b[32];
+  unsigned int i = 0;
+  size_t a = strlen(s);
+  memset(b, 0, sizeof(b));
+  while (a > 0) {
+    unsigned int v = hexvalues[(unsigned char)s[--a]];
+    if (v > 15) {
+      return -1;
+    }
+    if (i < 64) {
+      b[i / 2] |= v << (4 * (i % 2));
+      i++;
+    }
+  }
+  curve25519key_from_bytes(x, b);
+  return 0;
+}
+
+extern void
+ibh_encode(char *s, curve25519key_t *x) {
+  unsigned char b[32];
+  curve25519key_to_bytes(b, x);
+  encode(s, b, 0);
+  s[64] = 0;
+}
+
+extern int
+ibh_decode(const char *s, curve25519key_t *x) {
+  unsigned char b[32];
+  unsigned int i;
+  for (i = 0; i < 32; i++) {
+    unsigned int h = hexvalues[(unsigned char)s[2 * i]], l;
+    if (h > 15) {
+      return -1;
+    }
+    l = hexvalues[(unsigned char)s[2 * i + 1]];
+    if (l > 15) {
+      return -1;
+    }
+    b[i] = (h << 4) | l;
+  }
+  curve25519key_from_bytes(x, b);
+  return 0;
+}
+
+extern size_t
+hex_encode_n(char *s, curve25519key_t *x, unsigned int n) {
+  return encode_n(s, x, n, 1);
+}
+
+extern size_t
+ibh_encode_n(char *s, curve25519key_t *x, unsigned int n) {
+  return encode_n(s, x, n, 0);
+}
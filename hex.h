@@ -0,0 +1,40 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CURVE25519LIB_HEX_H__
+#define __CURVE25519LIB_HEX_H__
+
+#include <stddef.h>
+
+/* Hexadecimal: the key as a 64-digit number, most significant digit
+ * first.  Decoding accepts any number of digits, ignoring those beyond
+ * 256 bits, and returns -1 on a character that is not a digit. */
+extern void hex_encode(char *s, curve25519key_t *x);
+extern int hex_decode(const char *s, curve25519key_t *x);
+
+/* Inverted-bytes hexadecimal: the 32 bytes of the key, least
+ * significant first, each as two digits.  Decoding returns -1 unless s
+ * starts with 64 digits. */
+extern void ibh_encode(char *s, curve25519key_t *x);
+extern int ibh_decode(const char *s, curve25519key_t *x);
+
+/* Write the n keys one per line, each followed by a newline rather
+ * than a null character; return the number of characters written,
+ * 65 * n. */
+extern size_t hex_encode_n(char *s, curve25519key_t *x, unsigned int n);
+extern size_t ibh_encode_n(char *s, curve25519key_t *x, unsigned int n);
+
+#endif /* __CURVE25519LIB_HEX_H__ */
@@ -0,0 +1,77 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Steps of the Montgomery ladder on projective (x:z) coordinates,
+ * internal to the library. */
+
+#ifndef __CURVE25519LIB_MONT25519_H__
+#define __CURVE25519LIB_MONT25519_H__
+
+#include <stddef.h>
+#include "fe25519.h"
+
+/* (x_2:z_2) = 2 (x:z) */
+static inline
+void dbl(fe25519 *x_2, fe25519 *z_2, fe25519 *x, fe25519 *z) {
+  fe25519 m, n, o;
+  copymodp(&m, x); addmodp(&m, z); sqrmodp(&m);
+  copymodp(&n, x); submodp(&n, z); sqrmodp(&n);
+  copymodp(&o, &m); submodp(&o, &n);
+  copymodp(x_2, &n); mulmodp(x_2, &m);
+  copymodp(z_2, &o); mulasmalladdmodp(z_2, &m); mulmodp(z_2, &o);
+}
+
+/* (x_3:z_3) = (x:z) + (x_p:z_p), whose difference has affine x_1 */
+static inline
+void sum(fe25519 *x_3, fe25519 *z_3, fe25519 *x, fe25519 *z, fe25519 *x_p, fe25519 *z_p, fe25519 *x_1) {
+  fe25519 k, l, p, q;
+  copymodp(&p, x); submodp(&p, z); copymodp(&k, x_p); addmodp(&k, z_p); mulmodp(&p, &k);
+  copymodp(&q, x); addmodp(&q, z); copymodp(&l, x_p); submodp(&l, z_p); mulmodp(&q, &l);
+  copymodp(x_3, &p); addmodp(x_3, &q); sqrmodp(x_3);
+  copymodp(z_3, &p); submodp(z_3, &q); sqrmodp(z_3); mulmodp(z_3, x_1);
+}
+
+/* One step of the ladder, in place: (x_2:z_2) = 2 (x_2:z_2) and
+   (x_3:z_3) = (x_2:z_2) + (x_3:z_3), whose difference is (x_1:z_1).
+   The sums and differences of the inputs are computed once for both. */
+static inline void
+ladderstepproj(fe25519 *x_2, fe25519 *z_2, fe25519 *x_3, fe25519 *z_3, fe25519 *x_1, fe25519 *z_1) {
+  fe25519 a, c, e;
+  copymodp(&a, x_2); addmodp(&a, z_2);		/* A = x_2 + z_2 */
+  submodp(x_2, z_2);				/* B = x_2 - z_2 */
+  copymodp(&c, x_3); addmodp(&c, z_3);		/* C = x_3 + z_3 */
+  submodp(x_3, z_3);				/* D = x_3 - z_3 */
+  mulmodp(x_3, &a);				/* DA */
+  mulmodp(&c, x_2);				/* CB */
+  sqrmodp(&a);					/* AA */
+  sqrmodp(x_2);					/* BB */
+  copymodp(z_3, x_3); submodp(z_3, &c); sqrmodp(z_3); mulmodp(z_3, x_1);
+  addmodp(x_3, &c); sqrmodp(x_3);
+  if (z_1) {
+    mulmodp(x_3, z_1);
+  }
+  copymodp(z_2, &a); submodp(z_2, x_2);		/* E = AA - BB */
+  copymodp(&e, z_2); mulasmalladdmodp(&e, &a); mulmodp(z_2, &e);
+  mulmodp(x_2, &a);
+}
+
+/* The same with the difference in affine form, z_1 = 1 */
+static inline void
+ladderstep(fe25519 *x_2, fe25519 *z_2, fe25519 *x_3, fe25519 *z_3, fe25519 *x_1) {
+  ladderstepproj(x_2, z_2, x_3, z_3, x_1, NULL);
+}
+
+#endif /* __CURVE25519LIB_MONT25519_H__ */
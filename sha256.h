@@ -0,0 +1,38 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CURVE25519LIB_SHA256_H__
+#define __CURVE25519LIB_SHA256_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* SHA-256 (FIPS 180-4), used by curve25519test to digest its output.
+ * The context is plain data: it can be copied to take the digest of a
+ * prefix, or saved and restored to resume hashing elsewhere. */
+
+typedef struct {
+  uint32_t h[8];
+  uint64_t n;			/* bytes hashed so far */
+  unsigned char buf[64];	/* the last n % 64 of them */
+} sha256_t;
+
+extern void sha256_init(sha256_t *c);
+extern void sha256_update(sha256_t *c, const void *p, size_t n);
+/* Writes the 32-byte digest; c is left unusable */
+extern void sha256_final(sha256_t *c, unsigned char *d);
+
+#endif /* __CURVE25519LIB_SHA256_H__ */
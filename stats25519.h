@@ -0,0 +1,114 @@
+/* Copyright (c) 2007, 2013 Michele Bini
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Instrumentation hooks, internal to the library.
+ *
+ * C25519COUNT(MUL) counts a field operation and C25519COUNTN(SQR, n) n
+ * of them; C25519TIMER(t) starts timing a phase and C25519TIMED(LADDER,
+ * t) records it.  Without C25519_STATS they expand to nothing.  The
+ * counters are per thread and only ever written by their thread, so no
+ * atomic read-modify-write is needed on the hot path; only the block
+ * shared by the threads that could not allocate their own is updated
+ * with atomic adds.
+ */
+
+#ifndef __CURVE25519LIB_STATS25519_H__
+#define __CURVE25519LIB_STATS25519_H__
+
+#ifdef C25519_STATS
+
+#include <stdint.h>
+#include <time.h>
+#include "curve25519stats.h"
+
+struct stats25519 {
+  uint64_t ops[C25519OPS];
+  uint64_t count[C25519PHASES];
+  uint64_t time[C25519PHASES];
+  uint64_t hist[C25519PHASES][C25519STATSBUCKETS];
+  struct stats25519 *next;
+  int shared;
+};
+
+extern _Thread_local struct stats25519 *stats25519_local;
+extern struct stats25519 *stats25519_register(void);
+
+static inline struct stats25519 *
+stats25519(void) {
+  struct stats25519 *s = stats25519_local;
+  return s ? s : stats25519_register();
+}
+
+/* Adds v to the counter c of s, which curve25519_stats_snapshot() reads
+   concurrently */
+static inline void
+stats25519_add(struct stats25519 *s, uint64_t *c, uint64_t v) {
+  if (s->shared) {
+    __atomic_fetch_add(c, v, __ATOMIC_RELAXED);
+  } else {
+    __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+  }
+}
+
+static inline void
+stats25519_count(unsigned int op, uint64_t n) {
+  struct stats25519 *s = stats25519();
+  stats25519_add(s, s->ops + op, n);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define C25519STATSCYCLES 1
+static inline uint64_t
+stats25519_ticks(void) {
+  return __builtin_ia32_rdtsc();
+}
+#else
+#define C25519STATSCYCLES 0
+static inline uint64_t
+stats25519_ticks(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+#endif
+
+static inline void
+stats25519_record(unsigned int phase, uint64_t t) {
+  struct stats25519 *s = stats25519();
+  unsigned int b = t ? 63 - __builtin_clzll(t) : 0;
+  if (b >= C25519STATSBUCKETS) {
+    b = C25519STATSBUCKETS - 1;
+  }
+  stats25519_add(s, s->count + phase, 1);
+  stats25519_add(s, s->time + phase, t);
+  stats25519_add(s, s->hist[phase] + b, 1);
+}
+
+#define C25519COUNT(op) stats25519_count(C25519OP_##op, 1)
+#define C25519COUNTN(op, n) stats25519_count(C25519OP_##op, (n))
+#define C25519TIMER(t) uint64_t t = stats25519_ticks()
+#define C25519TIMED(phase, t) stats25519_record(C25519PHASE_##phase, stats25519_ticks() - (t))
+
+#else
+
+#define C25519COUNT(op)
+#define C25519COUNTN(op, n)
+#define C25519TIMER(t)
+#define C25519TIMED(phase, t)
+
+#endif /* C25519_STATS */
+
+#endif /* __CURVE25519LIB_STATS25519_H__ */